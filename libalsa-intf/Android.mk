@@ -201,6 +201,22 @@ LOCAL_SHARED_LIBRARIES := libc libcutils libalsa-intf
 LOCAL_MODULE_TAGS:= debug
 include $(BUILD_EXECUTABLE)
 
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= ucmlint.c alsa_mixer.c
+LOCAL_MODULE:= ucmlint
+LOCAL_STATIC_LIBRARIES:= libcutils liblog
+LOCAL_MODULE_TAGS:= optional
+LOCAL_LDLIBS += -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES:= ucmbench.c alsa_mixer.c
+LOCAL_MODULE:= ucmbench
+LOCAL_STATIC_LIBRARIES:= libcutils liblog
+LOCAL_MODULE_TAGS:= optional
+LOCAL_LDLIBS += -lpthread -ldl
+include $(BUILD_HOST_EXECUTABLE)
+
 include $(CLEAR_VARS)
 LOCAL_COPY_HEADERS_TO   := mm-audio/libalsa-intf
 LOCAL_COPY_HEADERS      := alsa_audio.h
@@ -18,6 +18,7 @@
 #ifndef _AUDIO_H_
 #define _AUDIO_H_
 
+#include <pthread.h>
 #include <sound/asound.h>
 #define PCM_ERROR_MAX 128
 
@@ -30,6 +31,7 @@ struct pcm {
     unsigned format;
     int running:1;
     int underruns;
+    int overruns;
     unsigned buffer_size;
     unsigned period_size;
     unsigned period_cnt;
@@ -81,6 +83,8 @@ struct mixer_ctl {
     struct mixer *mixer;
     struct snd_ctl_elem_info *info;
     char **ename;
+    /* cached values, NULL if the control is not cached */
+    long long *cache;
 };
 
 #define __snd_alloca(ptr,type) do { *ptr = (type *) alloca(sizeof(type)); memset(*ptr, 0, sizeof(type)); } while (0)
@@ -123,6 +127,21 @@ struct mixer {
     struct snd_ctl_elem_info *info;
     struct mixer_ctl *ctl;
     unsigned count;
+    /* name index of ctl, see mixer_get_control() */
+    unsigned *hash;
+    unsigned hash_size;
+    /* set for handles of mixer_open_shared(), see mixer_close() */
+    char *device;
+    int refs;
+    struct mixer *next;
+    /* value cache of shared handles, cached holds one flag per control
+     * and is cleared by the change events of the card */
+    pthread_mutex_t lock;
+    long long *cache;
+    unsigned char *cached;
+    /* set by our own writes until the card reports the change */
+    unsigned char *echo;
+    unsigned events;
 };
 
 int get_format(const char* name);
@@ -147,6 +166,14 @@ void param_dump(struct snd_pcm_hw_params *p);
 int pcm_prepare(struct pcm *pcm);
 long pcm_avail(struct pcm *pcm);
 
+/* Start a hostless stream, fed or drained by the DSP, and wait for SIGINT,
+ * SIGTERM or the end of duration seconds (0 runs until signalled). A one
+ * second timer checks the stream, which is resumed after a suspend and
+ * restarted after an xrun, counted in underruns or overruns, or when it
+ * stopped. Returns the seconds it ran, otherwise a negative error code.
+ */
+int pcm_hostless_run(struct pcm *pcm, int duration);
+
 /* Returns a human readable reason for the last error. */
 const char *pcm_error(struct pcm *pcm);
 
@@ -168,8 +195,27 @@ struct mixer_ctl;
 
 struct mixer *mixer_open(const char *device);
 void mixer_close(struct mixer *mixer);
+
+/* Open a mixer shared by all the users of a control device within the
+ * process. The first open enumerates the controls, later ones only take
+ * a reference which mixer_close() drops. Reads through a shared handle
+ * are served from a value cache kept up to date by the change events of
+ * the card. The handle may be used from several threads.
+ */
+struct mixer *mixer_open_shared(const char *device);
 void mixer_dump(struct mixer *mixer);
 
+/* Save the element list of the card, names and enumerated items
+ * included, to a text file. Returns 0 or a negative error code.
+ */
+int mixer_elems_save(struct mixer *mixer, const char *path);
+
+/* Open a mixer from a saved element list instead of a card, for tools
+ * that check mixer settings offline. Controls can be looked up and
+ * values resolved but not read or written.
+ */
+struct mixer *mixer_elems_open(const char *path);
+
 struct mixer_ctl *mixer_get_control(struct mixer *mixer,
                                     const char *name, unsigned index);
 struct mixer_ctl *mixer_get_nth_control(struct mixer *mixer, unsigned n);
@@ -179,6 +225,42 @@ int mixer_ctl_select(struct mixer_ctl *ctl, const char *value);
 void mixer_ctl_get(struct mixer_ctl *ctl, unsigned *value);
 int mixer_ctl_set_value(struct mixer_ctl *ctl, int count, char ** argv);
 
+/* Maximum number of values of a control element */
+#define MIXER_MAX_VALUES 128
+
+/* Resolve a value the way mixer_ctl_set(), mixer_ctl_select() and
+ * mixer_ctl_set_value() would write it, into ctl->info->count element
+ * values that mixer_ctl_write_values() can write later without any
+ * string or TLV work. Returns 0 or a negative error code.
+ */
+int mixer_ctl_resolve_percent(struct mixer_ctl *ctl, unsigned percent,
+                              long long *values);
+int mixer_ctl_resolve_enum(struct mixer_ctl *ctl, const char *value,
+                           long long *values);
+int mixer_ctl_resolve_mulvalues(struct mixer_ctl *ctl, int count, char **argv,
+                                long long *values);
+int mixer_ctl_read_values(struct mixer_ctl *ctl, long long *values);
+int mixer_ctl_write_values(struct mixer_ctl *ctl, const long long *values);
+/* Like mixer_ctl_read_values() but never goes to the card, returns
+ * -ENODATA if the value is not in the cache of a shared handle */
+int mixer_ctl_cached_values(struct mixer_ctl *ctl, long long *values);
+
+/* Raw element value access, returns 0 or a negative error code */
+int mixer_ctl_read_elem(struct mixer_ctl *ctl, struct snd_ctl_elem_value *ev);
+int mixer_ctl_write_elem(struct mixer_ctl *ctl, struct snd_ctl_elem_value *ev);
+
+/* Save the values of all writable controls of the card to a file.
+ * Returns 0 on success, negative error code otherwise.
+ */
+int mixer_snapshot_save(struct mixer *mixer, const char *path);
+
+/* Restore control values saved by mixer_snapshot_save(). The snapshot
+ * is validated against the element list of the card first and only the
+ * controls whose value differs from the snapshot are written.
+ * Returns the number of controls written or a negative error code.
+ */
+int mixer_snapshot_restore(struct mixer *mixer, const char *path);
+
 
 #define MAX_NUM_CODECS 32
 
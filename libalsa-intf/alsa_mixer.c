@@ -23,6 +23,8 @@
 #include <errno.h>
 #include <ctype.h>
 #include <math.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 #include <linux/ioctl.h>
 #define __force
@@ -113,10 +115,43 @@ static const char *elem_type_name(snd_ctl_elem_type_t n)
     }
 }
 
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mixer *shared_mixers;
+
+static struct mixer_ctl *mixer_get_ctl_by_numid(struct mixer *mixer, unsigned numid);
+
+/* Release what mixer_open_shared() added to the handle */
+static void mixer_shared_free(struct mixer *mixer)
+{
+    pthread_mutex_destroy(&mixer->lock);
+    free(mixer->device);
+    free(mixer->cache);
+    free(mixer->cached);
+    free(mixer->echo);
+    mixer->device = NULL;
+    mixer->cache = NULL;
+    mixer->cached = NULL;
+    mixer->echo = NULL;
+}
+
 void mixer_close(struct mixer *mixer)
 {
+    struct mixer **prev;
     unsigned n,m;
 
+    if (mixer->refs) {
+        pthread_mutex_lock(&shared_lock);
+        if (--mixer->refs > 0) {
+            pthread_mutex_unlock(&shared_lock);
+            return;
+        }
+        for (prev = &shared_mixers; *prev != mixer; prev = &(*prev)->next)
+            ;
+        *prev = mixer->next;
+        pthread_mutex_unlock(&shared_lock);
+        mixer_shared_free(mixer);
+    }
+
     if (mixer->fd >= 0)
         close(mixer->fd);
 
@@ -135,9 +170,43 @@ void mixer_close(struct mixer *mixer)
     if (mixer->info)
         free(mixer->info);
 
+    free(mixer->hash);
     free(mixer);
 }
 
+static unsigned name_hash(const char *name)
+{
+    unsigned h = 2166136261u;
+    unsigned n;
+
+    for (n = 0; n < SNDRV_CTL_ELEM_ID_NAME_MAXLEN && name[n]; n++)
+        h = (h ^ (unsigned char)name[n]) * 16777619u;
+    return h;
+}
+
+/* Build an open addressing index of the controls by name. Slots hold the
+ * control index + 1 and 0 for a free slot. Controls are inserted in order
+ * so that a lookup still finds the first of several matching controls.
+ */
+static int mixer_index(struct mixer *mixer)
+{
+    unsigned n, slot;
+
+    mixer->hash_size = 16;
+    while (mixer->hash_size < mixer->count * 2)
+        mixer->hash_size <<= 1;
+    mixer->hash = calloc(mixer->hash_size, sizeof(unsigned));
+    if (!mixer->hash)
+        return -ENOMEM;
+    for (n = 0; n < mixer->count; n++) {
+        slot = name_hash((char *)mixer->info[n].id.name) & (mixer->hash_size - 1);
+        while (mixer->hash[slot])
+            slot = (slot + 1) & (mixer->hash_size - 1);
+        mixer->hash[slot] = n + 1;
+    }
+    return 0;
+}
+
 struct mixer *mixer_open(const char *device)
 {
     struct snd_ctl_elem_list elist;
@@ -204,6 +273,9 @@ struct mixer *mixer_open(const char *device)
         }
     }
 
+    if (mixer_index(mixer) < 0)
+        goto fail;
+
     free(eid);
     return mixer;
 
@@ -217,6 +289,327 @@ fail:
     return 0;
 }
 
+/* Controls whose value can be cached: readable values the card reports
+ * changes of */
+static int mixer_cacheable(struct snd_ctl_elem_info *ei)
+{
+    if (!(ei->access & SNDRV_CTL_ELEM_ACCESS_READ) ||
+        (ei->access & SNDRV_CTL_ELEM_ACCESS_VOLATILE) ||
+        (ei->count > MIXER_MAX_VALUES))
+        return 0;
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Subscribe to the change events of the card and set up the value cache.
+ * Without events the cache is left out and every read goes to the card.
+ */
+static void mixer_cache_init(struct mixer *mixer)
+{
+    unsigned n, size = 0;
+    int subscribe = 1;
+    long long *cache;
+
+    if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS, &subscribe) < 0) {
+        LOGV("No control events, values of %s are not cached\n", mixer->device);
+        return;
+    }
+    if (fcntl(mixer->fd, F_SETFL, fcntl(mixer->fd, F_GETFL) | O_NONBLOCK) < 0)
+        goto fail;
+    for (n = 0; n < mixer->count; n++) {
+        if (mixer_cacheable(&mixer->info[n]))
+            size += mixer->info[n].count;
+    }
+    mixer->cache = calloc(size ? size : 1, sizeof(long long));
+    mixer->cached = calloc(mixer->count ? mixer->count : 1, 1);
+    mixer->echo = calloc(mixer->count ? mixer->count : 1, 1);
+    if (!mixer->cache || !mixer->cached || !mixer->echo) {
+        free(mixer->cache);
+        free(mixer->cached);
+        free(mixer->echo);
+        mixer->cache = NULL;
+        mixer->cached = NULL;
+        mixer->echo = NULL;
+        goto fail;
+    }
+    cache = mixer->cache;
+    for (n = 0; n < mixer->count; n++) {
+        if (mixer_cacheable(&mixer->info[n])) {
+            mixer->ctl[n].cache = cache;
+            cache += mixer->info[n].count;
+        }
+    }
+    return;
+
+fail:
+    subscribe = 0;
+    ioctl(mixer->fd, SNDRV_CTL_IOCTL_SUBSCRIBE_EVENTS, &subscribe);
+}
+
+static void mixer_elem_values(struct mixer_ctl *ctl,
+                              const struct snd_ctl_elem_value *ev,
+                              long long *values)
+{
+    unsigned n;
+
+    for (n = 0; n < ctl->info->count && n < MIXER_MAX_VALUES; n++) {
+        switch (ctl->info->type) {
+        case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+            values[n] = ev->value.integer64.value[n];
+            break;
+        case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+            values[n] = ev->value.enumerated.item[n];
+            break;
+        default:
+            values[n] = ev->value.integer.value[n];
+            break;
+        }
+    }
+}
+
+/* Drop the cached values of the controls changed since the last call,
+ * called with mixer->lock held. Every event counts, a value read from
+ * the card is only cached if no event was seen meanwhile.
+ * A control written through mixer_ctl_write_values() is expected to
+ * report its own change; it is read back once and stays cached with the
+ * value the card holds, so the write does not cost the next reader a
+ * round trip.
+ */
+static void mixer_cache_events(struct mixer *mixer)
+{
+    struct snd_ctl_event ev[16];
+    struct snd_ctl_elem_value value;
+    struct mixer_ctl *ctl;
+    ssize_t len;
+    unsigned n, idx;
+
+    while ((len = read(mixer->fd, ev, sizeof(ev))) > 0) {
+        for (n = 0; n < len / sizeof(ev[0]); n++) {
+            mixer->events++;
+            if (ev[n].type != SNDRV_CTL_EVENT_ELEM)
+                continue;
+            ctl = mixer_get_ctl_by_numid(mixer, ev[n].data.elem.id.numid);
+            if (!ctl)
+                continue;
+            idx = ctl - mixer->ctl;
+            if (mixer->echo[idx] && mixer->cached[idx] &&
+                ev[n].data.elem.mask != SNDRV_CTL_EVENT_MASK_REMOVE &&
+                !mixer_ctl_read_elem(ctl, &value)) {
+                mixer_elem_values(ctl, &value, ctl->cache);
+            } else {
+                mixer->cached[idx] = 0;
+            }
+            mixer->echo[idx] = 0;
+        }
+    }
+}
+
+struct mixer *mixer_open_shared(const char *device)
+{
+    struct mixer *mixer;
+
+    struct mixer *other;
+
+    pthread_mutex_lock(&shared_lock);
+    for (other = shared_mixers; other; other = other->next) {
+        if (!strcmp(other->device, device)) {
+            other->refs++;
+            pthread_mutex_unlock(&shared_lock);
+            return other;
+        }
+    }
+    pthread_mutex_unlock(&shared_lock);
+
+    /* Enumerating the card takes a while, do not hold up the users of
+     * other cards; a handle opened meanwhile for the same card wins */
+    mixer = mixer_open(device);
+    if (!mixer)
+        return 0;
+    mixer->device = strdup(device);
+    if (!mixer->device) {
+        mixer_close(mixer);
+        return 0;
+    }
+    pthread_mutex_init(&mixer->lock, NULL);
+    mixer_cache_init(mixer);
+
+    pthread_mutex_lock(&shared_lock);
+    for (other = shared_mixers; other; other = other->next) {
+        if (!strcmp(other->device, device)) {
+            other->refs++;
+            pthread_mutex_unlock(&shared_lock);
+            mixer_shared_free(mixer);
+            mixer_close(mixer);
+            return other;
+        }
+    }
+    mixer->refs = 1;
+    mixer->next = shared_mixers;
+    shared_mixers = mixer;
+    pthread_mutex_unlock(&shared_lock);
+    return mixer;
+}
+
+/*
+ * Element list file layout, one line per element:
+ *     numid iface index count access type min max step name
+ * followed by one "\titem" line per item of an enumerated element.
+ * min, max and step are 0 for other than integer elements.
+ */
+int mixer_elems_save(struct mixer *mixer, const char *path)
+{
+    long long min, max, step;
+    unsigned n, m;
+    FILE *fp;
+    int ret = 0;
+
+    fp = fopen(path, "w");
+    if (!fp)
+        return -errno;
+    for (n = 0; n < mixer->count; n++) {
+        struct snd_ctl_elem_info *ei = mixer->info + n;
+
+        min = max = step = 0;
+        if (ei->type == SNDRV_CTL_ELEM_TYPE_INTEGER) {
+            min = ei->value.integer.min;
+            max = ei->value.integer.max;
+            step = ei->value.integer.step;
+        } else if (ei->type == SNDRV_CTL_ELEM_TYPE_INTEGER64) {
+            min = ei->value.integer64.min;
+            max = ei->value.integer64.max;
+            step = ei->value.integer64.step;
+        }
+        fprintf(fp, "%u %u %u %u %u %u %lld %lld %lld %s\n",
+                ei->id.numid, ei->id.iface, ei->id.index, ei->count,
+                ei->access, ei->type, min, max, step, ei->id.name);
+        if (ei->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+            continue;
+        for (m = 0; m < ei->value.enumerated.items; m++)
+            fprintf(fp, "\t%s\n", mixer->ctl[n].ename[m]);
+    }
+    if (ferror(fp))
+        ret = -EIO;
+    if (fclose(fp) && !ret)
+        ret = -errno;
+    return ret;
+}
+
+/* Add an element read from an element list file to the mixer
+ * Returns the element info or NULL on failure
+ */
+static struct snd_ctl_elem_info *mixer_elems_add(struct mixer *mixer,
+                                                 unsigned *size)
+{
+    struct snd_ctl_elem_info *info;
+    struct mixer_ctl *ctl;
+    unsigned n;
+
+    if (mixer->count == *size) {
+        *size = *size ? *size * 2 : 64;
+        info = realloc(mixer->info, *size * sizeof(*info));
+        if (!info)
+            return 0;
+        mixer->info = info;
+        ctl = realloc(mixer->ctl, *size * sizeof(*ctl));
+        if (!ctl)
+            return 0;
+        mixer->ctl = ctl;
+        for (n = 0; n < mixer->count; n++)
+            mixer->ctl[n].info = mixer->info + n;
+    }
+    n = mixer->count++;
+    memset(mixer->info + n, 0, sizeof(mixer->info[n]));
+    mixer->ctl[n].mixer = mixer;
+    mixer->ctl[n].info = mixer->info + n;
+    mixer->ctl[n].ename = 0;
+    mixer->ctl[n].cache = 0;
+    return mixer->info + n;
+}
+
+struct mixer *mixer_elems_open(const char *path)
+{
+    struct snd_ctl_elem_info *ei = 0;
+    struct mixer *mixer;
+    char line[256], **enames;
+    long long min, max, step;
+    unsigned size = 0, items = 0;
+    int len, pos;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        LOGE("Failed to open element list %s\n", path);
+        return 0;
+    }
+    mixer = calloc(1, sizeof(*mixer));
+    if (!mixer)
+        goto fail;
+    mixer->fd = -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = 0;
+        if (line[0] == '\t') {
+            if (!ei || ei->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+                goto bad;
+            enames = realloc(mixer->ctl[mixer->count - 1].ename,
+                             (items + 1) * sizeof(char *));
+            if (!enames)
+                goto fail;
+            mixer->ctl[mixer->count - 1].ename = enames;
+            enames[items] = strdup(line + 1);
+            if (!enames[items])
+                goto fail;
+            ei->value.enumerated.items = ++items;
+            continue;
+        }
+        if (line[0] == 0 || line[0] == '#')
+            continue;
+        ei = mixer_elems_add(mixer, &size);
+        if (!ei)
+            goto fail;
+        items = 0;
+        pos = 0;
+        if (sscanf(line, "%u %u %u %u %u %u %lld %lld %lld %n",
+                   &ei->id.numid, &ei->id.iface, &ei->id.index, &ei->count,
+                   &ei->access, &ei->type, &min, &max, &step, &pos) < 9 ||
+            pos == 0)
+            goto bad;
+        strncpy((char *)ei->id.name, line + pos, sizeof(ei->id.name) - 1);
+        if (ei->type == SNDRV_CTL_ELEM_TYPE_INTEGER) {
+            ei->value.integer.min = min;
+            ei->value.integer.max = max;
+            ei->value.integer.step = step;
+        } else if (ei->type == SNDRV_CTL_ELEM_TYPE_INTEGER64) {
+            ei->value.integer64.min = min;
+            ei->value.integer64.max = max;
+            ei->value.integer64.step = step;
+        }
+    }
+    fclose(fp);
+    if (mixer_index(mixer) < 0) {
+        mixer_close(mixer);
+        return 0;
+    }
+    return mixer;
+
+bad:
+    LOGE("Invalid element list %s: %s\n", path, line);
+fail:
+    fclose(fp);
+    if (mixer)
+        mixer_close(mixer);
+    return 0;
+}
+
 void mixer_dump(struct mixer *mixer)
 {
     unsigned n, m;
@@ -273,7 +666,20 @@ void mixer_dump(struct mixer *mixer)
 struct mixer_ctl *mixer_get_control(struct mixer *mixer,
                                     const char *name, unsigned index)
 {
-    unsigned n;
+    unsigned n, slot;
+
+    if (mixer->hash) {
+        slot = name_hash(name) & (mixer->hash_size - 1);
+        while (mixer->hash[slot]) {
+            n = mixer->hash[slot] - 1;
+            if (mixer->info[n].id.index == index &&
+                !strncmp(name, (char*) mixer->info[n].id.name,
+                         sizeof(mixer->info[n].id.name)))
+                return mixer->ctl + n;
+            slot = (slot + 1) & (mixer->hash_size - 1);
+        }
+        return 0;
+    }
     for (n = 0; n < mixer->count; n++) {
         if (mixer->info[n].id.index == index) {
             if (!strncmp(name, (char*) mixer->info[n].id.name,
@@ -462,55 +868,71 @@ static long long scale_int64(struct snd_ctl_elem_info *ei, unsigned _percent)
 }
 
 /*
- * Add support for controls taking more than one parameter as input value
- * This is useful for volume controls which take two parameters as input value.
+ * Fill the element values for a list of input values, one per channel.
+ * Returns 0 or a negative error code.
  */
-int mixer_ctl_mulvalues(struct mixer_ctl *ctl, int count, char ** argv)
+static int mulvalues_to_values(struct mixer_ctl *ctl, int count, char ** argv,
+                               long long *values)
 {
-    struct snd_ctl_elem_value ev;
     unsigned n;
 
     if (!ctl) {
         LOGV("can't find control\n");
-        return -1;
+        return -ENODEV;
     }
     if (count < ctl->info->count || count > ctl->info->count)
         return -EINVAL;
 
-
-    memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info->id.numid;
     switch (ctl->info->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
         for (n = 0; n < ctl->info->count; n++)
-            ev.value.integer.value[n] = !!atoi(argv[n]);
+            values[n] = !!atoi(argv[n]);
         break;
     case SNDRV_CTL_ELEM_TYPE_INTEGER: {
         for (n = 0; n < ctl->info->count; n++) {
-             fprintf( stderr, "Value: %d idx:%d\n", atoi(argv[n]), n);
-             ev.value.integer.value[n] = atoi(argv[n]);
+             LOGV("Value: %d idx:%d\n", atoi(argv[n]), n);
+             values[n] = atoi(argv[n]);
         }
         break;
     }
     case SNDRV_CTL_ELEM_TYPE_INTEGER64: {
         for (n = 0; n < ctl->info->count; n++) {
              long long value_ll = scale_int64(ctl->info, atoi(argv[n]));
-             fprintf( stderr, "ll_value = %d\n", value_ll);
-             ev.value.integer64.value[n] = value_ll;
+             LOGV("ll_value = %lld\n", value_ll);
+             values[n] = value_ll;
         }
         break;
     }
     default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * Add support for controls taking more than one parameter as input value
+ * This is useful for volume controls which take two parameters as input value.
+ */
+int mixer_ctl_mulvalues(struct mixer_ctl *ctl, int count, char ** argv)
+{
+    long long values[MIXER_MAX_VALUES];
+    int ret;
+
+    ret = mulvalues_to_values(ctl, count, argv, values);
+    if (ret == -ENODEV)
+        return -1;
+    if (ret == -EINVAL && count == ctl->info->count) {
         errno = EINVAL;
         return errno;
     }
-
-    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    if (ret < 0)
+        return ret;
+    return mixer_ctl_write_values(ctl, values) < 0 ? -1 : 0;
 }
 
-int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
+int mixer_ctl_resolve_percent(struct mixer_ctl *ctl, unsigned percent,
+                              long long *values)
 {
-    struct snd_ctl_elem_value ev;
     unsigned n;
     long min, max;
     unsigned int *tlv = NULL;
@@ -520,7 +942,7 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
 
     if (!ctl) {
         LOGV("can't find control\n");
-        return -1;
+        return -ENODEV;
     }
 
     if (is_volume(ctl->info->id.name, &type)) {
@@ -551,12 +973,10 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
             LOGV("mixer_ctl_read_tlv failed\n");
         free(tlv);
     }
-    memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info->id.numid;
     switch (ctl->info->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
         for (n = 0; n < ctl->info->count; n++)
-            ev.value.integer.value[n] = !!percent;
+            values[n] = !!percent;
         break;
     case SNDRV_CTL_ELEM_TYPE_INTEGER: {
         int value;
@@ -565,7 +985,7 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
         else
              value = (int) percent;
         for (n = 0; n < ctl->info->count; n++)
-            ev.value.integer.value[n] = value;
+            values[n] = value;
         break;
     }
     case SNDRV_CTL_ELEM_TYPE_INTEGER64: {
@@ -575,15 +995,28 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
         else
              value = (long long)percent;
         for (n = 0; n < ctl->info->count; n++)
-            ev.value.integer64.value[n] = value;
+            values[n] = value;
         break;
     }
     default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
+{
+    long long values[MIXER_MAX_VALUES];
+    int ret;
+
+    ret = mixer_ctl_resolve_percent(ctl, percent, values);
+    if (ret == -ENODEV)
+        return -1;
+    if (ret < 0) {
         errno = EINVAL;
         return errno;
     }
-
-    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    return mixer_ctl_write_values(ctl, values) < 0 ? -1 : 0;
 }
 
 /* the api parses the mixer control input to extract
@@ -593,12 +1026,11 @@ int mixer_ctl_set(struct mixer_ctl *ctl, unsigned percent)
  * All remaining formats are currently ignored.
  */
 
-static int set_volume_simple(struct mixer_ctl *ctl,
-    char **ptr, long pmin, long pmax, int count)
+static int volume_simple_to_values(struct mixer_ctl *ctl,
+    char **ptr, long pmin, long pmax, int count, long long *values)
 {
     long val, orig;
     char *p = *ptr, *s;
-    struct snd_ctl_elem_value ev;
     unsigned n;
 
     if (*p == ':')
@@ -636,17 +1068,15 @@ static int set_volume_simple(struct mixer_ctl *ctl,
 
     LOGV("Value = ");
 
-    memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info->id.numid;
     switch (ctl->info->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
         for (n = 0; n < ctl->info->count; n++)
-            ev.value.integer.value[n] = !!val;
+            values[n] = !!val;
         print_dB(val);
         break;
     case SNDRV_CTL_ELEM_TYPE_INTEGER: {
         for (n = 0; n < ctl->info->count; n++)
-             ev.value.integer.value[n] = val;
+             values[n] = val;
         print_dB(val);
         break;
     }
@@ -654,23 +1084,36 @@ static int set_volume_simple(struct mixer_ctl *ctl,
         for (n = 0; n < ctl->info->count; n++) {
              long long value_ll = scale_int64(ctl->info, val);
              print_dB(value_ll);
-             ev.value.integer64.value[n] = value_ll;
+             values[n] = value_ll;
         }
         break;
     }
     default:
-        errno = EINVAL;
-        return errno;
+        return -EINVAL;
     }
 
     LOGV("\n");
-    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    return 0;
 
 skip:
         if (*p == ',')
                 p++;
         *ptr = p;
+        return 1;
+}
+
+static int set_volume_simple(struct mixer_ctl *ctl,
+    char **ptr, long pmin, long pmax, int count)
+{
+    long long values[MIXER_MAX_VALUES];
+    int ret;
+
+    ret = volume_simple_to_values(ctl, ptr, pmin, pmax, count, values);
+    if (ret > 0)
         return 0;
+    if (ret < 0)
+        return ret;
+    return mixer_ctl_write_values(ctl, values) < 0 ? -1 : 0;
 }
 
 int mixer_ctl_set_value(struct mixer_ctl *ctl, int count, char ** argv)
@@ -699,29 +1142,549 @@ int mixer_ctl_set_value(struct mixer_ctl *ctl, int count, char ** argv)
     return 0;
 }
 
+int mixer_ctl_resolve_mulvalues(struct mixer_ctl *ctl, int count, char **argv,
+                                long long *values)
+{
+    unsigned int *tlv = NULL;
+    long min, max;
+    enum ctl_type type;
+    unsigned int tlv_type;
+    int ret = -EINVAL;
 
-int mixer_ctl_select(struct mixer_ctl *ctl, const char *value)
+    if (!ctl)
+        return -ENODEV;
+    if (is_volume(ctl->info->id.name, &type)) {
+        tlv = calloc(1, DEFAULT_TLV_SIZE);
+        if (tlv == NULL)
+            return -ENOMEM;
+        if (!mixer_ctl_read_tlv(ctl, tlv, &min, &max, &tlv_type))
+            ret = volume_simple_to_values(ctl, argv, min, max, count, values);
+        free(tlv);
+        if (ret == 0)
+            return 0;
+    }
+    return mulvalues_to_values(ctl, count, argv, values);
+}
+
+static int find_enum_item(struct mixer_ctl *ctl, const char *value)
 {
     unsigned n, max;
-    struct snd_ctl_elem_value ev;
+
+    max = ctl->info->value.enumerated.items;
+    for (n = 0; n < max; n++) {
+        if (!strncmp(value, ctl->ename[n], strnlen(ctl->ename[n],64)))
+            return n;
+    }
+    return -1;
+}
+
+int mixer_ctl_select(struct mixer_ctl *ctl, const char *value)
+{
+    long long values[MIXER_MAX_VALUES];
+    int item;
 
     if (ctl->info->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
         errno = EINVAL;
         return -1;
     }
 
-    max = ctl->info->value.enumerated.items;
-    for (n = 0; n < max; n++) {
-        if (!strncmp(value, ctl->ename[n], strnlen(ctl->ename[n],64))) {
-            memset(&ev, 0, sizeof(ev));
-            ev.value.enumerated.item[0] = n;
-            ev.id.numid = ctl->info->id.numid;
-            if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev) < 0)
-                return -1;
-            return 0;
-        }
+    item = find_enum_item(ctl, value);
+    if (item >= 0) {
+        memset(values, 0, sizeof(values));
+        values[0] = item;
+        if (mixer_ctl_write_values(ctl, values) < 0)
+            return -1;
+        return 0;
     }
 
     errno = EINVAL;
     return errno;
 }
+
+int mixer_ctl_resolve_enum(struct mixer_ctl *ctl, const char *value,
+                           long long *values)
+{
+    unsigned n;
+    int item;
+
+    if (ctl->info->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+        return -EINVAL;
+    item = find_enum_item(ctl, value);
+    if (item < 0)
+        return -EINVAL;
+    for (n = 0; n < ctl->info->count; n++)
+        values[n] = 0;
+    values[0] = item;
+    return 0;
+}
+
+int mixer_ctl_read_values(struct mixer_ctl *ctl, long long *values)
+{
+    struct mixer *mixer = ctl->mixer;
+    struct snd_ctl_elem_value ev;
+    unsigned events = 0;
+    int ret;
+
+    if (ctl->cache) {
+        pthread_mutex_lock(&mixer->lock);
+        mixer_cache_events(mixer);
+        if (mixer->cached[ctl - mixer->ctl]) {
+            memcpy(values, ctl->cache, ctl->info->count * sizeof(long long));
+            pthread_mutex_unlock(&mixer->lock);
+            return 0;
+        }
+        events = mixer->events;
+        pthread_mutex_unlock(&mixer->lock);
+    }
+    ret = mixer_ctl_read_elem(ctl, &ev);
+    if (ret < 0)
+        return ret;
+    mixer_elem_values(ctl, &ev, values);
+    if (ctl->cache) {
+        pthread_mutex_lock(&mixer->lock);
+        mixer_cache_events(mixer);
+        if (mixer->events == events) {
+            memcpy(ctl->cache, values, ctl->info->count * sizeof(long long));
+            mixer->cached[ctl - mixer->ctl] = 1;
+        }
+        pthread_mutex_unlock(&mixer->lock);
+    }
+    return 0;
+}
+
+int mixer_ctl_cached_values(struct mixer_ctl *ctl, long long *values)
+{
+    struct mixer *mixer = ctl->mixer;
+    int ret = -ENODATA;
+
+    if (!ctl->cache)
+        return ret;
+    pthread_mutex_lock(&mixer->lock);
+    mixer_cache_events(mixer);
+    if (mixer->cached[ctl - mixer->ctl]) {
+        memcpy(values, ctl->cache, ctl->info->count * sizeof(long long));
+        ret = 0;
+    }
+    pthread_mutex_unlock(&mixer->lock);
+    return ret;
+}
+
+int mixer_ctl_write_values(struct mixer_ctl *ctl, const long long *values)
+{
+    struct snd_ctl_elem_value ev;
+    unsigned n;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->info->id.numid;
+    for (n = 0; n < ctl->info->count && n < MIXER_MAX_VALUES; n++) {
+        switch (ctl->info->type) {
+        case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+            ev.value.integer64.value[n] = values[n];
+            break;
+        case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+            ev.value.enumerated.item[n] = values[n];
+            break;
+        default:
+            ev.value.integer.value[n] = values[n];
+            break;
+        }
+    }
+    if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev) < 0)
+        return -errno;
+    /* No event is sent when put() reports the value as unchanged. Events
+     * still queued are handled on the next read; the one of this write
+     * is recognised by the echo flag, see mixer_cache_events(). */
+    if (ctl->cache) {
+        pthread_mutex_lock(&ctl->mixer->lock);
+        memcpy(ctl->cache, values, ctl->info->count * sizeof(long long));
+        ctl->mixer->cached[ctl - ctl->mixer->ctl] = 1;
+        ctl->mixer->echo[ctl - ctl->mixer->ctl] = 1;
+        pthread_mutex_unlock(&ctl->mixer->lock);
+    }
+    return 0;
+}
+
+int mixer_ctl_read_elem(struct mixer_ctl *ctl, struct snd_ctl_elem_value *ev)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->id.numid = ctl->info->id.numid;
+    if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, ev) < 0)
+        return -errno;
+    return 0;
+}
+
+int mixer_ctl_write_elem(struct mixer_ctl *ctl, struct snd_ctl_elem_value *ev)
+{
+    ev->id.numid = ctl->info->id.numid;
+    if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, ev) < 0)
+        return -errno;
+    if (ctl->cache) {
+        pthread_mutex_lock(&ctl->mixer->lock);
+        ctl->mixer->cached[ctl - ctl->mixer->ctl] = 0;
+        pthread_mutex_unlock(&ctl->mixer->lock);
+    }
+    return 0;
+}
+
+/*
+ * Mixer snapshot file layout:
+ *     struct snapshot_hdr
+ *     hdr.count x { struct snapshot_elem, values }
+ * Values are stored as 64 bit words for boolean, integer and integer64
+ * elements, 32 bit words for enumerated elements and raw bytes (padded to
+ * a word boundary) for bytes elements. Records are only 32 bit aligned, so
+ * 64 bit words are accessed with memcpy().
+ */
+#define SNAPSHOT_MAGIC   0x50414e53 /* "SNAP" */
+#define SNAPSHOT_VERSION 2
+
+struct snapshot_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t elem_count;
+};
+
+struct snapshot_elem {
+    uint32_t numid;
+    uint32_t type;
+    uint32_t count;
+    uint32_t name_hash;
+};
+
+static uint32_t elem_name_hash(struct snd_ctl_elem_info *ei)
+{
+    const unsigned char *p = (const unsigned char *) ei->id.name;
+    uint32_t hash = 2166136261u;
+    unsigned n;
+
+    for (n = 0; n < sizeof(ei->id.name) && p[n]; n++) {
+        hash ^= p[n];
+        hash *= 16777619u;
+    }
+    hash ^= ei->id.index;
+    hash *= 16777619u;
+    return hash;
+}
+
+/* Number of values of a given type that fit in a snd_ctl_elem_value */
+static unsigned snapshot_max_count(unsigned type)
+{
+    struct snd_ctl_elem_value *ev = 0;
+
+    switch (type) {
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        return sizeof(ev->value.integer64.value) / sizeof(ev->value.integer64.value[0]);
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        return sizeof(ev->value.enumerated.item) / sizeof(ev->value.enumerated.item[0]);
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        return sizeof(ev->value.bytes.data);
+    default:
+        return MIXER_MAX_VALUES;
+    }
+}
+
+static int snapshot_elem_saved(struct snd_ctl_elem_info *ei)
+{
+    if (ei->count > snapshot_max_count(ei->type))
+        return 0;
+    if (!(ei->access & SNDRV_CTL_ELEM_ACCESS_READ) ||
+        !(ei->access & SNDRV_CTL_ELEM_ACCESS_WRITE) ||
+        (ei->access & (SNDRV_CTL_ELEM_ACCESS_VOLATILE |
+                       SNDRV_CTL_ELEM_ACCESS_INACTIVE)))
+        return 0;
+
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static size_t snapshot_values_size(unsigned type, unsigned count)
+{
+    switch (type) {
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        return count * sizeof(uint32_t);
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        return (count + 3) & ~3;
+    default:
+        return count * sizeof(int64_t);
+    }
+}
+
+static void snapshot_pack(struct snd_ctl_elem_info *ei,
+                          struct snd_ctl_elem_value *ev, char *buf)
+{
+    uint32_t v32;
+    int64_t v64;
+    unsigned n;
+
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        for (n = 0; n < ei->count; n++) {
+            v64 = ev->value.integer64.value[n];
+            memcpy(buf + n * sizeof(v64), &v64, sizeof(v64));
+        }
+        break;
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        for (n = 0; n < ei->count; n++) {
+            v32 = ev->value.enumerated.item[n];
+            memcpy(buf + n * sizeof(v32), &v32, sizeof(v32));
+        }
+        break;
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        memcpy(buf, ev->value.bytes.data, ei->count);
+        break;
+    default:
+        for (n = 0; n < ei->count; n++) {
+            v64 = ev->value.integer.value[n];
+            memcpy(buf + n * sizeof(v64), &v64, sizeof(v64));
+        }
+        break;
+    }
+}
+
+static void snapshot_unpack(struct snd_ctl_elem_info *ei,
+                            const char *buf, struct snd_ctl_elem_value *ev)
+{
+    uint32_t v32;
+    int64_t v64;
+    unsigned n;
+
+    memset(ev, 0, sizeof(*ev));
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        for (n = 0; n < ei->count; n++) {
+            memcpy(&v64, buf + n * sizeof(v64), sizeof(v64));
+            ev->value.integer64.value[n] = v64;
+        }
+        break;
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        for (n = 0; n < ei->count; n++) {
+            memcpy(&v32, buf + n * sizeof(v32), sizeof(v32));
+            ev->value.enumerated.item[n] = v32;
+        }
+        break;
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        memcpy(ev->value.bytes.data, buf, ei->count);
+        break;
+    default:
+        for (n = 0; n < ei->count; n++) {
+            memcpy(&v64, buf + n * sizeof(v64), sizeof(v64));
+            ev->value.integer.value[n] = v64;
+        }
+        break;
+    }
+}
+
+static int snapshot_differs(struct snd_ctl_elem_info *ei,
+                            struct snd_ctl_elem_value *a,
+                            struct snd_ctl_elem_value *b)
+{
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        return memcmp(a->value.integer64.value, b->value.integer64.value,
+                      ei->count * sizeof(a->value.integer64.value[0]));
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        return memcmp(a->value.enumerated.item, b->value.enumerated.item,
+                      ei->count * sizeof(a->value.enumerated.item[0]));
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        return memcmp(a->value.bytes.data, b->value.bytes.data, ei->count);
+    default:
+        return memcmp(a->value.integer.value, b->value.integer.value,
+                      ei->count * sizeof(a->value.integer.value[0]));
+    }
+}
+
+static struct mixer_ctl *mixer_get_ctl_by_numid(struct mixer *mixer, unsigned numid)
+{
+    unsigned n;
+
+    /* numids are normally dense and start at 1 */
+    if (numid >= 1 && numid <= mixer->count &&
+        mixer->info[numid - 1].id.numid == numid)
+        return mixer->ctl + numid - 1;
+    for (n = 0; n < mixer->count; n++) {
+        if (mixer->info[n].id.numid == numid)
+            return mixer->ctl + n;
+    }
+    return 0;
+}
+
+int mixer_snapshot_save(struct mixer *mixer, const char *path)
+{
+    struct snd_ctl_elem_value ev;
+    struct snapshot_hdr *hdr;
+    struct snapshot_elem *rec;
+    char tmp_path[256];
+    char *buf;
+    size_t size = sizeof(*hdr), off;
+    unsigned n;
+    int fd, ret = 0;
+
+    for (n = 0; n < mixer->count; n++) {
+        if (snapshot_elem_saved(mixer->info + n))
+            size += sizeof(*rec) +
+                    snapshot_values_size(mixer->info[n].type, mixer->info[n].count);
+    }
+    buf = calloc(1, size);
+    if (!buf)
+        return -ENOMEM;
+
+    hdr = (struct snapshot_hdr *) buf;
+    hdr->magic = SNAPSHOT_MAGIC;
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->elem_count = mixer->count;
+    off = sizeof(*hdr);
+    for (n = 0; n < mixer->count; n++) {
+        struct snd_ctl_elem_info *ei = mixer->info + n;
+
+        if (!snapshot_elem_saved(ei))
+            continue;
+        ret = mixer_ctl_read_elem(mixer->ctl + n, &ev);
+        if (ret < 0) {
+            LOGE("snapshot: failed to read %s: %d\n", ei->id.name, ret);
+            goto done;
+        }
+        rec = (struct snapshot_elem *) (buf + off);
+        rec->numid = ei->id.numid;
+        rec->type = ei->type;
+        rec->count = ei->count;
+        rec->name_hash = elem_name_hash(ei);
+        off += sizeof(*rec);
+        snapshot_pack(ei, &ev, buf + off);
+        off += snapshot_values_size(ei->type, ei->count);
+        hdr->count++;
+    }
+
+    /* Write to a temporary file and rename it, so that an interrupted
+     * save never leaves a truncated snapshot behind */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        ret = -errno;
+        LOGE("snapshot: failed to create %s: %d\n", tmp_path, ret);
+        goto done;
+    }
+    if (write(fd, buf, off) != (ssize_t) off) {
+        ret = -errno;
+        close(fd);
+        unlink(tmp_path);
+        goto done;
+    }
+    fsync(fd);
+    close(fd);
+    if (rename(tmp_path, path) < 0) {
+        ret = -errno;
+        unlink(tmp_path);
+        goto done;
+    }
+    LOGV("snapshot: saved %d controls to %s\n", hdr->count, path);
+    ret = 0;
+
+done:
+    free(buf);
+    return ret;
+}
+
+int mixer_snapshot_restore(struct mixer *mixer, const char *path)
+{
+    struct snd_ctl_elem_value ev, cur;
+    struct snapshot_hdr *hdr;
+    struct snapshot_elem *rec;
+    struct mixer_ctl *ctl;
+    struct stat st;
+    char *buf;
+    size_t off;
+    unsigned n;
+    int fd, ret = 0, written = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(*hdr)) {
+        close(fd);
+        return -EINVAL;
+    }
+    buf = malloc(st.st_size);
+    if (!buf) {
+        close(fd);
+        return -ENOMEM;
+    }
+    if (read(fd, buf, st.st_size) != st.st_size) {
+        ret = -EIO;
+        close(fd);
+        goto done;
+    }
+    close(fd);
+
+    hdr = (struct snapshot_hdr *) buf;
+    if (hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION) {
+        LOGE("snapshot: %s is not a valid mixer snapshot\n", path);
+        ret = -EINVAL;
+        goto done;
+    }
+    /* Counts are bounded by the file and the card before any iteration */
+    if (hdr->elem_count > mixer->count || hdr->count > hdr->elem_count ||
+        hdr->count > (st.st_size - sizeof(*hdr)) / sizeof(*rec)) {
+        LOGE("snapshot: %s holds %u of %u controls, card has %u\n", path,
+             hdr->count, hdr->elem_count, mixer->count);
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Validate every record against the live element list before
+     * touching the hardware, a stale snapshot is rejected as a whole */
+    off = sizeof(*hdr);
+    for (n = 0; n < hdr->count; n++) {
+        if (off + sizeof(*rec) > (size_t) st.st_size)
+            break;
+        rec = (struct snapshot_elem *) (buf + off);
+        ctl = mixer_get_ctl_by_numid(mixer, rec->numid);
+        if (!ctl || ctl->info->type != rec->type ||
+            ctl->info->count != rec->count ||
+            rec->count > snapshot_max_count(rec->type) ||
+            elem_name_hash(ctl->info) != rec->name_hash) {
+            LOGE("snapshot: element %d does not match the card\n", rec->numid);
+            break;
+        }
+        off += sizeof(*rec) + snapshot_values_size(rec->type, rec->count);
+        if (off > (size_t) st.st_size)
+            break;
+    }
+    if (n != hdr->count) {
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Write only the controls whose current value differs */
+    off = sizeof(*hdr);
+    for (n = 0; n < hdr->count; n++) {
+        rec = (struct snapshot_elem *) (buf + off);
+        off += sizeof(*rec);
+        ctl = mixer_get_ctl_by_numid(mixer, rec->numid);
+        snapshot_unpack(ctl->info, buf + off, &ev);
+        off += snapshot_values_size(rec->type, rec->count);
+        if (!mixer_ctl_read_elem(ctl, &cur) &&
+            !snapshot_differs(ctl->info, &cur, &ev))
+            continue;
+        ret = mixer_ctl_write_elem(ctl, &ev);
+        if (ret < 0) {
+            LOGE("snapshot: failed to restore %s: %d\n", ctl->info->id.name, ret);
+            goto done;
+        }
+        written++;
+    }
+    LOGV("snapshot: restored %d of %d controls from %s\n", written, hdr->count, path);
+    ret = written;
+
+done:
+    free(buf);
+    return ret;
+}
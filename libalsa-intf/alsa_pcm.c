@@ -27,6 +27,7 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <signal.h>
 
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -497,6 +498,95 @@ int pcm_prepare(struct pcm *pcm)
     return 0;
 }
 
+int pcm_hostless_run(struct pcm *pcm, int duration)
+{
+    struct snd_pcm_status status;
+    struct itimerval tick;
+    sigset_t set, old, pending;
+    int sig, secs = 0, suspended = 0, err = 0;
+    int *xruns = (pcm->flags & PCM_IN) ? &pcm->overruns : &pcm->underruns;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &set, &old);
+
+    if (pcm_prepare(pcm)) {
+        err = -errno;
+        goto unblock;
+    }
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_START)) {
+        err = -errno;
+        LOGE("Hostless IOCTL_START Error no %d \n", -err);
+        goto unblock;
+    }
+
+    memset(&tick, 0, sizeof(tick));
+    tick.it_interval.tv_sec = 1;
+    tick.it_value.tv_sec = 1;
+    setitimer(ITIMER_REAL, &tick, NULL);
+
+    while (!duration || secs < duration) {
+        if (sigwait(&set, &sig))
+            break;
+        if (sig != SIGALRM) {
+            LOGD("Hostless session stopped by signal %d\n", sig);
+            break;
+        }
+        secs++;
+        memset(&status, 0, sizeof(status));
+        if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_STATUS, &status)) {
+            err = -errno;
+            LOGE("Hostless IOCTL_STATUS Error no %d \n", -err);
+            break;
+        }
+        if (status.state == SNDRV_PCM_STATE_RUNNING) {
+            suspended = 0;
+            continue;
+        }
+        if (status.state == SNDRV_PCM_STATE_SUSPENDED) {
+            if (!suspended++)
+                LOGE("Hostless stream suspended after %d s\n", secs);
+            if (!ioctl(pcm->fd, SNDRV_PCM_IOCTL_RESUME) || errno == EAGAIN)
+                continue;
+        } else if (status.state == SNDRV_PCM_STATE_XRUN) {
+            LOGE("Hostless stream xrun after %d s\n", secs);
+            (*xruns)++;
+        } else if (status.state == SNDRV_PCM_STATE_DISCONNECTED) {
+            LOGE("Hostless stream disconnected\n");
+            err = -ENODEV;
+            break;
+        } else {
+            LOGE("Hostless stream stopped in state %d after %d s\n", status.state, secs);
+        }
+        if (pcm_prepare(pcm) || ioctl(pcm->fd, SNDRV_PCM_IOCTL_START)) {
+            err = -errno;
+            LOGE("Hostless restart failed, Error no %d \n", -err);
+            break;
+        }
+        suspended = 0;
+    }
+
+    memset(&tick, 0, sizeof(tick));
+    setitimer(ITIMER_REAL, &tick, NULL);
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_DROP))
+        LOGE("Hostless IOCTL_DROP Error no %d \n", errno);
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_HW_FREE))
+        LOGE("Hostless IOCTL_HW_FREE Error no %d \n", errno);
+
+    /* A tick that fired before the timer stopped would kill us once unblocked */
+    sigpending(&pending);
+    if (sigismember(&pending, SIGALRM)) {
+        sigemptyset(&set);
+        sigaddset(&set, SIGALRM);
+        sigwait(&set, &sig);
+    }
+unblock:
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return err ? err : secs;
+}
+
 static int pcm_write_mmap(struct pcm *pcm, void *data, unsigned count)
 {
     long frames;
@@ -610,7 +700,7 @@ int pcm_read(struct pcm *pcm, void *data, unsigned count)
             if (errno == EPIPE) {
                 /* we failed to make our window -- try to restart */
                 LOGE("Arec:Overrun Error\n");
-                pcm->underruns++;
+                pcm->overruns++;
                 pcm->running = 0;
                 continue;
             }
@@ -39,12 +39,15 @@
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <ctype.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
 
 #include <linux/ioctl.h>
 #include "msm8960_use_cases.h"
@@ -59,6 +62,20 @@
 #endif
 #define PARSE_DEBUG 0
 
+/* Sound cards with a use case configuration. Entries are only appended
+ * so that the names handed out by snd_use_case_get_list stay valid, the
+ * lock also covers the ACDB users count shared by the managers. */
+static pthread_mutex_t card_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static card_mapping_t card_found[MAX_NUM_CARDS];
+static const char *card_list[MAX_NUM_CARDS];
+static int card_count;
+static int acdb_users;
+
+/* Directories of the config files and of the compiled configs, the
+ * offline checker points them to a config tree on the host */
+static const char *ucm_config_dir = CONFIG_DIR;
+static const char *ucm_cache_dir = UCM_CACHE_DIR;
+
 /**
  * Create an identifier
  * fmt - sprintf like format,
@@ -93,185 +110,143 @@ int snd_use_case_free_list(const char *list[], int items)
  * list - Returns allocated list
  * returns Number of list entries on success, otherwise a negative error code
  */
+/* Replace a list returned to the caller by copies of the given names
+ * cur_list - list owned by the use case manager
+ * cur_count - number of entries of cur_list
+ * names - names to copy
+ * count - number of names
+ * list - returned list
+ * Returns the number of entries on sucess, negative error code otherwise
+ */
+static int snd_ucm_copy_list(char ***cur_list, int *cur_count, const char **names,
+    int count, const char **list[])
+{
+    int index;
+
+    for (index = 0; index < *cur_count; index++)
+        free((*cur_list)[index]);
+    free(*cur_list);
+    *cur_list = NULL;
+    *cur_count = 0;
+    *list = NULL;
+    if (count == 0)
+        return 0;
+    *cur_list = (char **)malloc(sizeof(char *) * count);
+    if (*cur_list == NULL)
+        return -ENOMEM;
+    for (index = 0; index < count; index++)
+        (*cur_list)[index] = strdup(names[index]);
+    *cur_count = count;
+    *list = (const char **)*cur_list;
+    return count;
+}
+
 int snd_use_case_get_list(snd_use_case_mgr_t *uc_mgr,
                           const char *identifier,
                           const char **list[])
 {
-    int verb_index, list_size, index = 0;
+    const char *names[MAX_UCM_IDENTS];
+    ucm_ident_set_t *set;
+    ucm_state_t *state;
+    char **entries;
+    int epoch, list_size, index = 0;
 
     if (identifier == NULL) {
+        snd_ucm_discover_cards();
+        pthread_mutex_lock(&card_list_lock);
         *list = card_list;
-        return ((int)MAX_NUM_CARDS);
+        list_size = card_count;
+        pthread_mutex_unlock(&card_list_lock);
+        return list_size;
     }
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
         LOGE("snd_use_case_get_list(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return -EINVAL;
     }
 
+    /* Queries only look at the published state, they never wait for
+     * a routing change in progress */
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
     if (!strncmp(identifier, "_verbs", 6)) {
-        while(strncmp(uc_mgr->card_ctxt_ptr->verb_list[index], SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-            LOGV("Index:%d Verb:%s", index, uc_mgr->card_ctxt_ptr->verb_list[index]);
-            index++;
-        }
-        *list = (char ***)uc_mgr->card_ctxt_ptr->verb_list;
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return index;
-    } else  if (!strncmp(identifier, "_devices", 8)) {
-        if (!strncmp(uc_mgr->card_ctxt_ptr->current_verb,
-                   SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
-            LOGE("Use case verb name not set, invalid current verb");
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-            return -EINVAL;
-        }
-        while(strncmp(uc_mgr->card_ctxt_ptr->current_verb,
-            uc_mgr->card_ctxt_ptr->use_case_verb_list[index].use_case_name,
-            (strlen(uc_mgr->card_ctxt_ptr->use_case_verb_list[index].use_case_name)+1))) {
+        while(state->verb_list && strncmp(state->verb_list[index], SND_UCM_END_OF_LIST,
+              strlen(SND_UCM_END_OF_LIST))) {
+            LOGV("Index:%d Verb:%s", index, state->verb_list[index]);
             index++;
         }
-        verb_index = index;
-        index = 0;
-        while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index],
-                    SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-            LOGV("Index:%d Device:%s", index,
-                uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index]);
-            index++;
-        }
-        *list = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].device_list;
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        *list = (const char **)state->verb_list;
+        snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
         return index;
-    } else  if (!strncmp(identifier, "_modifiers", 10)) {
-        if (!strncmp(uc_mgr->card_ctxt_ptr->current_verb,
-                    SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
+    } else  if (!strncmp(identifier, "_devices", 8) ||
+                !strncmp(identifier, "_modifiers", 10)) {
+        if (!strncmp(state->current_verb,
+                   SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE)) ||
+            (state->verb_index < 0)) {
             LOGE("Use case verb name not set, invalid current verb");
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+            snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
             return -EINVAL;
         }
-        while(strncmp(uc_mgr->card_ctxt_ptr->current_verb,
-            uc_mgr->card_ctxt_ptr->use_case_verb_list[index].use_case_name,
-            (strlen(uc_mgr->card_ctxt_ptr->use_case_verb_list[index].use_case_name)+1))) {
-            index++;
-        }
-        verb_index = index;
-        index = 0;
-        while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index],
-                    SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-            LOGV("Index:%d Modifier:%s", index,
-                uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index]);
+        if (!strncmp(identifier, "_devices", 8))
+            entries = state->verb.device_list;
+        else
+            entries = state->verb.modifier_list;
+        while(entries && strncmp(entries[index], SND_UCM_END_OF_LIST,
+              strlen(SND_UCM_END_OF_LIST))) {
+            LOGV("Index:%d %s:%s", index, identifier, entries[index]);
             index++;
         }
-        *list = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list;
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        *list = (const char **)entries;
+        snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
         return index;
-    } else  if (!strncmp(identifier, "_enadevs", 8)) {
-        if (uc_mgr->device_list_count) {
-            for (index = 0; index < uc_mgr->device_list_count; index++) {
-                free(uc_mgr->current_device_list[index]);
-                uc_mgr->current_device_list[index] = NULL;
-            }
-            free(uc_mgr->current_device_list);
-            uc_mgr->current_device_list = NULL;
-            uc_mgr->device_list_count = 0;
-        }
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
-        uc_mgr->device_list_count = list_size;
-	if (list_size > 0) {
-            uc_mgr->current_device_list = (char **)malloc(sizeof(char *)*list_size);
-            if (uc_mgr->current_device_list == NULL) {
-                *list = NULL;
-                pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-                return -ENOMEM;
-            }
-            for (index = 0; index < list_size; index++) {
-                uc_mgr->current_device_list[index] =
-                            snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
-            }
-        }
-        *list = (const char **)uc_mgr->current_device_list;
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return (list_size);
-    } else  if (!strncmp(identifier, "_enamods", 8)) {
-        if (uc_mgr->modifier_list_count) {
-            for (index = 0; index < uc_mgr->modifier_list_count; index++) {
-                free(uc_mgr->current_modifier_list[index]);
-                uc_mgr->current_modifier_list[index] = NULL;
-            }
-            free(uc_mgr->current_modifier_list);
-            uc_mgr->current_modifier_list = NULL;
-            uc_mgr->modifier_list_count = 0;
-        }
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-        uc_mgr->modifier_list_count = list_size;
-	if (list_size > 0) {
-            uc_mgr->current_modifier_list = (char **)malloc(sizeof(char *) * list_size);
-            if (uc_mgr->current_modifier_list == NULL) {
-                *list = NULL;
-                pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-                return -ENOMEM;
-            }
-            for (index = 0; index < list_size; index++) {
-                uc_mgr->current_modifier_list[index] =
-                            snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
-            }
-        }
-        *list = (const char **)uc_mgr->current_modifier_list;
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return (list_size);
+    } else  if (!strncmp(identifier, "_enadevs", 8) ||
+                !strncmp(identifier, "_enamods", 8)) {
+        /* Only borrow the interned names from the state, the copies
+         * handed to the caller are made after releasing it */
+        if (!strncmp(identifier, "_enamods", 8))
+            set = &state->mod_set;
+        else
+            set = &state->dev_set;
+        list_size = set->count;
+        for (index = 0; index < list_size; index++)
+            names[index] = uc_mgr->card_ctxt_ptr->ident_name[set->ids[index]];
+        snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+        if (!strncmp(identifier, "_enamods", 8))
+            return snd_ucm_copy_list(&uc_mgr->current_modifier_list,
+                       &uc_mgr->modifier_list_count, names, list_size, list);
+        return snd_ucm_copy_list(&uc_mgr->current_device_list,
+                   &uc_mgr->device_list_count, names, list_size, list);
     } else {
         LOGE("Invalid identifier: %s", identifier);
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
         return -EINVAL;
     }
 }
 
 
-/**
- * Get current value of the identifier
- * identifier - NULL for current card
- *        _verb
- *        <Name>/<_device/_modifier>
- *    Name -    PlaybackPCM
- *        CapturePCM
- *        PlaybackCTL
- *        CaptureCTL
- * value - Value pointer
- * returns Zero if success, otherwise a negative error code
+/* Look up the value of an identifier in the published state
+ * uc_mgr - UCM structure
+ * state - state got with snd_ucm_state_get
+ * identifier - as for snd_use_case_get
+ * value - returns the value, owned by the card context and valid until
+ *         the next routing change or reload
+ * Returns 0 on sucess, negative error code otherwise
  */
-int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
-                     const char *identifier,
-                     const char **value)
+static int snd_ucm_get_value(snd_use_case_mgr_t *uc_mgr, ucm_state_t *state,
+                             const char *identifier, const char **value)
 {
     char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
-    int index, verb_index = 0, ret = 0;
-
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
-    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
-        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
-        LOGE("snd_use_case_get(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return -EINVAL;
-    }
-
-    if (identifier == NULL) {
-        if (uc_mgr->card_ctxt_ptr->card_name != NULL) {
-            *value = strdup(uc_mgr->card_ctxt_ptr->card_name);
-        } else {
-            *value = NULL;
-        }
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return 0;
-    }
+    int index, ret = 0;
 
     if (!strncmp(identifier, "_verb", 5)) {
-        if (uc_mgr->card_ctxt_ptr->current_verb != NULL) {
-            *value = strdup(uc_mgr->card_ctxt_ptr->current_verb);
-        } else {
-            *value = NULL;
-        }
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        /* The verb list entry outlives this state slot */
+        if (!strncmp(state->current_verb, SND_USE_CASE_VERB_INACTIVE,
+                     strlen(SND_USE_CASE_VERB_INACTIVE)))
+            *value = SND_USE_CASE_VERB_INACTIVE;
+        else if ((state->verb_index >= 0) && (state->verb_list != NULL))
+            *value = state->verb_list[state->verb_index];
+        else
+            *value = state->current_verb;
         return 0;
     }
 
@@ -283,36 +258,30 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
         if ((!strncmp(ident1, "PlaybackPCM", 11)) || (!strncmp(ident1, "CapturePCM", 10))) {
             ident2 = strtok_r(NULL, "/", &temp_ptr);
             index = 0;
-            verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
-            if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
-               (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl == NULL)) {
-                LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
-                pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+            if((state->verb_index < 0) || (!strncmp(state->current_verb, SND_UCM_END_OF_LIST, 3)) ||
+               (state->verb.card_ctrl == NULL)) {
+                LOGE("Invalid current verb value: %s - %d", state->current_verb, state->verb_index);
                 return -EINVAL;
             }
-            while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name, ident2, (strlen(ident2)+1))) {
-                if (!strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name,
-                        SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))){
-                    *value = NULL;
-                    ret = -EINVAL;
-                    break;
-                } else {
-                    index++;
-                }
+            if (ident2 != NULL)
+                index = snd_ucm_find_section(&state->verb, ident2, NULL);
+            if ((ident2 == NULL) || (index < 0)) {
+                *value = NULL;
+                ret = -EINVAL;
             }
             if (ret < 0) {
                 LOGE("No valid device/modifier found with given identifier: %s", ident2);
             } else {
                 if(!strncmp(ident1, "PlaybackPCM", 11)) {
-                    if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].playback_dev_name) {
-                        *value = strdup(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].playback_dev_name);
+                    if (state->verb.card_ctrl[index].playback_dev_name) {
+                        *value = state->verb.card_ctrl[index].playback_dev_name;
                     } else {
                         *value = NULL;
                         ret = -ENODEV;
                     }
                 } else if(!strncmp(ident1, "CapturePCM", 10)) {
-                    if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].capture_dev_name) {
-                        *value = strdup(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].capture_dev_name);
+                    if (state->verb.card_ctrl[index].capture_dev_name) {
+                        *value = state->verb.card_ctrl[index].capture_dev_name;
                     } else {
                         *value = NULL;
                         ret = -ENODEV;
@@ -325,7 +294,7 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
             }
         } else if ((!strncmp(ident1, "PlaybackCTL", 11)) || (!strncmp(ident1, "CaptureCTL", 10))) {
             if(uc_mgr->card_ctxt_ptr->control_device != NULL) {
-                *value = strdup(uc_mgr->card_ctxt_ptr->control_device);
+                *value = uc_mgr->card_ctxt_ptr->control_device;
             } else {
                 LOGE("No valid control device found");
                 *value = NULL;
@@ -337,7 +306,214 @@ int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
             ret = -EINVAL;
         }
     }
-    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    return ret;
+}
+
+/**
+ * Get current value of the identifier
+ * identifier - NULL for current card
+ *        _verb
+ *        _stats
+ *        <Name>/<_device/_modifier>
+ *    Name -    PlaybackPCM
+ *        CapturePCM
+ *        PlaybackCTL
+ *        CaptureCTL
+ * value - Value pointer
+ * returns Zero if success, otherwise a negative error code
+ */
+int snd_use_case_get(snd_use_case_mgr_t *uc_mgr,
+                     const char *identifier,
+                     const char **value)
+{
+    ucm_state_t *state;
+    char *buf;
+    int epoch, ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        LOGE("snd_use_case_get(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    if (identifier == NULL) {
+        if (uc_mgr->card_ctxt_ptr->card_name != NULL) {
+            *value = strdup(uc_mgr->card_ctxt_ptr->card_name);
+        } else {
+            *value = NULL;
+        }
+        return 0;
+    }
+
+    if (!strncmp(identifier, "_stats", 6)) {
+        buf = (char *)malloc(UCM_STATS_RING * UCM_STATS_LINE);
+        if (buf == NULL)
+            return -ENOMEM;
+        pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+        snd_ucm_stats_format(uc_mgr->card_ctxt_ptr, buf, UCM_STATS_RING * UCM_STATS_LINE);
+        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        *value = buf;
+        return 0;
+    }
+
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
+    ret = snd_ucm_get_value(uc_mgr, state, identifier, value);
+    if ((ret == 0) && (*value != NULL))
+        *value = strdup(*value);
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+    return ret;
+}
+
+/**
+ * Get current value of the identifier without copying it
+ * identifier - as for snd_use_case_get
+ * value - Value pointer, owned by the use case manager
+ * returns Zero if success, otherwise a negative error code
+ */
+int snd_use_case_get_ref(snd_use_case_mgr_t *uc_mgr,
+                         const char *identifier,
+                         const char **value)
+{
+    ucm_state_t *state;
+    int epoch, ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        LOGE("snd_use_case_get_ref(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    if (identifier == NULL) {
+        *value = uc_mgr->card_ctxt_ptr->card_name;
+        return 0;
+    }
+
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
+    ret = snd_ucm_get_value(uc_mgr, state, identifier, value);
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+    return ret;
+}
+
+/**
+ * Copy current value of the identifier to a buffer
+ * identifier - as for snd_use_case_get
+ * buf - buffer the value is copied to
+ * size - size of buf
+ * returns Zero if success, otherwise a negative error code
+ */
+int snd_use_case_get_buf(snd_use_case_mgr_t *uc_mgr,
+                         const char *identifier,
+                         char *buf, size_t size)
+{
+    const char *value = NULL;
+    ucm_state_t *state;
+    int epoch, ret = 0;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (buf == NULL) || (size == 0)) {
+        LOGE("snd_use_case_get_buf(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    buf[0] = 0;
+    if (identifier == NULL) {
+        value = uc_mgr->card_ctxt_ptr->card_name;
+        if ((value != NULL) && ((size_t)strlcpy(buf, value, size) >= size))
+            ret = -ENOSPC;
+        return ret;
+    }
+
+    if (!strncmp(identifier, "_stats", 6)) {
+        pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+        snd_ucm_stats_format(uc_mgr->card_ctxt_ptr, buf, size);
+        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        return 0;
+    }
+
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
+    ret = snd_ucm_get_value(uc_mgr, state, identifier, &value);
+    if ((ret == 0) && (value != NULL) && ((size_t)strlcpy(buf, value, size) >= size))
+        ret = -ENOSPC;
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+    return ret;
+}
+
+/**
+ * Get the PCM device number of a device or modifier
+ * identifier - PlaybackPCM/<name> or CapturePCM/<name>
+ * returns PCM device number if success, otherwise a negative error code
+ */
+int snd_use_case_get_pcm_id(snd_use_case_mgr_t *uc_mgr,
+                            const char *identifier)
+{
+    const char *value = NULL, *p;
+    ucm_state_t *state;
+    int epoch, ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (identifier == NULL) || (strncmp(identifier, "PlaybackPCM", 11) &&
+        strncmp(identifier, "CapturePCM", 10))) {
+        LOGE("snd_use_case_get_pcm_id(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
+    ret = snd_ucm_get_value(uc_mgr, state, identifier, &value);
+    if (ret == 0) {
+        /* Device names are hw:<card>,<device> */
+        p = (value != NULL) ? strchr(value, ',') : NULL;
+        if ((p != NULL) && isdigit(p[1]))
+            ret = atoi(p + 1);
+        else
+            ret = -ENODEV;
+    }
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+    return ret;
+}
+
+/**
+ * Get the enabled devices or modifiers without allocating
+ * identifier - _enadevs or _enamods
+ * list - array filled with names owned by the use case manager
+ * size - number of entries of list
+ * returns Number of entries if success, otherwise a negative error code
+ */
+int snd_use_case_get_enabled(snd_use_case_mgr_t *uc_mgr,
+                             const char *identifier,
+                             const char *list[], int size)
+{
+    ucm_ident_set_t *set;
+    ucm_state_t *state;
+    int epoch, index, ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (identifier == NULL) || (list == NULL) || (size < 0)) {
+        LOGE("snd_use_case_get_enabled(): failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
+    if (!strncmp(identifier, "_enadevs", 8)) {
+        set = &state->dev_set;
+    } else if (!strncmp(identifier, "_enamods", 8)) {
+        set = &state->mod_set;
+    } else {
+        LOGE("Invalid identifier: %s", identifier);
+        snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
+        return -EINVAL;
+    }
+    if (set->count > size) {
+        ret = -ENOSPC;
+    } else {
+        /* Interned names are never removed while the manager is open */
+        for (index = 0; index < set->count; index++)
+            list[index] = uc_mgr->card_ctxt_ptr->ident_name[set->ids[index]];
+        ret = set->count;
+    }
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
     return ret;
 }
 
@@ -353,67 +529,48 @@ int snd_use_case_geti(snd_use_case_mgr_t *uc_mgr,
               const char *identifier,
               long *value)
 {
-    char ident[MAX_STR_LEN], *ident1, *ident2, *ident_value, *temp_ptr;
-    int index, list_size, ret = -EINVAL;
+    char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
+    ucm_state_t *state;
+    int epoch, ret = -EINVAL;
 
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
         LOGE("snd_use_case_geti(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
         return -EINVAL;
     }
 
     *value = 0;
     strlcpy(ident, identifier, sizeof(ident));
+    state = snd_ucm_state_get(uc_mgr->card_ctxt_ptr, &epoch);
     if(!(ident1 = strtok_r(ident, "/", &temp_ptr))) {
         LOGE("No valid identifier found: %s", ident);
         ret = -EINVAL;
     } else {
         if (!strncmp(ident1, "_devstatus", 10)) {
             ident2 = strtok_r(NULL, "/", &temp_ptr);
-            list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
-            for (index = 0; index < list_size; index++) {
-                ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
-                if (!strncmp(ident2, ident_value, (strlen(ident_value)+1))) {
-                    *value = 1;
-                    free(ident_value);
-                    ident_value = NULL;
-                    break;
-                } else {
-                    free(ident_value);
-                    ident_value = NULL;
-                }
-            }
+            if (ident2 && snd_ucm_get_status(uc_mgr->card_ctxt_ptr,
+                    &state->dev_set, ident2) >= 0)
+                *value = 1;
             ret = 0;
         } else if (!strncmp(ident1, "_modstatus", 10)) {
             ident2 = strtok_r(NULL, "/", &temp_ptr);
-            list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-            for (index = 0; index < list_size; index++) {
-                ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
-                if (!strncmp(ident2, ident_value, (strlen(ident_value)+1))) {
-                    *value = 1;
-                    free(ident_value);
-                    ident_value = NULL;
-                    break;
-                } else {
-                    free(ident_value);
-                    ident_value = NULL;
-                }
-            }
+            if (ident2 && snd_ucm_get_status(uc_mgr->card_ctxt_ptr,
+                    &state->mod_set, ident2) >= 0)
+                *value = 1;
             ret = 0;
         } else {
             LOGE("Unknown identifier: %s", ident1);
         }
     }
-    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    snd_ucm_state_put(uc_mgr->card_ctxt_ptr, epoch);
     return ret;
 }
 
 static int snd_use_case_apply_voice_acdb(snd_use_case_mgr_t *uc_mgr, int use_case_index)
 {
-    int list_size, index, verb_index, ret = 0, voice_acdb = 0, rx_id, tx_id;
-    char *ident_value;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    int index, verb_index, ret = 0, voice_acdb = 0, rx_id, tx_id;
+    const char *ident_value = NULL;
 
     /* Check if voice call use case/modifier exists */
     if ((!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_VOICECALL, strlen(SND_USE_CASE_VERB_VOICECALL))) ||
@@ -421,16 +578,13 @@ static int snd_use_case_apply_voice_acdb(snd_use_case_mgr_t *uc_mgr, int use_cas
         voice_acdb = 1;
     }
     if (voice_acdb != 1) {
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-        for (index = 0; index < list_size; index++) {
-            ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
+        for (index = 0; index < card_ctxt->mod_set.count; index++) {
+            ident_value = card_ctxt->ident_name[card_ctxt->mod_set.ids[index]];
             if ((!strncmp(ident_value, SND_USE_CASE_MOD_PLAY_VOICE, strlen(SND_USE_CASE_MOD_PLAY_VOICE))) ||
                 (!strncmp(ident_value, SND_USE_CASE_MOD_PLAY_VOIP, strlen(SND_USE_CASE_MOD_PLAY_VOIP)))) {
                 voice_acdb = 1;
-                free(ident_value);
                 break;
             }
-            free(ident_value);
         }
     }
 
@@ -440,27 +594,20 @@ static int snd_use_case_apply_voice_acdb(snd_use_case_mgr_t *uc_mgr, int use_cas
         return -EINVAL;
     }
     if (voice_acdb == 1) {
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
-        for (index = 0; index < list_size; index++) {
-            ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
+        ident_value = NULL;
+        for (index = 0; index < card_ctxt->dev_set.count; index++) {
+            ident_value = card_ctxt->ident_name[card_ctxt->dev_set.ids[index]];
             if (strncmp(ident_value, uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].case_name,
                 (strlen(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].case_name)+1))) {
                 break;
             }
-            free(ident_value);
             ident_value = NULL;
         }
-        index = 0;
         if (ident_value != NULL) {
-            while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name, ident_value, (strlen(ident_value)+1))) {
-                if (!strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name,
-                        SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-                    ret = -EINVAL;
-                    break;
-                }
-                index++;
-            }
-            if (ret < 0) {
+            index = snd_ucm_find_section(&uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index],
+                ident_value, NULL);
+            if (index < 0) {
+                ret = -EINVAL;
                 LOGE("No valid device found: %s",ident_value);
             } else {
                 if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].capability == CAP_RX) {
@@ -474,17 +621,17 @@ static int snd_use_case_apply_voice_acdb(snd_use_case_mgr_t *uc_mgr, int use_cas
                     tx_id = DEVICE_SPEAKER_TX_ACDB_ID;
                 }
                 if ((rx_id != uc_mgr->current_rx_device) ||
-                    (tx_id != uc_mgr->current_tx_device)) {
+                    (tx_id != uc_mgr->current_tx_device) || card_ctxt->cal_force) {
                     uc_mgr->current_rx_device = rx_id; uc_mgr->current_tx_device = tx_id;
                     LOGD("Voice acdb: rx id %d tx id %d", uc_mgr->current_rx_device,
                           uc_mgr->current_tx_device);
-                    acdb_loader_send_voice_cal(uc_mgr->current_rx_device, uc_mgr->current_tx_device);
+                    snd_ucm_send_voice_cal(card_ctxt, uc_mgr->current_rx_device,
+                        uc_mgr->current_tx_device);
                 } else {
                     LOGV("Voice acdb: Required acdb already pushed rx id %d tx id %d",
                          uc_mgr->current_rx_device, uc_mgr->current_tx_device);
                 }
             }
-            free(ident_value);
         }
     } else {
         LOGV("No voice use case found");
@@ -494,139 +641,1187 @@ static int snd_use_case_apply_voice_acdb(snd_use_case_mgr_t *uc_mgr, int use_cas
     return ret;
 }
 
-int get_use_case_index(snd_use_case_mgr_t *uc_mgr, const char *use_case)
+/* Look up a section of a verb by name, the name being ident followed by
+ * device (if not NULL). The key is hashed in place so callers do not need
+ * to build the combined name.
+ * Returns index of the section, negative error code otherwise
+ */
+static int snd_ucm_find_section(use_case_verb_t *verb, const char *ident, const char *device)
 {
-    int ret = 0, index = 0, verb_index;
+    uint32_t hash, mask;
+    size_t len = strlen(ident);
+    const char *name;
+    int index;
 
-    verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
-    if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
-       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl == NULL) ||
-       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name == NULL)) {
-        LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
+    if (verb->card_ctrl == NULL)
         return -EINVAL;
-    }
-    while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name,
-                use_case, (strlen(use_case)+1))) {
-        if (!strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name,
-                SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-            ret = -EINVAL;
-            break;
-        }
-        index++;
-        if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name == NULL) {
-            LOGE("Invalid case_name at index %d", index);
-            index++;
-            while(1) {
-                if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name == NULL) {
-                    index++;
-                    if (index == (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count+1))
-                        break;
-                    else
-                        continue;
-                } else {
-                    break;
-                }
-            }
-        }
-        if ((index == (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count+1)) ||
-            (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name == NULL)) {
-            ret = -EINVAL;
-            break;
+    if (device == NULL)
+        device = "";
+    if (verb->section_hash == NULL) {
+        for (index = 0; index <= verb->use_case_count; index++) {
+            name = verb->card_ctrl[index].case_name;
+            if (name && !strncmp(name, ident, len) && !strcmp(name + len, device))
+                return index;
         }
+        return -EINVAL;
     }
-    if (ret < 0) {
-        return ret;
-    } else {
-        return index;
+    mask = verb->section_hash_size - 1;
+    hash = snd_ucm_hash_add(snd_ucm_hash(ident), device) & mask;
+    while (verb->section_hash[hash]) {
+        name = verb->card_ctrl[verb->section_hash[hash] - 1].case_name;
+        if (!strncmp(name, ident, len) && !strcmp(name + len, device))
+            return verb->section_hash[hash] - 1;
+        hash = (hash + 1) & mask;
     }
+    return -EINVAL;
 }
 
-/* Apply the required mixer controls for specific use case
- * uc_mgr - UCM structure pointer
- * use_case - use case name
- * return 0 on sucess, otherwise a negative error code
+/* Build the section name index of a verb, sections are inserted in
+ * order so that a lookup returns the first of duplicate names
+ * Returns 0 on sucess, negative error code otherwise
  */
-int snd_use_case_apply_mixer_controls(snd_use_case_mgr_t *uc_mgr,
-                const char *use_case, int enable)
+static int snd_ucm_index_verb(use_case_verb_t *verb)
 {
-    mixer_control_t *mixer_list;
-    struct mixer_ctl *ctl;
-    int i, ret = 0, index = 0, verb_index, use_case_index, mixer_count;
+    int index, size = 16;
+    uint32_t hash;
 
-    verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
-    if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
-       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl == NULL)) {
-        LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
-        return -EINVAL;
+    while (size < 2 * (verb->use_case_count + 1))
+        size *= 2;
+    verb->section_hash = (int *)snd_ucm_arena_alloc(&verb->arena, size * sizeof(int));
+    if (verb->section_hash == NULL) {
+        verb->section_hash_size = 0;
+        return -ENOMEM;
     }
-    if ((use_case_index = get_use_case_index(uc_mgr, use_case)) < 0) {
-        LOGE("No valid use case found with the use case: %s", use_case);
-        ret = -ENODEV;
-    } else {
-        if (!uc_mgr->card_ctxt_ptr->mixer_handle) {
-            LOGE("Control device not initialized");
-            ret = -ENODEV;
+    verb->section_hash_size = size;
+    for (index = 0; index <= verb->use_case_count; index++) {
+        if (verb->card_ctrl[index].case_name == NULL)
+            continue;
+        hash = snd_ucm_hash(verb->card_ctrl[index].case_name) & (size - 1);
+        while (verb->section_hash[hash])
+            hash = (hash + 1) & (size - 1);
+        verb->section_hash[hash] = index + 1;
+    }
+    return 0;
+}
+
+/* Get the section index of ident + device for the current verb
+ * Returns index of the section, negative error code otherwise
+ */
+static int snd_ucm_get_case_index(snd_use_case_mgr_t *uc_mgr, const char *ident,
+    const char *device)
+{
+    int verb_index;
+
+    verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
+    if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
+       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl == NULL) ||
+       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[0].case_name == NULL)) {
+        LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
+        return -EINVAL;
+    }
+    return snd_ucm_find_section(&uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index],
+        ident, device);
+}
+
+int get_use_case_index(snd_use_case_mgr_t *uc_mgr, const char *use_case)
+{
+    return snd_ucm_get_case_index(uc_mgr, use_case, NULL);
+}
+
+/* Resolve the value of a parsed mixer control for its bound control
+ * mctl - mixer control with ctl and values set
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_resolve_control(mixer_control_t *mctl)
+{
+    if (mctl->type == TYPE_INT)
+        return mixer_ctl_resolve_percent(mctl->ctl, mctl->value, mctl->values);
+    else if (mctl->type == TYPE_MULTI_VAL)
+        return mixer_ctl_resolve_mulvalues(mctl->ctl, mctl->value, mctl->mulval, mctl->values);
+    return mixer_ctl_resolve_enum(mctl->ctl, mctl->string, mctl->values);
+}
+
+/* Bind a list of mixer controls to the controls of the card
+ * mixer - mixer handle
+ * list - mixer control list
+ * count - number of controls in the list
+ * values - storage for the resolved values, NULL to only count them
+ * Returns the number of values used by the list
+ */
+static size_t snd_ucm_bind_list(struct mixer *mixer, mixer_control_t *list,
+    int count, long long *values)
+{
+    size_t used = 0;
+    int index;
+
+    for (index = 0; list != NULL && index < count; index++) {
+        list[index].ctl = mixer_get_control(mixer, list[index].control_name, 0);
+        list[index].values = NULL;
+        if (list[index].ctl == NULL)
+            continue;
+        if (values != NULL) {
+            list[index].values = values + used;
+            if (snd_ucm_resolve_control(&list[index]) < 0) {
+                LOGE("Invalid value for mixer control %s", list[index].control_name);
+                list[index].values = NULL;
+            }
+        }
+        used += list[index].ctl->info->count;
+    }
+    return used;
+}
+
+/* Bind all mixer controls of a verb to the controls of the card and
+ * resolve their values, so that applying a section only writes values
+ * mixer - mixer handle
+ * verb - verb to bind
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_bind_verb(struct mixer *mixer, use_case_verb_t *verb)
+{
+    card_mctrl_t *section;
+    long long *values = NULL;
+    size_t total = 0, used = 0;
+    int index;
+
+    free(verb->ctl_values);
+    verb->ctl_values = NULL;
+    /* Lists shared through the pool are bound there */
+    for (index = 0; index < verb->use_case_count; index++) {
+        section = &verb->card_ctrl[index];
+        if (section->ena_shared == NULL)
+            total += snd_ucm_bind_list(mixer, section->ena_mixer_list,
+                         section->ena_mixer_count, NULL);
+        if (section->dis_shared == NULL)
+            total += snd_ucm_bind_list(mixer, section->dis_mixer_list,
+                         section->dis_mixer_count, NULL);
+    }
+    if (total == 0)
+        return 0;
+    values = (long long *)calloc(total, sizeof(long long));
+    if (values == NULL) {
+        LOGE("Failed to allocate memory for mixer control values");
+        return -ENOMEM;
+    }
+    for (index = 0; index < verb->use_case_count; index++) {
+        section = &verb->card_ctrl[index];
+        if (section->ena_shared == NULL)
+            used += snd_ucm_bind_list(mixer, section->ena_mixer_list,
+                        section->ena_mixer_count, values + used);
+        if (section->dis_shared == NULL)
+            used += snd_ucm_bind_list(mixer, section->dis_mixer_list,
+                        section->dis_mixer_count, values + used);
+    }
+    verb->ctl_values = values;
+    return 0;
+}
+
+/* Allocate zeroed memory from an arena
+ * arena - arena to allocate from
+ * size - number of bytes
+ * Returns the memory, NULL on failure
+ */
+static void *snd_ucm_arena_alloc(ucm_arena_t *arena, size_t size)
+{
+    ucm_arena_block_t *block = arena->head;
+    size_t block_size;
+    char *ptr;
+
+    size = (size + UCM_ARENA_ALIGN - 1) & ~((size_t)UCM_ARENA_ALIGN - 1);
+    if ((block == NULL) || (block->used + size > block->size)) {
+        block_size = (size > UCM_ARENA_BLOCK_SIZE) ? size : UCM_ARENA_BLOCK_SIZE;
+        block = (ucm_arena_block_t *)malloc(sizeof(ucm_arena_block_t) + block_size);
+        if (block == NULL)
+            return NULL;
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+        arena->total += block_size;
+    }
+    ptr = (char *)block->data + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+/* Remember the current end of an arena */
+static void snd_ucm_arena_mark(ucm_arena_t *arena, ucm_arena_mark_t *mark)
+{
+    mark->block = arena->head;
+    mark->used = arena->head ? arena->head->used : 0;
+}
+
+/* Give back everything allocated from an arena after a mark */
+static void snd_ucm_arena_reset(ucm_arena_t *arena, ucm_arena_mark_t *mark)
+{
+    ucm_arena_block_t *block;
+
+    while ((arena->head != NULL) && (arena->head != mark->block)) {
+        block = arena->head;
+        arena->head = block->next;
+        arena->total -= block->size;
+        free(block);
+    }
+    if (arena->head != NULL)
+        arena->head->used = mark->used;
+}
+
+/* Free all the memory of an arena */
+static void snd_ucm_arena_free(ucm_arena_t *arena)
+{
+    ucm_arena_block_t *block, *next;
+
+    for (block = arena->head; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+    arena->head = NULL;
+    arena->total = 0;
+}
+
+/* Create the string pool of a card
+ * Returns the pool, NULL on failure
+ */
+static ucm_str_pool_t *snd_ucm_str_pool_create(void)
+{
+    ucm_str_pool_t *pool;
+
+    pool = (ucm_str_pool_t *)calloc(1, sizeof(ucm_str_pool_t));
+    if (pool == NULL)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/* Free the string pool and all the strings in it */
+static void snd_ucm_str_pool_destroy(ucm_str_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    LOGV("String pool: %d strings, %u bytes", pool->count, (unsigned)pool->arena.total);
+    snd_ucm_arena_free(&pool->arena);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/* Get the pooled copy of a string, the copy stays valid until the pool
+ * is destroyed and must not be modified
+ * pool - string pool of the card
+ * str - string to look up
+ * Returns the pooled string, NULL on failure
+ */
+static char *snd_ucm_intern(ucm_str_pool_t *pool, const char *str)
+{
+    ucm_str_t *entry;
+    uint32_t hash;
+    size_t len;
+
+    hash = snd_ucm_hash(str);
+    pthread_mutex_lock(&pool->lock);
+    for (entry = pool->hash[hash % UCM_STR_POOL_SIZE]; entry != NULL; entry = entry->next) {
+        if ((entry->hash == hash) && !strcmp(entry->str, str)) {
+            pthread_mutex_unlock(&pool->lock);
+            return entry->str;
+        }
+    }
+    len = strlen(str);
+    entry = (ucm_str_t *)snd_ucm_arena_alloc(&pool->arena, sizeof(ucm_str_t) + len + 1);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    entry->hash = hash;
+    memcpy(entry->str, str, len + 1);
+    entry->next = pool->hash[hash % UCM_STR_POOL_SIZE];
+    pool->hash[hash % UCM_STR_POOL_SIZE] = entry;
+    pool->count++;
+    pthread_mutex_unlock(&pool->lock);
+    return entry->str;
+}
+
+/* Create the pool of shared mixer control lists of a card
+ * mixer - mixer handle the lists are bound to, may be NULL
+ * Returns the pool, NULL on failure
+ */
+static ucm_ctl_pool_t *snd_ucm_ctl_pool_create(struct mixer *mixer)
+{
+    ucm_ctl_pool_t *pool;
+
+    pool = (ucm_ctl_pool_t *)calloc(1, sizeof(ucm_ctl_pool_t));
+    if (pool == NULL)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->mixer = mixer;
+    return pool;
+}
+
+/* Free the pool and any list still in it */
+static void snd_ucm_ctl_pool_destroy(ucm_ctl_pool_t *pool)
+{
+    ucm_ctl_list_t *entry, *next;
+    int index;
+
+    if (pool == NULL)
+        return;
+    LOGV("Control pool: %d lists, %d shared", pool->lists, pool->shared);
+    for (index = 0; index < UCM_CTL_POOL_SIZE; index++) {
+        for (entry = pool->hash[index]; entry != NULL; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/* Hash a mixer control list by its contents */
+static uint32_t snd_ucm_hash_controls(const mixer_control_t *list, int count)
+{
+    uint32_t hash = UCM_HASH_INIT;
+    unsigned mul_index;
+    int index;
+
+    for (index = 0; index < count; index++) {
+        hash = snd_ucm_hash_add(hash, list[index].control_name);
+        hash = (hash ^ list[index].type) * 16777619u;
+        if (list[index].type == TYPE_STR) {
+            hash = snd_ucm_hash_add(hash, list[index].string ? list[index].string : "");
         } else {
-            LOGD("Set mixer controls for %s enable %d", use_case, enable);
-            if (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].acdb_id &&
-                uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].capability) {
-                /*TODO: Check for voice call use case or modifier and set voice calibration*/
-                if (enable) {
-                    if (snd_use_case_apply_voice_acdb(uc_mgr, use_case_index)) {
-                        LOGD("acdb_id %d cap %d enable %d", uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].acdb_id,
-                            uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].capability, enable);
-                        acdb_loader_send_audio_cal(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].acdb_id,
-                            uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].capability);
-                    }
-                }
+            hash = (hash ^ list[index].value) * 16777619u;
+            for (mul_index = 0; (list[index].type == TYPE_MULTI_VAL) &&
+                 (mul_index < list[index].value); mul_index++)
+                hash = snd_ucm_hash_add(hash, list[index].mulval[mul_index]);
+        }
+    }
+    return hash;
+}
+
+/* Compare two mixer control lists of the same length by contents */
+static int snd_ucm_same_controls(const mixer_control_t *a, const mixer_control_t *b, int count)
+{
+    unsigned mul_index;
+    int index;
+
+    for (index = 0; index < count; index++) {
+        if ((a[index].type != b[index].type) ||
+            strcmp(a[index].control_name, b[index].control_name))
+            return 0;
+        if (a[index].type == TYPE_STR) {
+            if (strcmp(a[index].string ? a[index].string : "",
+                       b[index].string ? b[index].string : ""))
+                return 0;
+            continue;
+        }
+        if (a[index].value != b[index].value)
+            return 0;
+        for (mul_index = 0; (a[index].type == TYPE_MULTI_VAL) &&
+             (mul_index < a[index].value); mul_index++) {
+            if (strcmp(a[index].mulval[mul_index], b[index].mulval[mul_index]))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/* Share a parsed mixer control list with the sections of the card that
+ * have the same controls. A list not in the pool yet is copied into it
+ * and bound to the mixer, the parsed list is not used anymore either way.
+ * pool - control pool of the card, NULL to keep the list as it is
+ * list - parsed mixer control list
+ * count - number of controls in the list
+ * shared - returns the pool entry, NULL if the list is not shared
+ * Returns the list to be used by the section
+ */
+static mixer_control_t *snd_ucm_share_controls(ucm_ctl_pool_t *pool, mixer_control_t *list,
+    int count, ucm_ctl_list_t **shared)
+{
+    ucm_ctl_list_t *entry;
+    mixer_control_t *copy;
+    char **mulval;
+    uint32_t hash;
+    size_t total = 0, mul_total = 0, ctl_size, size;
+    int index;
+
+    *shared = NULL;
+    if ((pool == NULL) || (list == NULL) || (count <= 0))
+        return list;
+    hash = snd_ucm_hash_controls(list, count);
+    pthread_mutex_lock(&pool->lock);
+    for (entry = pool->hash[hash % UCM_CTL_POOL_SIZE]; entry != NULL; entry = entry->next) {
+        if ((entry->hash == hash) && (entry->count == count) &&
+            snd_ucm_same_controls(entry->list, list, count))
+            break;
+    }
+    if (entry != NULL) {
+        entry->refs++;
+        pool->shared++;
+        pthread_mutex_unlock(&pool->lock);
+        *shared = entry;
+        return entry->list;
+    }
+    if (pool->mixer)
+        total = snd_ucm_bind_list(pool->mixer, list, count, NULL);
+    for (index = 0; index < count; index++) {
+        if (list[index].type == TYPE_MULTI_VAL)
+            mul_total += list[index].value;
+    }
+    /* Values follow the controls, aligned for long long */
+    ctl_size = (count * sizeof(mixer_control_t) + UCM_ARENA_ALIGN - 1) &
+               ~((size_t)UCM_ARENA_ALIGN - 1);
+    size = sizeof(ucm_ctl_list_t) + ctl_size + total * sizeof(long long) +
+           mul_total * sizeof(char *);
+    entry = (ucm_ctl_list_t *)calloc(1, size);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        return list;
+    }
+    /* Control names and values are pooled strings, only the arrays
+     * are copied */
+    copy = (mixer_control_t *)(entry + 1);
+    memcpy(copy, list, count * sizeof(mixer_control_t));
+    entry->values = total ? (long long *)((char *)copy + ctl_size) : NULL;
+    mulval = (char **)((long long *)((char *)copy + ctl_size) + total);
+    for (index = 0; index < count; index++) {
+        if ((copy[index].type != TYPE_MULTI_VAL) || (copy[index].mulval == NULL))
+            continue;
+        memcpy(mulval, copy[index].mulval, copy[index].value * sizeof(char *));
+        copy[index].mulval = mulval;
+        mulval += copy[index].value;
+    }
+    if (total)
+        snd_ucm_bind_list(pool->mixer, copy, count, entry->values);
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->count = count;
+    entry->list = copy;
+    entry->next = pool->hash[hash % UCM_CTL_POOL_SIZE];
+    pool->hash[hash % UCM_CTL_POOL_SIZE] = entry;
+    pool->lists++;
+    pthread_mutex_unlock(&pool->lock);
+    *shared = entry;
+    return copy;
+}
+
+/* Drop a reference to a shared mixer control list, the list is freed
+ * with its last user */
+static void snd_ucm_release_controls(ucm_ctl_pool_t *pool, ucm_ctl_list_t *shared)
+{
+    ucm_ctl_list_t **link;
+
+    pthread_mutex_lock(&pool->lock);
+    if (--shared->refs > 0) {
+        pool->shared--;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    for (link = &pool->hash[shared->hash % UCM_CTL_POOL_SIZE]; *link != NULL;
+         link = &(*link)->next) {
+        if (*link == shared) {
+            *link = shared->next;
+            break;
+        }
+    }
+    pool->lists--;
+    pthread_mutex_unlock(&pool->lock);
+    free(shared);
+}
+
+/* Publish the current routing state for the query functions, called with
+ * card_lock held after every change. The current state is the slot of the
+ * epoch parity, the next one is filled in the other slot and made current
+ * by moving to the next epoch. Returns once no reader can be using the
+ * previous state anymore, so that its slot can be filled again and the
+ * tables it points to can be freed.
+ * card_ctxt - card context
+ */
+static void snd_ucm_publish_state(card_ctxt_t *card_ctxt)
+{
+    ucm_state_t *next;
+    int epoch;
+
+    epoch = __sync_fetch_and_add(&card_ctxt->state_epoch, 0) & 1;
+    next = &card_ctxt->states[epoch ^ 1];
+    strlcpy(next->current_verb, card_ctxt->current_verb, MAX_STR_LEN);
+    next->verb_index = -1;
+    memset(&next->verb, 0, sizeof(next->verb));
+    if ((card_ctxt->current_verb_index >= 0) &&
+        (card_ctxt->current_verb_index < card_ctxt->verb_count)) {
+        next->verb_index = card_ctxt->current_verb_index;
+        next->verb = card_ctxt->use_case_verb_list[card_ctxt->current_verb_index];
+    }
+    next->verb_list = card_ctxt->verb_list;
+    next->dev_set = card_ctxt->dev_set;
+    next->mod_set = card_ctxt->mod_set;
+    /* Readers entering from now on use the new slot */
+    __sync_fetch_and_add(&card_ctxt->state_epoch, 1);
+    while (__sync_fetch_and_add(&card_ctxt->state_readers[epoch], 0) > 0)
+        sched_yield();
+}
+
+/* Get the published routing state without taking card_lock
+ * card_ctxt - card context
+ * epoch - returns the epoch to pass to snd_ucm_state_put
+ * Returns the state, valid until snd_ucm_state_put
+ */
+static ucm_state_t *snd_ucm_state_get(card_ctxt_t *card_ctxt, int *epoch)
+{
+    int cur;
+
+    while (1) {
+        cur = __sync_fetch_and_add(&card_ctxt->state_epoch, 0) & 1;
+        __sync_fetch_and_add(&card_ctxt->state_readers[cur], 1);
+        if ((__sync_fetch_and_add(&card_ctxt->state_epoch, 0) & 1) == cur)
+            break;
+        /* A state was published meanwhile, the writer may not have
+         * seen this reader */
+        __sync_fetch_and_sub(&card_ctxt->state_readers[cur], 1);
+    }
+    *epoch = cur;
+    return &card_ctxt->states[cur];
+}
+
+/* Release the state got with snd_ucm_state_get */
+static void snd_ucm_state_put(card_ctxt_t *card_ctxt, int epoch)
+{
+    __sync_fetch_and_sub(&card_ctxt->state_readers[epoch], 1);
+}
+
+/* Get the monotonic time in microseconds */
+static long long snd_ucm_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Start measuring a routing transition, called with card_lock held
+ * card_ctxt - card context
+ * identifier - identifier of the request
+ * value - value of the request
+ */
+static void snd_ucm_stats_begin(card_ctxt_t *card_ctxt, const char *identifier,
+                                const char *value)
+{
+    ucm_stats_t *stats = &card_ctxt->stats;
+    ucm_transition_t *cur;
+
+    cur = &stats->ring[stats->count % UCM_STATS_RING];
+    memset(cur, 0, sizeof(*cur));
+    cur->seq = stats->count;
+    strlcpy(cur->identifier, identifier, sizeof(cur->identifier));
+    strlcpy(cur->value, value ? value : "", sizeof(cur->value));
+    stats->cur = cur;
+    stats->start_us = snd_ucm_now_us();
+}
+
+/* Finish measuring the current routing transition and add it to the ring
+ * card_ctxt - card context
+ * requests - number of requests applied by the transition
+ * result - result of the transition
+ */
+static void snd_ucm_stats_end(card_ctxt_t *card_ctxt, int requests, int result)
+{
+    ucm_stats_t *stats = &card_ctxt->stats;
+    ucm_transition_t *cur = stats->cur;
+    unsigned int other;
+
+    if (cur == NULL)
+        return;
+    cur->requests = requests;
+    cur->result = result;
+    cur->total_us = (unsigned int)(snd_ucm_now_us() - stats->start_us);
+    other = cur->write_us + cur->acdb_us;
+    cur->lookup_us = (cur->total_us > other) ? (cur->total_us - other) : 0;
+    LOGD("Transition %s %s: %u us, lookup %u us, %d writes %u us (max %u us), "
+         "acdb %d %u us (%d cached), skipped %d failed %d rolled back %d",
+         cur->identifier, cur->value, cur->total_us, cur->lookup_us, cur->writes,
+         cur->write_us, cur->write_max_us, cur->acdb_sends, cur->acdb_us,
+         cur->acdb_cached, cur->skipped, cur->failed, cur->rolled_back);
+    stats->count++;
+    stats->cur = NULL;
+}
+
+/* Format the recent transitions, the most recent first
+ * card_ctxt - card context
+ * buf - output buffer
+ * size - size of buf
+ * Returns the length of the output
+ */
+static int snd_ucm_stats_format(card_ctxt_t *card_ctxt, char *buf, size_t size)
+{
+    ucm_stats_t *stats = &card_ctxt->stats;
+    ucm_transition_t *tr;
+    unsigned int index, count;
+    int len = 0, ret;
+
+    buf[0] = 0;
+    count = (stats->count < UCM_STATS_RING) ? stats->count : UCM_STATS_RING;
+    for (index = 0; index < count; index++) {
+        tr = &stats->ring[(stats->count - 1 - index) % UCM_STATS_RING];
+        ret = snprintf(buf + len, size - len,
+                 "%u %s %s: requests %d result %d total %u lookup %u write %u/%d "
+                 "max %u acdb %u/%d cached %d skipped %d failed %d rolledback %d\n",
+                 tr->seq, tr->identifier, tr->value, tr->requests, tr->result,
+                 tr->total_us, tr->lookup_us, tr->write_us, tr->writes,
+                 tr->write_max_us, tr->acdb_us, tr->acdb_sends, tr->acdb_cached,
+                 tr->skipped, tr->failed, tr->rolled_back);
+        if ((ret < 0) || ((size_t)ret >= size - len))
+            break;
+        len += ret;
+    }
+    return len;
+}
+
+/* Write the values of a mixer control to the card and account it to the
+ * current transition
+ * card_ctxt - card context
+ * mctl - bound mixer control with resolved values
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_write_values(card_ctxt_t *card_ctxt, mixer_control_t *mctl)
+{
+    ucm_transition_t *cur = card_ctxt->stats.cur;
+    long long start, *staged;
+    unsigned int elapsed;
+    int ret;
+
+    if (cur == NULL) {
+        ret = mixer_ctl_write_values(mctl->ctl, mctl->values);
+    } else {
+        start = snd_ucm_now_us();
+        ret = mixer_ctl_write_values(mctl->ctl, mctl->values);
+        elapsed = (unsigned int)(snd_ucm_now_us() - start);
+        cur->writes++;
+        cur->write_us += elapsed;
+        if (elapsed > cur->write_max_us)
+            cur->write_max_us = elapsed;
+        if (ret < 0)
+            cur->failed++;
+    }
+    /* Keep the staged value in line with what the card now holds */
+    if ((ret >= 0) && ((staged = snd_ucm_stage_lookup(card_ctxt, mctl->ctl)) != NULL))
+        memcpy(staged, mctl->values, mctl->ctl->info->count * sizeof(long long));
+    return ret;
+}
+
+/* Send the audio calibration of a device and account it to the current
+ * transition. The calibration is not sent again while it is resident for
+ * all the capabilities of the device.
+ * card_ctxt - card context
+ * acdb_id - ACDB id of the device
+ * capability - CAP_RX or CAP_TX
+ */
+static void snd_ucm_send_audio_cal(card_ctxt_t *card_ctxt, int acdb_id, int capability)
+{
+    ucm_transition_t *cur = card_ctxt->stats.cur;
+    long long start;
+    int slot, resident = !card_ctxt->cal_force;
+
+    if (card_ctxt->stage.dry)
+        return;
+    if (card_ctxt->cal_defer) {
+        for (slot = 0; slot < UCM_CAL_SLOTS; slot++) {
+            if (capability & (1 << slot))
+                card_ctxt->cal_pending[slot] = acdb_id;
+        }
+        return;
+    }
+    for (slot = 0; slot < UCM_CAL_SLOTS; slot++) {
+        if ((capability & (1 << slot)) && (card_ctxt->cal_audio[slot] != acdb_id))
+            resident = 0;
+    }
+    if (resident && (capability & ((1 << UCM_CAL_SLOTS) - 1))) {
+        LOGV("acdb_id %d cap %d already sent", acdb_id, capability);
+        if (cur)
+            cur->acdb_cached++;
+        return;
+    }
+    start = snd_ucm_now_us();
+    acdb_loader_send_audio_cal(acdb_id, capability);
+    for (slot = 0; slot < UCM_CAL_SLOTS; slot++) {
+        if (capability & (1 << slot))
+            card_ctxt->cal_audio[slot] = acdb_id;
+    }
+    if (cur) {
+        cur->acdb_us += (unsigned int)(snd_ucm_now_us() - start);
+        cur->acdb_sends++;
+    }
+}
+
+/* Forget the audio calibration of a device whose path is disabled
+ * card_ctxt - card context
+ * acdb_id - ACDB id of the device
+ * capability - CAP_RX or CAP_TX
+ */
+static void snd_ucm_drop_audio_cal(card_ctxt_t *card_ctxt, int acdb_id, int capability)
+{
+    int slot;
+
+    for (slot = 0; slot < UCM_CAL_SLOTS; slot++) {
+        if (!(capability & (1 << slot)))
+            continue;
+        if (card_ctxt->cal_audio[slot] == acdb_id)
+            card_ctxt->cal_audio[slot] = 0;
+        if (card_ctxt->cal_pending[slot] == acdb_id)
+            card_ctxt->cal_pending[slot] = 0;
+    }
+}
+
+/* Send the voice calibration of a device pair and account it to the
+ * current transition
+ * card_ctxt - card context
+ * rx_id - ACDB id of the rx device
+ * tx_id - ACDB id of the tx device
+ */
+static void snd_ucm_send_voice_cal(card_ctxt_t *card_ctxt, int rx_id, int tx_id)
+{
+    ucm_transition_t *cur = card_ctxt->stats.cur;
+    long long start;
+
+    if (card_ctxt->stage.dry) {
+        card_ctxt->stage.rx_id = rx_id;
+        card_ctxt->stage.tx_id = tx_id;
+        return;
+    }
+    if (card_ctxt->cal_defer) {
+        card_ctxt->cal_voice_rx = rx_id;
+        card_ctxt->cal_voice_tx = tx_id;
+        return;
+    }
+    start = snd_ucm_now_us();
+    acdb_loader_send_voice_cal(rx_id, tx_id);
+    /* The voice path reconfigures the devices of the audio path */
+    memset(card_ctxt->cal_audio, 0, sizeof(card_ctxt->cal_audio));
+    if (cur) {
+        cur->acdb_us += (unsigned int)(snd_ucm_now_us() - start);
+        cur->acdb_sends++;
+    }
+}
+
+/* Send the calibration recorded while it was deferred, that is the one
+ * of the devices still enabled at the end of the batch. The voice
+ * calibration goes first as it invalidates the audio one.
+ * card_ctxt - card context
+ */
+static void snd_ucm_cal_flush(card_ctxt_t *card_ctxt)
+{
+    int slot, other, acdb_id, capability;
+
+    card_ctxt->cal_defer = 0;
+    if (card_ctxt->cal_voice_rx >= 0)
+        snd_ucm_send_voice_cal(card_ctxt, card_ctxt->cal_voice_rx, card_ctxt->cal_voice_tx);
+    card_ctxt->cal_voice_rx = card_ctxt->cal_voice_tx = -1;
+    for (slot = 0; slot < UCM_CAL_SLOTS; slot++) {
+        if ((acdb_id = card_ctxt->cal_pending[slot]) == 0)
+            continue;
+        /* A device covering several capabilities is sent once */
+        capability = 0;
+        for (other = slot; other < UCM_CAL_SLOTS; other++) {
+            if (card_ctxt->cal_pending[other] == acdb_id) {
+                capability |= 1 << other;
+                card_ctxt->cal_pending[other] = 0;
             }
+        }
+        snd_ucm_send_audio_cal(card_ctxt, acdb_id, capability);
+    }
+}
+
+/* Start recording the control writes of a routing transition
+ * card_ctxt - card context
+ * If the plan cannot be set up the writes are applied directly.
+ */
+static void snd_ucm_plan_begin(card_ctxt_t *card_ctxt)
+{
+    ucm_plan_t *plan = &card_ctxt->plan;
+
+    if (!card_ctxt->mixer_handle || plan->hold)
+        return;
+    if (plan->last == NULL) {
+        plan->last = (int *)calloc(card_ctxt->mixer_handle->count, sizeof(int));
+        if (plan->last == NULL) {
+            LOGE("Failed to allocate memory for transition plan");
+            return;
+        }
+    }
+    plan->count = 0;
+    plan->active = 1;
+}
+
+/* Keep the value a control held before the commit writes it
+ * plan - transition plan
+ * used - number of undo values in use, updated
+ * index - index of the write in the plan
+ * values - current values of the control
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_plan_save(ucm_plan_t *plan, int *used, int index, const long long *values)
+{
+    int count = plan->writes[index]->ctl->info->count, size;
+    long long *undo;
+
+    if (*used + count + 1 > plan->undo_size) {
+        size = plan->undo_size ? plan->undo_size * 2 : 256;
+        while (size < *used + count + 1)
+            size *= 2;
+        undo = (long long *)realloc(plan->undo, size * sizeof(long long));
+        if (undo == NULL)
+            return -ENOMEM;
+        plan->undo = undo;
+        plan->undo_size = size;
+    }
+    memcpy(&plan->undo[*used], values, count * sizeof(long long));
+    plan->undo[*used + count] = index;
+    *used += count + 1;
+    return 0;
+}
+
+/* Write back the saved values of the controls written by a failed commit,
+ * last written first
+ * card_ctxt - card context
+ * used - number of undo values in use
+ */
+static void snd_ucm_plan_undo(card_ctxt_t *card_ctxt, int used)
+{
+    ucm_plan_t *plan = &card_ctxt->plan;
+    mixer_control_t mctl;
+    int index;
+
+    while (used > 0) {
+        index = (int)plan->undo[used - 1];
+        mctl = *plan->writes[index];
+        used -= mctl.ctl->info->count + 1;
+        mctl.values = &plan->undo[used];
+        if (snd_ucm_write_values(card_ctxt, &mctl) < 0)
+            LOGE("Failed to restore mixer control %s", mctl.control_name);
+        if (card_ctxt->stats.cur)
+            card_ctxt->stats.cur->rolled_back++;
+    }
+}
+
+/* Write the recorded controls of a routing transition. Each control is
+ * written once at the position of its last write, so controls which are
+ * disabled by the old path keep their place ahead of the controls enabled
+ * by the new one. Controls known to hold their final value, from the
+ * value cache of the mixer or the stage, are skipped; the others are
+ * written without reading them first. A staged value is dropped once the
+ * card reports a change of the control, and without change events a skip
+ * is confirmed by reading the control. The known values are kept, and if
+ * a write fails the controls written so far are set back to them, so that
+ * a transition is undone as far as the old values are known.
+ * card_ctxt - card context
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_plan_commit(card_ctxt_t *card_ctxt)
+{
+    ucm_plan_t *plan = &card_ctxt->plan;
+    struct mixer *mixer = card_ctxt->mixer_handle;
+    long long values[MIXER_MAX_VALUES], *staged;
+    mixer_control_t *mctl;
+    int index, ret = 0, written = 0, used = 0, undoable = 1;
+    size_t size;
+
+    if (!plan->active || plan->hold)
+        return 0;
+    plan->active = 0;
+    for (index = 0; index < plan->count; index++)
+        plan->last[plan->writes[index]->ctl - mixer->ctl] = index;
+    for (index = 0; index < plan->count; index++) {
+        mctl = plan->writes[index];
+        if (plan->last[mctl->ctl - mixer->ctl] != index)
+            continue;
+        staged = snd_ucm_stage_lookup(card_ctxt, mctl->ctl);
+        size = mctl->ctl->info->count * sizeof(long long);
+        if (!mixer_ctl_cached_values(mctl->ctl, values)) {
+            staged = values;
+        } else if (staged && mctl->ctl->cache) {
+            /* Changed on the card since it was staged */
+            staged = NULL;
+        } else if (staged && !memcmp(staged, mctl->values, size)) {
+            /* Without change events only the card confirms a skip */
+            staged = (mixer_ctl_read_values(mctl->ctl, values) < 0) ? NULL : values;
+        }
+        if (staged && !memcmp(staged, mctl->values, size))
+            continue;
+        if (staged == NULL || snd_ucm_plan_save(plan, &used, index, staged) < 0)
+            undoable = 0;
+        LOGD("Setting mixer control: %s", mctl->control_name);
+        ret = snd_ucm_write_values(card_ctxt, mctl);
+        if (ret < 0) {
+            LOGE("Failed to set mixer control %s", mctl->control_name);
+            if (!undoable)
+                LOGE("Transition can only be partly undone");
+            snd_ucm_plan_undo(card_ctxt, used);
+            break;
+        }
+        written++;
+    }
+    LOGD("Transition planned %d control writes, %d written", plan->count, written);
+    if (card_ctxt->stats.cur)
+        card_ctxt->stats.cur->skipped += plan->count - written;
+    plan->count = 0;
+    /* A staged transition only serves the verb change following it */
+    if (card_ctxt->stage.used && (card_ctxt->stage.verb_index < 0))
+        snd_ucm_stage_clear(card_ctxt);
+    return ret;
+}
+
+/* Write a resolved mixer control or record it if a transition is planned
+ * card_ctxt - card context
+ * mctl - bound mixer control with resolved values
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_write_control(card_ctxt_t *card_ctxt, mixer_control_t *mctl)
+{
+    ucm_plan_t *plan = &card_ctxt->plan;
+    mixer_control_t **writes;
+    int size, ret;
+
+    if (plan->active) {
+        if (plan->count == plan->size) {
+            size = plan->size ? plan->size * 2 : 64;
+            writes = (mixer_control_t **)realloc(plan->writes, size * sizeof(mixer_control_t *));
+            if (writes == NULL) {
+                if (card_ctxt->stage.dry)
+                    return -ENOMEM;
+                /* Keep the order by flushing what was planned so far */
+                plan->hold = 0;
+                ret = snd_ucm_plan_commit(card_ctxt);
+                if (ret < 0)
+                    return ret;
+                return snd_ucm_write_values(card_ctxt, mctl);
+            }
+            plan->writes = writes;
+            plan->size = size;
+        }
+        plan->writes[plan->count++] = mctl;
+        return 0;
+    }
+    return snd_ucm_write_values(card_ctxt, mctl);
+}
+
+/* Look up the staged value of a mixer control
+ * card_ctxt - card context
+ * ctl - mixer control
+ * Returns the staged values, NULL if the control is not staged
+ */
+static long long *snd_ucm_stage_lookup(card_ctxt_t *card_ctxt, struct mixer_ctl *ctl)
+{
+    ucm_stage_t *stage = &card_ctxt->stage;
+    int slot;
+
+    if (!stage->used)
+        return NULL;
+    slot = stage->slot[ctl - card_ctxt->mixer_handle->ctl];
+    return slot ? &stage->values[slot - 1] : NULL;
+}
+
+/* Drop the staged transition, the buffers are kept for the next one
+ * card_ctxt - card context
+ */
+static void snd_ucm_stage_clear(card_ctxt_t *card_ctxt)
+{
+    ucm_stage_t *stage = &card_ctxt->stage;
+
+    if (stage->used)
+        memset(stage->slot, 0, card_ctxt->mixer_handle->count * sizeof(int));
+    stage->used = 0;
+    stage->verb_index = -1;
+    stage->rx_id = -1;
+    stage->tx_id = -1;
+}
+
+/* Prepare the change to a verb ahead of time, called with card_lock held.
+ * The verb is loaded and the transition is resolved against the current
+ * routing through the regular verb path without touching the card, the
+ * controls it writes are read so that the verb change only has to write
+ * the ones differing. The voice calibration ids of the new routing are
+ * only resolved, the calibration is sent by the verb change itself.
+ * uc_mgr - UCM structure pointer
+ * value - verb to be staged
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_stage_verb(snd_use_case_mgr_t *uc_mgr, const char *value)
+{
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    struct mixer *mixer = card_ctxt->mixer_handle;
+    ucm_plan_t *plan = &card_ctxt->plan;
+    ucm_stage_t *stage = &card_ctxt->stage;
+    ucm_ident_set_t dev_set, mod_set;
+    char verb[MAX_STR_LEN];
+    int cal_audio[UCM_CAL_SLOTS];
+    struct mixer_ctl *ctl;
+    long long *values;
+    int index, verb_index, staged, rx_id, tx_id, active, hold, base, size, ret;
+
+    for (index = 0; strncmp(card_ctxt->verb_list[index], SND_UCM_END_OF_LIST,
+         strlen(SND_UCM_END_OF_LIST)); index++) {
+        if (!strncmp(card_ctxt->verb_list[index], value, (strlen(value)+1)))
+            break;
+    }
+    if (!strncmp(card_ctxt->verb_list[index], SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
+        LOGE("Invalid verb identifier value to stage: %s", value);
+        return -EINVAL;
+    }
+    if (!mixer) {
+        LOGE("Control device not initialized");
+        return -ENODEV;
+    }
+    /* Loading may release card_lock, the dry run below must not */
+    if ((ret = snd_ucm_load_verb(uc_mgr, index)) < 0) {
+        LOGE("Failed to load use case verb: %s", value);
+        return ret;
+    }
+    if (stage->slot == NULL) {
+        stage->slot = (int *)calloc(mixer->count, sizeof(int));
+        if (stage->slot == NULL) {
+            LOGE("Failed to allocate memory for staged transition");
+            return -ENOMEM;
+        }
+    }
+    snd_ucm_stage_clear(card_ctxt);
+
+    strlcpy(verb, card_ctxt->current_verb, sizeof(verb));
+    verb_index = card_ctxt->current_verb_index;
+    dev_set = card_ctxt->dev_set;
+    mod_set = card_ctxt->mod_set;
+    memcpy(cal_audio, card_ctxt->cal_audio, sizeof(cal_audio));
+    rx_id = uc_mgr->current_rx_device;
+    tx_id = uc_mgr->current_tx_device;
+    active = plan->active;
+    hold = plan->hold;
+    base = active ? plan->count : 0;
+    if (!active)
+        snd_ucm_plan_begin(card_ctxt);
+    if (!plan->active)
+        return -ENOMEM;
+    plan->hold = 1;
+    stage->dry = 1;
+    if (snd_ucm_set_locked(uc_mgr, "_verb", value) < 0)
+        LOGV("Staged verb %s does not apply cleanly to the current routing", value);
+    stage->dry = 0;
+    staged = card_ctxt->current_verb_index;
+    strlcpy(card_ctxt->current_verb, verb, MAX_STR_LEN);
+    card_ctxt->current_verb_index = verb_index;
+    card_ctxt->dev_set = dev_set;
+    card_ctxt->mod_set = mod_set;
+    memcpy(card_ctxt->cal_audio, cal_audio, sizeof(cal_audio));
+    uc_mgr->current_rx_device = rx_id;
+    uc_mgr->current_tx_device = tx_id;
+
+    /* Read every control once, at most as many values as planned writes */
+    ret = 0;
+    for (index = base; index < plan->count; index++) {
+        ctl = plan->writes[index]->ctl;
+        if (stage->slot[ctl - mixer->ctl])
+            continue;
+        if (stage->used + (int)ctl->info->count > stage->size) {
+            size = stage->size ? stage->size * 2 : 1024;
+            while (size < stage->used + (int)ctl->info->count)
+                size *= 2;
+            values = (long long *)realloc(stage->values, size * sizeof(long long));
+            if (values == NULL) {
+                LOGE("Failed to allocate memory for staged transition");
+                ret = -ENOMEM;
+                break;
+            }
+            stage->values = values;
+            stage->size = size;
+        }
+        if (mixer_ctl_read_values(ctl, &stage->values[stage->used]) < 0)
+            continue;
+        stage->slot[ctl - mixer->ctl] = stage->used + 1;
+        stage->used += ctl->info->count;
+    }
+    LOGD("Staged verb %s: %d control writes, %d controls read", value,
+         plan->count - base, stage->used);
+    plan->count = base;
+    plan->active = active;
+    plan->hold = hold;
+    if (ret < 0) {
+        snd_ucm_stage_clear(card_ctxt);
+        return ret;
+    }
+    stage->verb_index = staged;
+
+    if (stage->rx_id >= 0)
+        LOGD("Voice acdb staged: rx id %d tx id %d", stage->rx_id, stage->tx_id);
+    return 0;
+}
+
+/* Apply the mixer controls of a section of the current verb
+ * uc_mgr - UCM structure pointer
+ * use_case_index - index of the section
+ * return 0 on sucess, otherwise a negative error code
+ */
+static int snd_ucm_apply_section(snd_use_case_mgr_t *uc_mgr, int use_case_index, int enable)
+{
+    mixer_control_t *mixer_list;
+    card_mctrl_t *section;
+    int i, ret = 0, index = 0, mixer_count;
+
+    section = &uc_mgr->card_ctxt_ptr->use_case_verb_list[uc_mgr->card_ctxt_ptr->current_verb_index].card_ctrl[use_case_index];
+    if (!uc_mgr->card_ctxt_ptr->mixer_handle) {
+        LOGE("Control device not initialized");
+        ret = -ENODEV;
+    } else {
+        LOGD("Set mixer controls for %s enable %d", section->case_name, enable);
+        if (section->acdb_id && section->capability) {
+            /*TODO: Check for voice call use case or modifier and set voice calibration*/
             if (enable) {
-                mixer_list = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].ena_mixer_list;
-                mixer_count = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].ena_mixer_count;
+                if (snd_use_case_apply_voice_acdb(uc_mgr, use_case_index)) {
+                    LOGD("acdb_id %d cap %d enable %d", section->acdb_id,
+                        section->capability, enable);
+                    snd_ucm_send_audio_cal(uc_mgr->card_ctxt_ptr, section->acdb_id,
+                        section->capability);
+                }
             } else {
-                mixer_list = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].dis_mixer_list;
-                mixer_count = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].dis_mixer_count;
+                snd_ucm_drop_audio_cal(uc_mgr->card_ctxt_ptr, section->acdb_id,
+                    section->capability);
             }
-            for(index = 0; index < mixer_count; index++) {
-                if (mixer_list == NULL) {
-                    LOGE("No valid controls available for this case: %s", use_case);
-                    break;
+        }
+        if (enable) {
+            mixer_list = section->ena_mixer_list;
+            mixer_count = section->ena_mixer_count;
+        } else {
+            mixer_list = section->dis_mixer_list;
+            mixer_count = section->dis_mixer_count;
+        }
+        for(index = 0; index < mixer_count; index++) {
+            if (mixer_list == NULL) {
+                LOGE("No valid controls available for this case: %s", section->case_name);
+                break;
+            }
+            if (mixer_list[index].ctl) {
+                if (mixer_list[index].type == TYPE_INT) {
+                    LOGD("Setting mixer control: %s, value: %d",
+                         mixer_list[index].control_name, mixer_list[index].value);
+                } else if (mixer_list[index].type == TYPE_MULTI_VAL) {
+                    LOGD("Setting multi value: %s", mixer_list[index].control_name);
+                } else {
+                    LOGD("Setting mixer control: %s, value: %s",
+                        mixer_list[index].control_name, mixer_list[index].string);
                 }
-                ctl = mixer_get_control(uc_mgr->card_ctxt_ptr->mixer_handle,
-                          mixer_list[index].control_name, 0);
-                if (ctl) {
-                    if (mixer_list[index].type == TYPE_INT) {
-                        LOGD("Setting mixer control: %s, value: %d",
-                             mixer_list[index].control_name, mixer_list[index].value);
-                        ret = mixer_ctl_set(ctl, mixer_list[index].value);
-                    } else if (mixer_list[index].type == TYPE_MULTI_VAL) {
-                        LOGD("Setting multi value: %s", mixer_list[index].control_name);
-                        ret = mixer_ctl_set_value(ctl, mixer_list[index].value, mixer_list[index].mulval);
-                        if (ret < 0)
-                            LOGE("Failed to set multi value control %s\n", mixer_list[index].control_name);
-                    } else {
-                        LOGD("Setting mixer control: %s, value: %s",
-                            mixer_list[index].control_name, mixer_list[index].string);
-                        ret = mixer_ctl_select(ctl, mixer_list[index].string);
-                    }
-                    if ((ret != 0) && enable) {
-                       /* Disable all the mixer controls which are already enabled before failure */
-                       mixer_list = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].dis_mixer_list;
-                       mixer_count = uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[use_case_index].dis_mixer_count;
-                       for(i = 0; i < mixer_count; i++) {
-                           ctl = mixer_get_control(uc_mgr->card_ctxt_ptr->mixer_handle,
-                                mixer_list[i].control_name, 0);
-                           if (ctl) {
-                               if (mixer_list[i].type == TYPE_INT) {
-                                   ret = mixer_ctl_set(ctl, mixer_list[i].value);
-                               } else {
-                                   ret = mixer_ctl_select(ctl, mixer_list[i].string);
-                               }
-                           }
+                if (mixer_list[index].values)
+                    ret = snd_ucm_write_control(uc_mgr->card_ctxt_ptr, &mixer_list[index]);
+                else
+                    ret = -EINVAL;
+                if (ret < 0)
+                    LOGE("Failed to set mixer control %s", mixer_list[index].control_name);
+                if ((ret != 0) && enable) {
+                   /* Disable all the mixer controls which are already enabled before failure */
+                   mixer_list = section->dis_mixer_list;
+                   mixer_count = section->dis_mixer_count;
+                   for(i = 0; i < mixer_count; i++) {
+                       if (mixer_list[i].ctl && mixer_list[i].values) {
+                           snd_ucm_write_control(uc_mgr->card_ctxt_ptr, &mixer_list[i]);
+                           if (uc_mgr->card_ctxt_ptr->stats.cur)
+                               uc_mgr->card_ctxt_ptr->stats.cur->rolled_back++;
                        }
-                       LOGE("Failed to enable the mixer controls for %s", use_case);
-                       break;
-                    }
+                   }
+                   LOGE("Failed to enable the mixer controls for %s", section->case_name);
+                   break;
                 }
             }
         }
@@ -634,6 +1829,29 @@ int snd_use_case_apply_mixer_controls(snd_use_case_mgr_t *uc_mgr,
     return ret;
 }
 
+/* Apply the required mixer controls for specific use case
+ * uc_mgr - UCM structure pointer
+ * use_case - use case name
+ * return 0 on sucess, otherwise a negative error code
+ */
+int snd_use_case_apply_mixer_controls(snd_use_case_mgr_t *uc_mgr,
+                const char *use_case, int enable)
+{
+    int verb_index, use_case_index;
+
+    verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
+    if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
+       (uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl == NULL)) {
+        LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
+        return -EINVAL;
+    }
+    if ((use_case_index = get_use_case_index(uc_mgr, use_case)) < 0) {
+        LOGE("No valid use case found with the use case: %s", use_case);
+        return -ENODEV;
+    }
+    return snd_ucm_apply_section(uc_mgr, use_case_index, enable);
+}
+
 /* Set/Reset mixer controls of specific use case for all current devices
  * uc_mgr - UCM structure pointer
  * ident  - use case name (verb or modifier)
@@ -643,32 +1861,28 @@ int snd_use_case_apply_mixer_controls(snd_use_case_mgr_t *uc_mgr,
 static int snd_use_case_ident_set_controls_for_all_devices(snd_use_case_mgr_t *uc_mgr,
     const char *ident, int enable)
 {
-    char *current_device, use_case[MAX_UC_LEN];
-    int list_size, index, ret = 0;
+    const char *current_device;
+    int list_size, index, use_case_index, ret = 0;
 
     LOGV("set_use_case_ident_for_all_devices(): %s", ident);
     if (snd_use_case_apply_mixer_controls(uc_mgr, ident, enable) < 0) {
         LOGV("use case %s not valid without device combination", ident);
     }
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+    list_size = uc_mgr->card_ctxt_ptr->dev_set.count;
     for (index = 0; index < list_size; index++) {
-        current_device = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
+        current_device = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, index);
         if (current_device != NULL) {
-            strlcpy(use_case, ident, sizeof(use_case));
-            strlcat(use_case, current_device, sizeof(use_case));
-            LOGV("Applying mixer controls for use case: %s", use_case);
-            if ((get_use_case_index(uc_mgr, use_case)) < 0) {
-                LOGV("No valid use case found: %s", use_case);
+            LOGV("Applying mixer controls for use case: %s%s", ident, current_device);
+            if ((use_case_index = snd_ucm_get_case_index(uc_mgr, ident, current_device)) < 0) {
+                LOGV("No valid use case found: %s%s", ident, current_device);
             } else {
                 if (enable) {
                     ret = snd_use_case_apply_mixer_controls(uc_mgr, current_device, enable);
                     if (!ret)
-                        snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, current_device, enable);
+                        snd_ucm_set_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, current_device, enable);
                 }
-                ret = snd_use_case_apply_mixer_controls(uc_mgr, use_case, enable);
+                ret = snd_ucm_apply_section(uc_mgr, use_case_index, enable);
             }
-            use_case[0] = 0;
-            free(current_device);
         }
     }
     return ret;
@@ -683,64 +1897,60 @@ static int snd_use_case_ident_set_controls_for_all_devices(snd_use_case_mgr_t *u
 static int snd_use_case_set_device_for_all_ident(snd_use_case_mgr_t *uc_mgr,
     const char *device, int enable)
 {
-    char *ident_value, use_case[MAX_UC_LEN];
-    int list_size, index = 0, ret = -ENODEV, flag = 0;
+    const char *ident_value;
+    int list_size, index = 0, use_case_index, ret = -ENODEV, flag = 0;
 
     LOGV("set_device_for_all_ident(): %s", device);
     if (strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
-        strlcpy(use_case, uc_mgr->card_ctxt_ptr->current_verb, sizeof(use_case));
-        strlcat(use_case, device, sizeof(use_case));
-        if ((get_use_case_index(uc_mgr, use_case)) < 0) {
-            LOGV("No valid use case found: %s", use_case);
+        if ((use_case_index = snd_ucm_get_case_index(uc_mgr,
+                uc_mgr->card_ctxt_ptr->current_verb, device)) < 0) {
+            LOGV("No valid use case found: %s%s", uc_mgr->card_ctxt_ptr->current_verb, device);
         } else {
             if (enable) {
                 ret = snd_use_case_apply_mixer_controls(uc_mgr, device, enable);
                 if (!ret)
-                    snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, device, enable);
+                    snd_ucm_set_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, device, enable);
                 flag = 1;
             }
-            LOGV("set %d for use case value: %s", enable, use_case);
-            ret = snd_use_case_apply_mixer_controls(uc_mgr, use_case, enable);
+            LOGV("set %d for use case value: %s%s", enable, uc_mgr->card_ctxt_ptr->current_verb, device);
+            ret = snd_ucm_apply_section(uc_mgr, use_case_index, enable);
             if (ret != 0) {
-                LOGE("No valid controls exists for usecase %s and device %s, enable: %d", use_case, device, enable);
+                LOGE("No valid controls exists for usecase %s%s and device %s, enable: %d",
+                     uc_mgr->card_ctxt_ptr->current_verb, device, device, enable);
                 if (snd_use_case_apply_mixer_controls(uc_mgr, uc_mgr->card_ctxt_ptr->current_verb, enable) < 0) {
                     LOGV("use case %s not valid without device combination also", uc_mgr->card_ctxt_ptr->current_verb);
                 }
             }
         }
-        use_case[0] = 0;
     }
-    snd_ucm_print_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+    snd_ucm_print_set(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set);
+    list_size = uc_mgr->card_ctxt_ptr->mod_set.count;
     for (index = 0; index < list_size; index++) {
-        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
-        strlcpy(use_case, ident_value, sizeof(use_case));
-        strlcat(use_case, device, sizeof(use_case));
-        if ((get_use_case_index(uc_mgr, use_case)) < 0) {
-            LOGV("No valid use case found: %s", use_case);
+        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, index);
+        if ((use_case_index = snd_ucm_get_case_index(uc_mgr, ident_value, device)) < 0) {
+            LOGV("No valid use case found: %s%s", ident_value, device);
         } else {
             if (enable && !flag) {
                 snd_use_case_apply_mixer_controls(uc_mgr, device, enable);
                 if (!ret)
-                    snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, device, enable);
+                    snd_ucm_set_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, device, enable);
                 flag = 1;
             }
-            LOGV("set %d for use case value: %s", enable, use_case);
-            ret = snd_use_case_apply_mixer_controls(uc_mgr, use_case, enable);
+            LOGV("set %d for use case value: %s%s", enable, ident_value, device);
+            ret = snd_ucm_apply_section(uc_mgr, use_case_index, enable);
             if (ret != 0) {
-                LOGE("No valid controls exists for usecase %s and device %s, enable: %d", use_case, device, enable);
+                LOGE("No valid controls exists for usecase %s%s and device %s, enable: %d",
+                     ident_value, device, device, enable);
                 if (snd_use_case_apply_mixer_controls(uc_mgr, ident_value, enable) < 0) {
                     LOGV("use case %s not valid without device combination also", ident_value);
                 }
             }
         }
-        use_case[0] = 0;
-        free(ident_value);
     }
     if (!enable) {
         ret = snd_use_case_apply_mixer_controls(uc_mgr, device, enable);
         if (!ret)
-            snd_ucm_set_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, device, enable);
+            snd_ucm_set_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, device, enable);
     }
     return ret;
 }
@@ -752,8 +1962,9 @@ static int snd_use_case_set_device_for_all_ident(snd_use_case_mgr_t *uc_mgr,
  */
 static int snd_use_case_check_device_for_disable(snd_use_case_mgr_t *uc_mgr, const char *device)
 {
-    char *ident_value, use_case[MAX_UC_LEN];
-    int list_size, verb_index, index = 0, case_index = 0, ret = 0;
+    const char *ident_value;
+    use_case_verb_t *verb;
+    int list_size, verb_index, index = 0, ret = 0;
 
     verb_index = uc_mgr->card_ctxt_ptr->current_verb_index;
     if((verb_index < 0) || (!strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_UCM_END_OF_LIST, 3)) ||
@@ -761,80 +1972,109 @@ static int snd_use_case_check_device_for_disable(snd_use_case_mgr_t *uc_mgr, con
         LOGE("Invalid current verb value: %s - %d", uc_mgr->card_ctxt_ptr->current_verb, verb_index);
         return -EINVAL;
     }
+    verb = &uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index];
     if (strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
-        strlcpy(use_case, uc_mgr->card_ctxt_ptr->current_verb, sizeof(use_case));
-        strlcat(use_case, device, sizeof(use_case));
-        while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name,
-                     SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-            if (!strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[index].case_name, use_case, (strlen(use_case)+1))) {
+        if (snd_ucm_find_section(verb, uc_mgr->card_ctxt_ptr->current_verb, device) >= 0)
+            ret = 1;
+    }
+    if (ret == 0) {
+        list_size = uc_mgr->card_ctxt_ptr->mod_set.count;
+        for (index = 0; index < list_size; index++) {
+            ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, index);
+            if (snd_ucm_find_section(verb, ident_value, device) >= 0)
                 ret = 1;
+            if (ret == 1) {
                 break;
             }
-            index++;
         }
-        use_case[0] = 0;
-    }
-    if (ret == 0) {
-        index = 0;
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
-        for (index = 0; index < list_size; index++) {
-            ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
-            strlcpy(use_case, ident_value, sizeof(use_case));
-            strlcat(use_case, device, sizeof(use_case));
-            free(ident_value);
-            case_index = 0;
-            while(strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].case_name,
-                         SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST))) {
-                if (!strncmp(uc_mgr->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].case_name, use_case, (strlen(use_case)+1))) {
-                    ret = 1;
-                    break;
-                }
-                case_index++;
-            }
-            use_case[0] = 0;
-            if (ret == 1) {
-                break;
-            }
+    }
+    return ret;
+}
+
+/* Add a device to the enabled list and enable its mixer controls
+ * uc_mgr - UCM structure pointer
+ * device - device name
+ * return 0 on sucess, otherwise a negative error code
+ */
+static int snd_use_case_enable_device(snd_use_case_mgr_t *uc_mgr, const char *device)
+{
+    if (snd_ucm_get_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, device) >= 0) {
+        LOGV("Ignoring %s device enable, it is already part of enabled list", device);
+    } else {
+        LOGV("enadev: device value to be enabled: %s", device);
+        snd_ucm_add_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, device);
+        snd_ucm_print_set(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set);
+    }
+    /* Apply Mixer controls of all verb and modifiers for this device*/
+    return snd_use_case_set_device_for_all_ident(uc_mgr, device, 1);
+}
+
+/* Disable or enable again all of the current routing, used to move the
+ * routing over to reloaded tables. Modifiers, the verb and then devices
+ * are disabled, enabling goes the other way round.
+ * uc_mgr - UCM structure pointer
+ * enable - 1 for enable and 0 for disable
+ */
+static void snd_ucm_apply_routing(snd_use_case_mgr_t *uc_mgr, int enable)
+{
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    const char *ident_value;
+    int index;
+
+    if (enable) {
+        snd_use_case_ident_set_controls_for_all_devices(uc_mgr, card_ctxt->current_verb, 1);
+        for (index = 0; index < card_ctxt->dev_set.count; index++) {
+            ident_value = snd_ucm_get_value_at_index(card_ctxt, &card_ctxt->dev_set, index);
+            snd_use_case_set_device_for_all_ident(uc_mgr, ident_value, 1);
+        }
+        for (index = 0; index < card_ctxt->mod_set.count; index++) {
+            ident_value = snd_ucm_get_value_at_index(card_ctxt, &card_ctxt->mod_set, index);
+            snd_use_case_ident_set_controls_for_all_devices(uc_mgr, ident_value, 1);
+        }
+    } else {
+        for (index = card_ctxt->mod_set.count - 1; index >= 0; index--) {
+            ident_value = snd_ucm_get_value_at_index(card_ctxt, &card_ctxt->mod_set, index);
+            snd_use_case_ident_set_controls_for_all_devices(uc_mgr, ident_value, 0);
+        }
+        snd_use_case_ident_set_controls_for_all_devices(uc_mgr, card_ctxt->current_verb, 0);
+        for (index = card_ctxt->dev_set.count - 1; index >= 0; index--) {
+            ident_value = snd_ucm_get_value_at_index(card_ctxt, &card_ctxt->dev_set, index);
+            snd_use_case_set_device_for_all_ident(uc_mgr, ident_value, 0);
         }
     }
-    return ret;
 }
 
-/**
- * Set new value for an identifier
+/* Set new value for an identifier, called with card_lock held
  * uc_mgr - UCM structure
- * identifier - _verb, _enadev, _disdev, _enamod, _dismod
- *        _swdev, _swmod
+ * identifier - as for snd_use_case_set
  * value - Value to be set
- * returns 0 on success, otherwise a negative error code
+ * Returns 0 on sucess, negative error code otherwise
  */
-int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
-                     const char *identifier,
-                     const char *value)
+static int snd_ucm_set_locked(snd_use_case_mgr_t *uc_mgr,
+                              const char *identifier,
+                              const char *value)
 {
     char ident[MAX_STR_LEN], *ident1, *ident2, *temp_ptr;
-    int verb_index, list_size, index = 0, ret = -EINVAL;
-
-    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
-    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) || (value == NULL) ||
-        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
-        (identifier == NULL)) {
-        LOGE("snd_use_case_set(): failed, invalid arguments");
-        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-        return -EINVAL;
-    }
+    int verb_index, index = 0, ret = -EINVAL, err;
 
     LOGD("snd_use_case_set(): uc_mgr %p identifier %s value %s", uc_mgr, identifier, value);
+    /* Staged values are only trusted up to the verb change they prepare */
+    if (uc_mgr->card_ctxt_ptr->stage.used && !uc_mgr->card_ctxt_ptr->stage.dry &&
+        strncmp(identifier, "_verb", 5) && strncmp(identifier, "_stageverb", 10))
+        snd_ucm_stage_clear(uc_mgr->card_ctxt_ptr);
     strlcpy(ident, identifier, sizeof(ident));
     if(!(ident1 = strtok_r(ident, "/", &temp_ptr))) {
         LOGV("No multiple identifiers found in identifier value");
         ident[0] = 0;
     } else {
         if (!strncmp(ident1, "_swdev", 6)) {
+            /* Disable the old device and enable the new one as a single
+             * transition, controls shared by both paths are not touched */
+            snd_ucm_plan_begin(uc_mgr->card_ctxt_ptr);
             if(!(ident2 = strtok_r(NULL, "/", &temp_ptr))) {
                 LOGD("Invalid disable device value: %s, but enabling new device", ident2);
             } else {
-                ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head, ident2);
+                ret = snd_ucm_del_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, ident2);
                 if (ret < 0) {
                     LOGV("Ignore device %s disable, device not part of enabled list", ident2);
                 } else {
@@ -846,23 +2086,26 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
                     }
                 }
             }
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
-            ret = snd_use_case_set(uc_mgr, "_enadev", value);
+            ret = snd_use_case_enable_device(uc_mgr, value);
             if (ret < 0) {
                 LOGV("Device %s not enabled, no valid use case found: %d", value, errno);
             }
+            err = snd_ucm_plan_commit(uc_mgr->card_ctxt_ptr);
+            if (err < 0) {
+                LOGE("Failed to switch to device %s", value);
+                ret = err;
+            }
             return ret;
         } else if (!strncmp(ident1, "_swmod", 6)) {
-            pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
             if(!(ident2 = strtok_r(NULL, "/", &temp_ptr))) {
                 LOGD("Invalid modifier value: %s, but enabling new modifier", ident2);
             } else {
-                ret = snd_use_case_set(uc_mgr, "_dismod", ident2);
+                ret = snd_ucm_set_locked(uc_mgr, "_dismod", ident2);
                 if (ret < 0) {
                     LOGV("Modifier %s not disabled, no valid use case found: %d", ident2, errno);
                 }
             }
-            ret = snd_use_case_set(uc_mgr, "_enamod", value);
+            ret = snd_ucm_set_locked(uc_mgr, "_enamod", value);
             if (ret < 0) {
                 LOGV("Modifier %s not enabled, no valid use case found: %d", value, errno);
             }
@@ -884,8 +2127,15 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
         }
         if ((ret < 0) && (strncmp(value, SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE)))) {
             LOGE("Invalid verb identifier value");
+        } else if ((ret == 0) && ((ret = snd_ucm_load_verb(uc_mgr, index)) < 0)) {
+            LOGE("Failed to load use case verb: %s", value);
         } else {
             LOGV("Index:%d Verb:%s", index, uc_mgr->card_ctxt_ptr->verb_list[index]);
+            if (uc_mgr->card_ctxt_ptr->stage.used && !uc_mgr->card_ctxt_ptr->stage.dry &&
+                (uc_mgr->card_ctxt_ptr->stage.verb_index != index))
+                snd_ucm_stage_clear(uc_mgr->card_ctxt_ptr);
+            /* The old and new verb are applied as a single transition */
+            snd_ucm_plan_begin(uc_mgr->card_ctxt_ptr);
             /* Disable the mixer controls for current use case
              * for all the enabled devices */
             if (strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
@@ -900,34 +2150,27 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
                uc_mgr->card_ctxt_ptr->current_verb_index = index;
                ret = snd_use_case_ident_set_controls_for_all_devices(uc_mgr, uc_mgr->card_ctxt_ptr->current_verb, 1);
             }
-        }
-    } else if (!strncmp(identifier, "_enadev", 7)) {
-        index = 0; ret = 0;
-        list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
-        for (index = 0; index < list_size; index++) {
-            ident1 = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
-            if (!strncmp(ident1, value, (strlen(value)+1))) {
-                LOGV("Ignoring %s device enable, it is already part of enabled list", value);
-                free(ident1);
-                break;
+            /* The staged transition is used up by this commit */
+            if (!uc_mgr->card_ctxt_ptr->stage.dry)
+                uc_mgr->card_ctxt_ptr->stage.verb_index = -1;
+            err = snd_ucm_plan_commit(uc_mgr->card_ctxt_ptr);
+            if (err < 0) {
+                LOGE("Failed to apply controls for use case: %s", uc_mgr->card_ctxt_ptr->current_verb);
+                ret = err;
             }
-            free(ident1);
-        }
-        if (index == list_size) {
-            LOGV("enadev: device value to be enabled: %s", value);
-            snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->dev_list_head, value);
-            snd_ucm_print_list(uc_mgr->card_ctxt_ptr->dev_list_head);
         }
-        /* Apply Mixer controls of all verb and modifiers for this device*/
-        ret = snd_use_case_set_device_for_all_ident(uc_mgr, value, 1);
+    } else if (!strncmp(identifier, "_stageverb", 10)) {
+        ret = snd_ucm_stage_verb(uc_mgr, value);
+    } else if (!strncmp(identifier, "_enadev", 7)) {
+        ret = snd_use_case_enable_device(uc_mgr, value);
     } else if (!strncmp(identifier, "_disdev", 7)) {
-        ret = snd_ucm_get_status_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, value);
+        ret = snd_ucm_get_status(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, value);
         if ((ret < 0) || (ret == 0)) {
             LOGD("disdev: device %s not enabled or not active, no need to disable", value);
         } else {
             ret = snd_use_case_check_device_for_disable(uc_mgr, value);
             if (ret == 0) {
-                ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head, value);
+                ret = snd_ucm_del_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, value);
                 if (ret < 0) {
                     LOGE("Invalid device: Device not part of enabled device list");
                 } else {
@@ -957,14 +2200,14 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
             if (ret < 0) {
                 LOGE("Invalid modifier identifier value");
             } else {
-                snd_ucm_add_ident_to_list(&uc_mgr->card_ctxt_ptr->mod_list_head, value);
+                snd_ucm_add_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, value);
                 /* Enable the mixer controls for the new use case
                  * for all the enabled devices */
                 ret = snd_use_case_ident_set_controls_for_all_devices(uc_mgr, value, 1);
             }
         }
     } else if (!strncmp(identifier, "_dismod", 7)) {
-        ret = snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_list_head, value);
+        ret = snd_ucm_del_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, value);
         if (ret < 0) {
             LOGE("Modifier not enabled currently, invalid modifier");
         } else {
@@ -973,13 +2216,350 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
              * for all the enabled devices */
             ret = snd_use_case_ident_set_controls_for_all_devices(uc_mgr, value, 0);
         }
+    } else if (!strncmp(identifier, "_acdbforce", 10)) {
+        /* Send calibration on every enable while set, clearing it sends
+         * everything once more as the cache may be stale */
+        uc_mgr->card_ctxt_ptr->cal_force = atoi(value) ? 1 : 0;
+        memset(uc_mgr->card_ctxt_ptr->cal_audio, 0, sizeof(uc_mgr->card_ctxt_ptr->cal_audio));
+        uc_mgr->current_rx_device = -1;
+        uc_mgr->current_tx_device = -1;
+        ret = 0;
     } else {
         LOGE("Unknown identifier value: %s", identifier);
     }
+    return ret;
+}
+
+/**
+ * Set new value for an identifier
+ * uc_mgr - UCM structure
+ * identifier - _verb, _enadev, _disdev, _enamod, _dismod
+ *        _swdev, _swmod, _stageverb
+ * value - Value to be set
+ * returns 0 on success, otherwise a negative error code
+ */
+int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
+                     const char *identifier,
+                     const char *value)
+{
+    int ret;
+
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) || (value == NULL) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (identifier == NULL)) {
+        LOGE("snd_use_case_set(): failed, invalid arguments");
+        pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+        return -EINVAL;
+    }
+
+    snd_ucm_stats_begin(uc_mgr->card_ctxt_ptr, identifier, value);
+    ret = snd_ucm_set_locked(uc_mgr, identifier, value);
+    snd_ucm_stats_end(uc_mgr->card_ctxt_ptr, 1, ret);
+    snd_ucm_publish_state(uc_mgr->card_ctxt_ptr);
     pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
     return ret;
 }
 
+/* Apply a batch of queued requests as one transition. Every request is
+ * applied in order so the routing ends up as with snd_use_case_set, but
+ * the control writes are only committed after the last one: a control
+ * changed back and forth within the batch is written once with its final
+ * value, or not at all if that is its current value.
+ * card_ctxt - card context
+ * batch - requests taken from the queue
+ */
+static void snd_ucm_async_apply(card_ctxt_t *card_ctxt, ucm_async_req_t *batch)
+{
+    ucm_async_req_t *req;
+    int count = 0, ret;
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    snd_ucm_stats_begin(card_ctxt, batch->identifier, batch->value);
+    snd_ucm_plan_begin(card_ctxt);
+    card_ctxt->plan.hold = 1;
+    card_ctxt->cal_defer = 1;
+    for (req = batch; req != NULL; req = req->next) {
+        req->result = snd_ucm_set_locked(req->uc_mgr, req->identifier, req->value);
+        count++;
+    }
+    snd_ucm_cal_flush(card_ctxt);
+    card_ctxt->plan.hold = 0;
+    ret = snd_ucm_plan_commit(card_ctxt);
+    if (ret < 0) {
+        LOGE("Failed to apply controls of queued routing requests");
+        /* None of the controls of the batch were applied */
+        for (req = batch; req != NULL; req = req->next)
+            req->result = ret;
+    }
+    LOGD("Applied %d queued routing requests", count);
+    snd_ucm_stats_end(card_ctxt, count, ret);
+    snd_ucm_publish_state(card_ctxt);
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+}
+
+/* Worker applying the queued requests, all the requests queued while a
+ * batch is applied make up the next batch */
+static void *snd_ucm_async_thread(void *arg)
+{
+    card_ctxt_t *card_ctxt = (card_ctxt_t *)arg;
+    ucm_async_req_t *batch, *req;
+    uint64_t done;
+
+    pthread_mutex_lock(&card_ctxt->async_lock);
+    while (1) {
+        while ((card_ctxt->async_head == NULL) && !card_ctxt->async_stop)
+            pthread_cond_wait(&card_ctxt->async_cond, &card_ctxt->async_lock);
+        if (card_ctxt->async_head == NULL)
+            break;
+        batch = card_ctxt->async_head;
+        card_ctxt->async_head = card_ctxt->async_tail = NULL;
+        card_ctxt->async_busy = 1;
+        pthread_mutex_unlock(&card_ctxt->async_lock);
+
+        snd_ucm_async_apply(card_ctxt, batch);
+        while ((req = batch) != NULL) {
+            batch = req->next;
+            if (req->cb)
+                req->cb(req->uc_mgr, req->identifier, req->value, req->result);
+            free(req);
+            done = 1;
+            pthread_mutex_lock(&card_ctxt->async_lock);
+            if ((card_ctxt->async_fd >= 0) &&
+                (write(card_ctxt->async_fd, &done, sizeof(done)) < 0))
+                LOGE("Failed to signal request completion: %d", errno);
+            pthread_mutex_unlock(&card_ctxt->async_lock);
+        }
+
+        pthread_mutex_lock(&card_ctxt->async_lock);
+        card_ctxt->async_busy = 0;
+        pthread_cond_broadcast(&card_ctxt->async_cond);
+    }
+    pthread_mutex_unlock(&card_ctxt->async_lock);
+    return NULL;
+}
+
+/* Stop the worker once the queued requests are applied
+ * card_ctxt - card context
+ */
+static void snd_ucm_async_stop(card_ctxt_t *card_ctxt)
+{
+    pthread_mutex_lock(&card_ctxt->async_lock);
+    card_ctxt->async_stop = 1;
+    pthread_cond_broadcast(&card_ctxt->async_cond);
+    pthread_mutex_unlock(&card_ctxt->async_lock);
+    if (card_ctxt->async_started) {
+        pthread_join(card_ctxt->async_thr, NULL);
+        card_ctxt->async_started = 0;
+    }
+}
+
+/**
+ * Queue a new value for an identifier
+ * uc_mgr - UCM structure
+ * identifier - as for snd_use_case_set
+ * value - Value to be set
+ * cb - completion callback, may be NULL
+ * returns 0 if queued, otherwise a negative error code
+ */
+int snd_use_case_set_async(snd_use_case_mgr_t *uc_mgr,
+                           const char *identifier,
+                           const char *value,
+                           snd_use_case_cb_t cb)
+{
+    card_ctxt_t *card_ctxt;
+    ucm_async_req_t *req;
+    int ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) || (value == NULL) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL) ||
+        (identifier == NULL) || (strlen(identifier) >= sizeof(req->identifier)) ||
+        (strlen(value) >= sizeof(req->value))) {
+        LOGE("snd_use_case_set_async(): failed, invalid arguments");
+        return -EINVAL;
+    }
+    card_ctxt = uc_mgr->card_ctxt_ptr;
+
+    req = (ucm_async_req_t *)calloc(1, sizeof(ucm_async_req_t));
+    if (req == NULL) {
+        LOGE("Failed to allocate memory for routing request");
+        return -ENOMEM;
+    }
+    req->uc_mgr = uc_mgr;
+    strlcpy(req->identifier, identifier, sizeof(req->identifier));
+    strlcpy(req->value, value, sizeof(req->value));
+    req->cb = cb;
+
+    pthread_mutex_lock(&card_ctxt->async_lock);
+    if (card_ctxt->async_stop) {
+        pthread_mutex_unlock(&card_ctxt->async_lock);
+        free(req);
+        return -EINVAL;
+    }
+    if (!card_ctxt->async_started) {
+        ret = pthread_create(&card_ctxt->async_thr, NULL, snd_ucm_async_thread, card_ctxt);
+        if (ret) {
+            LOGE("Failed to create routing request thread: %d", ret);
+            pthread_mutex_unlock(&card_ctxt->async_lock);
+            free(req);
+            return -ret;
+        }
+        card_ctxt->async_started = 1;
+    }
+    if (card_ctxt->async_tail != NULL)
+        card_ctxt->async_tail->next = req;
+    else
+        card_ctxt->async_head = req;
+    card_ctxt->async_tail = req;
+    pthread_cond_broadcast(&card_ctxt->async_cond);
+    pthread_mutex_unlock(&card_ctxt->async_lock);
+    return 0;
+}
+
+/**
+ * Get the eventfd signalled by completed asynchronous requests
+ * uc_mgr - UCM structure
+ * returns eventfd if success, otherwise a negative error code
+ */
+int snd_use_case_async_fd(snd_use_case_mgr_t *uc_mgr)
+{
+    card_ctxt_t *card_ctxt;
+    int fd;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        LOGE("snd_use_case_async_fd(): failed, invalid arguments");
+        return -EINVAL;
+    }
+    card_ctxt = uc_mgr->card_ctxt_ptr;
+
+    pthread_mutex_lock(&card_ctxt->async_lock);
+    if (card_ctxt->async_fd < 0) {
+        card_ctxt->async_fd = eventfd(0, 0);
+        if (card_ctxt->async_fd < 0)
+            LOGE("Failed to create eventfd: %d", errno);
+    }
+    fd = (card_ctxt->async_fd < 0) ? -errno : card_ctxt->async_fd;
+    pthread_mutex_unlock(&card_ctxt->async_lock);
+    return fd;
+}
+
+/**
+ * Wait until the queued requests are applied
+ * uc_mgr - UCM structure
+ * returns 0 on success, otherwise a negative error code
+ */
+int snd_use_case_async_wait(snd_use_case_mgr_t *uc_mgr)
+{
+    card_ctxt_t *card_ctxt;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        LOGE("snd_use_case_async_wait(): failed, invalid arguments");
+        return -EINVAL;
+    }
+    card_ctxt = uc_mgr->card_ctxt_ptr;
+
+    pthread_mutex_lock(&card_ctxt->async_lock);
+    while ((card_ctxt->async_head != NULL) || card_ctxt->async_busy)
+        pthread_cond_wait(&card_ctxt->async_cond, &card_ctxt->async_lock);
+    pthread_mutex_unlock(&card_ctxt->async_lock);
+    return 0;
+}
+
+/* Add a sound card to the card list if it has a use case configuration,
+ * card_list_lock must be held
+ * card_name - use case configuration name of the card
+ * card_number - number of the card
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_add_card(const char *card_name, int card_number)
+{
+    struct stat st;
+    char path[200];
+    int index;
+
+    for (index = 0; index < card_count; index++) {
+        if (!strcmp(card_found[index].card_name, card_name) &&
+            (card_found[index].card_number == card_number))
+            return 0;
+    }
+    if (card_count >= MAX_NUM_CARDS) {
+        LOGE("Card list full, %s not added", card_name);
+        return -ENOSPC;
+    }
+    snprintf(path, sizeof(path), "%s%s", ucm_config_dir, card_name);
+    if (stat(path, &st) < 0)
+        return -ENOENT;
+    strlcpy(card_found[card_count].card_name, card_name,
+            sizeof(card_found[card_count].card_name));
+    card_found[card_count].card_number = card_number;
+    card_list[card_count] = card_found[card_count].card_name;
+    LOGV("Card %d: %s", card_number, card_name);
+    card_count++;
+    return 0;
+}
+
+/* Find the sound cards by querying the control device of each card
+ * number, used when /proc/asound/cards is not available.
+ * card_list_lock must be held
+ * Returns number of cards found
+ */
+static int snd_ucm_probe_cards(void)
+{
+    struct snd_ctl_card_info info;
+    char device[32];
+    int fd, card, found = 0;
+
+    for (card = 0; card < MAX_NUM_CARDS; card++) {
+        snprintf(device, sizeof(device), "/dev/snd/controlC%d", card);
+        fd = open(device, O_RDWR);
+        if (fd < 0)
+            continue;
+        memset(&info, 0, sizeof(info));
+        if (ioctl(fd, SNDRV_CTL_IOCTL_CARD_INFO, &info) == 0) {
+            info.id[sizeof(info.id) - 1] = '\0';
+            snd_ucm_add_card((const char *)info.id, card);
+            found++;
+        }
+        close(fd);
+    }
+    return found;
+}
+
+/* Update the card list with the sound cards registered with the kernel,
+ * followed by the default card configurations
+ */
+static void snd_ucm_discover_cards(void)
+{
+    FILE *fp;
+    char line[128], id[50];
+    int card, len, index;
+
+    pthread_mutex_lock(&card_list_lock);
+    fp = fopen("/proc/asound/cards", "r");
+    if (fp != NULL) {
+        /* Card lines look like " 0 [id             ]: driver - name" */
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (sscanf(line, " %d [%49[^]]", &card, id) != 2)
+                continue;
+            len = strlen(id);
+            while ((len > 0) && isspace((unsigned char)id[len - 1]))
+                id[--len] = '\0';
+            if (len > 0)
+                snd_ucm_add_card(id, card);
+        }
+        fclose(fp);
+    } else {
+        snd_ucm_probe_cards();
+    }
+    for (index = 0; index < (int)NUM_DEFAULT_CARDS; index++) {
+        snd_ucm_add_card(card_mapping_list[index].card_name,
+                         card_mapping_list[index].card_number);
+    }
+    pthread_mutex_unlock(&card_list_lock);
+}
+
 /**
  * Open and initialise use case core for sound card
  * uc_mgr - Returned use case manager pointer
@@ -988,9 +2568,7 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
  */
 int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name)
 {
-    snd_use_case_mgr_t *uc_mgr_ptr = NULL;
     int index, ret = -EINVAL;
-    char tmp[2];
 
     LOGV("snd_use_case_open(): card_name %s", card_name);
 
@@ -999,91 +2577,394 @@ int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name)
         return ret;
     }
 
-    for (index = 0; index < (int)MAX_NUM_CARDS; index++) {
-        if(!strncmp(card_name, card_mapping_list[index].card_name, (strlen(card_mapping_list[index].card_name)+1))) {
+    snd_ucm_discover_cards();
+    pthread_mutex_lock(&card_list_lock);
+    for (index = 0; index < card_count; index++) {
+        if (!strcmp(card_name, card_found[index].card_name)) {
             ret = 0;
             break;
         }
     }
+    pthread_mutex_unlock(&card_list_lock);
 
     if (ret < 0) {
         LOGE("Card %s not found", card_name);
-    } else {
-        uc_mgr_ptr = (snd_use_case_mgr_t *)calloc(1, sizeof(snd_use_case_mgr_t));
-        if (uc_mgr_ptr == NULL) {
-            LOGE("Failed to allocate memory for instance");
-            return -ENOMEM;
+        return ret;
+    }
+    return snd_ucm_open_card(uc_mgr, index);
+}
+
+/**
+ * Open a use case manager for every discovered sound card, the first
+ * configuration found for a card is used
+ * uc_mgr - Returned use case manager pointers
+ * size - number of entries of uc_mgr
+ * returns Number of managers opened, otherwise a negative error code
+ */
+int snd_use_case_mgr_open_all(snd_use_case_mgr_t *uc_mgr[], int size)
+{
+    int numbers[MAX_NUM_CARDS];
+    int index, count, opened = 0, ret = 0;
+
+    if ((uc_mgr == NULL) || (size <= 0)) {
+        LOGE("snd_use_case_mgr_open_all: failed, invalid arguments");
+        return -EINVAL;
+    }
+
+    snd_ucm_discover_cards();
+    pthread_mutex_lock(&card_list_lock);
+    count = card_count;
+    for (index = 0; index < count; index++)
+        numbers[index] = card_found[index].card_number;
+    pthread_mutex_unlock(&card_list_lock);
+
+    for (index = 0; (index < count) && (opened < size); index++) {
+        /* Later entries for a card are alternative configurations */
+        for (ret = 0; ret < index; ret++) {
+            if (numbers[ret] == numbers[index])
+                break;
         }
-        uc_mgr_ptr->snd_card_index = index;
-        uc_mgr_ptr->card_ctxt_ptr = (card_ctxt_t *)calloc(1, sizeof(card_ctxt_t));
-        if (uc_mgr_ptr->card_ctxt_ptr == NULL) {
-            LOGE("Failed to allocate memory for card context");
-            free(uc_mgr_ptr);
-            uc_mgr_ptr = NULL;
-            return -ENOMEM;
+        if (ret < index)
+            continue;
+        ret = snd_ucm_open_card(&uc_mgr[opened], index);
+        if (ret < 0) {
+            LOGE("Failed to open card %d: %d", numbers[index], ret);
+            continue;
         }
-        uc_mgr_ptr->card_ctxt_ptr->card_number = card_mapping_list[index].card_number;
-        uc_mgr_ptr->card_ctxt_ptr->card_name = (char *)malloc((strlen(card_name)+1)*sizeof(char));
-        if (uc_mgr_ptr->card_ctxt_ptr->card_name == NULL) {
-            LOGE("Failed to allocate memory for card name");
-            free(uc_mgr_ptr->card_ctxt_ptr);
-            free(uc_mgr_ptr);
-            uc_mgr_ptr = NULL;
-            return -ENOMEM;
+        opened++;
+    }
+    return opened;
+}
+
+/* Open and initialise use case core for a sound card of the card list
+ * uc_mgr - Returned use case manager pointer
+ * index - index of the card in card_found
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_open_card(snd_use_case_mgr_t **uc_mgr, int index)
+{
+    snd_use_case_mgr_t *uc_mgr_ptr = NULL;
+    char card_name[50];
+    int card_number, ret = 0;
+    size_t size;
+
+    pthread_mutex_lock(&card_list_lock);
+    strlcpy(card_name, card_found[index].card_name, sizeof(card_name));
+    card_number = card_found[index].card_number;
+    pthread_mutex_unlock(&card_list_lock);
+
+    uc_mgr_ptr = (snd_use_case_mgr_t *)calloc(1, sizeof(snd_use_case_mgr_t));
+    if (uc_mgr_ptr == NULL) {
+        LOGE("Failed to allocate memory for instance");
+        return -ENOMEM;
+    }
+    uc_mgr_ptr->snd_card_index = index;
+    uc_mgr_ptr->card_ctxt_ptr = (card_ctxt_t *)calloc(1, sizeof(card_ctxt_t));
+    if (uc_mgr_ptr->card_ctxt_ptr == NULL) {
+        LOGE("Failed to allocate memory for card context");
+        free(uc_mgr_ptr);
+        uc_mgr_ptr = NULL;
+        return -ENOMEM;
+    }
+    uc_mgr_ptr->card_ctxt_ptr->card_number = card_number;
+    uc_mgr_ptr->card_ctxt_ptr->card_name = (char *)malloc((strlen(card_name)+1)*sizeof(char));
+    if (uc_mgr_ptr->card_ctxt_ptr->card_name == NULL) {
+        LOGE("Failed to allocate memory for card name");
+        free(uc_mgr_ptr->card_ctxt_ptr);
+        free(uc_mgr_ptr);
+        uc_mgr_ptr = NULL;
+        return -ENOMEM;
+    }
+    strlcpy(uc_mgr_ptr->card_ctxt_ptr->card_name, card_name, ((strlen(card_name)+1)*sizeof(char)));
+    size = strlen("/dev/snd/controlC") + 12;
+    uc_mgr_ptr->card_ctxt_ptr->control_device = (char *)malloc(size * sizeof(char));
+    if (uc_mgr_ptr->card_ctxt_ptr->control_device == NULL) {
+        LOGE("Failed to allocate memory for control device string");
+        free(uc_mgr_ptr->card_ctxt_ptr->card_name);
+        free(uc_mgr_ptr->card_ctxt_ptr);
+        free(uc_mgr_ptr);
+        uc_mgr_ptr = NULL;
+        return -ENOMEM;
+    }
+    snprintf(uc_mgr_ptr->card_ctxt_ptr->control_device, size, "/dev/snd/controlC%d",
+             card_number);
+    uc_mgr_ptr->device_list_count = 0;
+    uc_mgr_ptr->modifier_list_count = 0;
+    uc_mgr_ptr->current_device_list = NULL;
+    uc_mgr_ptr->current_modifier_list = NULL;
+    uc_mgr_ptr->current_tx_device = -1;
+    uc_mgr_ptr->current_rx_device = -1;
+    pthread_mutexattr_init(&uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
+    pthread_mutex_init(&uc_mgr_ptr->card_ctxt_ptr->card_lock,
+        &uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
+    pthread_mutex_init(&uc_mgr_ptr->card_ctxt_ptr->reload_lock, NULL);
+    pthread_cond_init(&uc_mgr_ptr->card_ctxt_ptr->verb_cond, NULL);
+    pthread_mutex_init(&uc_mgr_ptr->card_ctxt_ptr->async_lock, NULL);
+    pthread_cond_init(&uc_mgr_ptr->card_ctxt_ptr->async_cond, NULL);
+    uc_mgr_ptr->card_ctxt_ptr->async_fd = -1;
+    uc_mgr_ptr->card_ctxt_ptr->cal_voice_rx = -1;
+    uc_mgr_ptr->card_ctxt_ptr->cal_voice_tx = -1;
+    strlcpy(uc_mgr_ptr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, MAX_STR_LEN);
+    /* Reset all mixer controls if any applied previously for the same card */
+	snd_use_case_mgr_reset(uc_mgr_ptr);
+    uc_mgr_ptr->card_ctxt_ptr->current_verb_index = -1;
+    /* The mixer is opened first so that the parsed controls can be
+     * bound to the controls of the card as each verb is loaded, it is
+     * shared with the other users of the card within the process */
+    LOGV("Open mixer device: %s", uc_mgr_ptr->card_ctxt_ptr->control_device);
+    uc_mgr_ptr->card_ctxt_ptr->mixer_handle = mixer_open_shared(uc_mgr_ptr->card_ctxt_ptr->control_device);
+    LOGV("Mixer handle %p", uc_mgr_ptr->card_ctxt_ptr->mixer_handle);
+    uc_mgr_ptr->card_ctxt_ptr->ctl_pool =
+        snd_ucm_ctl_pool_create(uc_mgr_ptr->card_ctxt_ptr->mixer_handle);
+    uc_mgr_ptr->card_ctxt_ptr->str_pool = snd_ucm_str_pool_create();
+    /* Parse config files and update mixer controls */
+    ret = snd_ucm_parse(&uc_mgr_ptr);
+    if(ret < 0) {
+        LOGE("Failed to parse config files: %d", ret);
+        snd_ucm_free_mixer_list(&uc_mgr_ptr);
+    }
+    pthread_mutex_lock(&uc_mgr_ptr->card_ctxt_ptr->card_lock);
+    snd_ucm_publish_state(uc_mgr_ptr->card_ctxt_ptr);
+    pthread_mutex_unlock(&uc_mgr_ptr->card_ctxt_ptr->card_lock);
+    /* ACDB is shared by the managers of all the cards */
+    pthread_mutex_lock(&card_list_lock);
+    if ((acdb_users++ == 0) && ((acdb_loader_init_ACDB()) < 0)) {
+        LOGE("Failed to initialize ACDB");
+    }
+    pthread_mutex_unlock(&card_list_lock);
+    *uc_mgr = uc_mgr_ptr;
+    LOGV("snd_use_case_open(): returning instance %p", uc_mgr_ptr);
+    return ret;
+}
+
+
+/**
+ * \brief Reload and re-parse use case configuration files for sound card.
+ * Only the verbs whose config file changed are parsed again. The new tables
+ * replace the current ones under card_lock once no verb is being loaded on
+ * demand, and the current routing is applied again if its verb was
+ * reloaded.
+ * \param uc_mgr Use case manager
+ * \return zero if success, -EBUSY if a routing change holds the current
+ * tables, otherwise a negative error code
+ */
+int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr)
+{
+    snd_use_case_mgr_t stage_mgr, *stage_ptr = &stage_mgr;
+    card_ctxt_t *card_ctxt, *stage;
+    use_case_verb_t *verb, *old = NULL, moved;
+    /* Loaded verbs of the current tables, taken under card_lock since
+     * verbs are still loaded on demand while the new tables are built */
+    struct {
+        const char *name;
+        const char *file_name;
+        time_t mtime;
+        off_t size;
+    } *loaded = NULL;
+    time_t mtime, config_mtime;
+    off_t size, config_size;
+    char **verb_list;
+    int *reuse = NULL;
+    int index, old_index, old_count, verb_index = -1, cached = 0, parsed = 0, affected = 0, ret;
+
+    if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
+        (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
+        LOGE("snd_use_case_mgr_reload(): failed, invalid arguments");
+        return -EINVAL;
+    }
+    card_ctxt = uc_mgr->card_ctxt_ptr;
+
+    /* Tables are only replaced from here, let the initial parsing finish */
+    pthread_mutex_lock(&card_ctxt->reload_lock);
+    for (index = 0; index < card_ctxt->parse_threads; index++)
+        pthread_join(card_ctxt->parse_thr[index], NULL);
+    card_ctxt->parse_threads = 0;
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    old_count = card_ctxt->verb_count;
+    config_mtime = card_ctxt->config_mtime;
+    config_size = card_ctxt->config_size;
+    loaded = calloc(old_count + 1, sizeof(*loaded));
+    for (index = 0; loaded && (index < old_count); index++) {
+        old = &card_ctxt->use_case_verb_list[index];
+        if ((old->load_state != UCM_VERB_LOADED) || !old->file_name)
+            continue;
+        loaded[index].name = old->use_case_name;
+        loaded[index].file_name = old->file_name;
+        loaded[index].mtime = old->file_mtime;
+        loaded[index].size = old->file_size;
+    }
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    if (loaded == NULL) {
+        pthread_mutex_unlock(&card_ctxt->reload_lock);
+        return -ENOMEM;
+    }
+
+    /* New tables are built in a scratch context sharing the mixer */
+    stage = (card_ctxt_t *)calloc(1, sizeof(card_ctxt_t));
+    if (stage == NULL) {
+        free(loaded);
+        pthread_mutex_unlock(&card_ctxt->reload_lock);
+        return -ENOMEM;
+    }
+    stage->card_name = card_ctxt->card_name;
+    stage->mixer_handle = card_ctxt->mixer_handle;
+    stage->ctl_pool = card_ctxt->ctl_pool;
+    stage->str_pool = card_ctxt->str_pool;
+    pthread_mutex_init(&stage->card_lock, NULL);
+    pthread_cond_init(&stage->verb_cond, NULL);
+    memset(&stage_mgr, 0, sizeof(stage_mgr));
+    stage_mgr.snd_card_index = uc_mgr->snd_card_index;
+    stage_mgr.card_ctxt_ptr = stage;
+
+    ret = snd_ucm_parse_master(stage);
+    if (!ret) {
+        reuse = (int *)malloc((stage->verb_count+1)*sizeof(int));
+        if (reuse == NULL)
+            ret = -ENOMEM;
+    }
+    for (index = 0; !ret && (index < stage->verb_count); index++) {
+        verb = &stage->use_case_verb_list[index];
+        reuse[index] = -1;
+        for (old_index = 0; old_index < old_count; old_index++) {
+            if (loaded[old_index].file_name && verb->file_name &&
+                !strcmp(loaded[old_index].name, verb->use_case_name) &&
+                !strcmp(loaded[old_index].file_name, verb->file_name))
+                break;
         }
-        strlcpy(uc_mgr_ptr->card_ctxt_ptr->card_name, card_name, ((strlen(card_name)+1)*sizeof(char)));
-        uc_mgr_ptr->card_ctxt_ptr->control_device = (char *)malloc((strlen("/dev/snd/controlC")+2)*sizeof(char));
-        if (uc_mgr_ptr->card_ctxt_ptr->control_device == NULL) {
-            LOGE("Failed to allocate memory for control device string");
-            free(uc_mgr_ptr->card_ctxt_ptr->card_name);
-            free(uc_mgr_ptr->card_ctxt_ptr);
-            free(uc_mgr_ptr);
-            uc_mgr_ptr = NULL;
-            return -ENOMEM;
+        if (old_index < old_count) {
+            if (!snd_ucm_stat_verb_file(verb->file_name, &mtime, &size) &&
+                (mtime == loaded[old_index].mtime) && (size == loaded[old_index].size)) {
+                reuse[index] = old_index;
+                continue;
+            }
         }
-        strlcpy(uc_mgr_ptr->card_ctxt_ptr->control_device, "/dev/snd/controlC", 18);
-        snprintf(tmp, sizeof(tmp), "%d", uc_mgr_ptr->card_ctxt_ptr->card_number);
-        strlcat(uc_mgr_ptr->card_ctxt_ptr->control_device, tmp, (strlen("/dev/snd/controlC")+2)*sizeof(char));
-        uc_mgr_ptr->device_list_count = 0;
-        uc_mgr_ptr->modifier_list_count = 0;
-        uc_mgr_ptr->current_device_list = NULL;
-        uc_mgr_ptr->current_modifier_list = NULL;
-        uc_mgr_ptr->current_tx_device = -1;
-        uc_mgr_ptr->current_rx_device = -1;
-        pthread_mutexattr_init(&uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
-        pthread_mutex_init(&uc_mgr_ptr->card_ctxt_ptr->card_lock,
-            &uc_mgr_ptr->card_ctxt_ptr->card_lock_attr);
-        strlcpy(uc_mgr_ptr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, MAX_STR_LEN);
-        /* Reset all mixer controls if any applied previously for the same card */
-	snd_use_case_mgr_reset(uc_mgr_ptr);
-        uc_mgr_ptr->card_ctxt_ptr->current_verb_index = -1;
-        /* Parse config files and update mixer controls */
-        ret = snd_ucm_parse(&uc_mgr_ptr);
-        if(ret < 0) {
-            LOGE("Failed to parse config files: %d", ret);
-            snd_ucm_free_mixer_list(&uc_mgr_ptr);
+        LOGD("Reloading use case verb %s", verb->use_case_name);
+        pthread_mutex_lock(&stage->card_lock);
+        ret = snd_ucm_load_verb(stage_ptr, index);
+        pthread_mutex_unlock(&stage->card_lock);
+        if (ret < 0)
+            break;
+        snd_ucm_intern_verb(card_ctxt, verb);
+        parsed++;
+    }
+    if (ret < 0) {
+        LOGE("Failed to reload config files: %d, keeping current tables", ret);
+        goto done;
+    }
+    if (!parsed && (stage->config_mtime == config_mtime) &&
+        (stage->config_size == config_size)) {
+        LOGV("Config files of %s not changed", card_ctxt->card_name);
+        goto done;
+    }
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    /* A verb loaded on demand is filled in with card_lock released, the
+     * old tables must outlive the load */
+    for (index = 0; index < card_ctxt->verb_count; index++) {
+        if (card_ctxt->use_case_verb_list[index].load_state == UCM_VERB_LOADING) {
+            pthread_cond_wait(&card_ctxt->verb_cond, &card_ctxt->card_lock);
+            index = -1;
+        }
+    }
+    /* Recorded controls of a transition in progress point into them too */
+    if (card_ctxt->plan.active || card_ctxt->plan.hold) {
+        pthread_mutex_unlock(&card_ctxt->card_lock);
+        LOGE("Routing change in progress, not reloading %s", card_ctxt->card_name);
+        ret = -EBUSY;
+        goto done;
+    }
+    if (strncmp(card_ctxt->current_verb, SND_USE_CASE_VERB_INACTIVE,
+        strlen(SND_USE_CASE_VERB_INACTIVE)) && (card_ctxt->current_verb_index >= 0)) {
+        for (index = 0; index < stage->verb_count; index++) {
+            if (!strcmp(stage->use_case_verb_list[index].use_case_name, card_ctxt->current_verb))
+                break;
         }
-        LOGV("Open mixer device: %s", uc_mgr_ptr->card_ctxt_ptr->control_device);
-        uc_mgr_ptr->card_ctxt_ptr->mixer_handle = mixer_open(uc_mgr_ptr->card_ctxt_ptr->control_device);
-        LOGV("Mixer handle %p", uc_mgr_ptr->card_ctxt_ptr->mixer_handle);
-        if ((acdb_loader_init_ACDB()) < 0) {
-            LOGE("Failed to initialize ACDB");
+        verb_index = (index < stage->verb_count) ? index : -1;
+        affected = (verb_index < 0) || (reuse[verb_index] != card_ctxt->current_verb_index);
+    }
+    if (affected) {
+        /* Routing is taken down with the old tables and brought up with
+         * the new ones, only the controls that differ are written */
+        snd_ucm_plan_begin(card_ctxt);
+        snd_ucm_apply_routing(uc_mgr, 0);
+    }
+    /* Unchanged verbs are moved over, the old slots keep only their names */
+    for (index = 0; index < stage->verb_count; index++) {
+        if (reuse[index] < 0)
+            continue;
+        verb = &stage->use_case_verb_list[index];
+        old = &card_ctxt->use_case_verb_list[reuse[index]];
+        moved = *old;
+        memset(old, 0, sizeof(*old));
+        old->use_case_name = moved.use_case_name;
+        old->file_name = moved.file_name;
+        moved.use_case_name = verb->use_case_name;
+        moved.file_name = verb->file_name;
+        *verb = moved;
+        cached += verb->cached;
+    }
+    old = card_ctxt->use_case_verb_list;
+    card_ctxt->use_case_verb_list = stage->use_case_verb_list;
+    stage->use_case_verb_list = old;
+    verb_list = card_ctxt->verb_list;
+    card_ctxt->verb_list = stage->verb_list;
+    stage->verb_list = verb_list;
+    index = card_ctxt->verb_count;
+    card_ctxt->verb_count = stage->verb_count;
+    stage->verb_count = index;
+    card_ctxt->config_mtime = stage->config_mtime;
+    card_ctxt->config_size = stage->config_size;
+    if (!cached) {
+        /* The compiled config mapping goes away with the old tables */
+        stage->cache_addr = card_ctxt->cache_addr;
+        stage->cache_size = card_ctxt->cache_size;
+        stage->cache_ctrl = card_ctxt->cache_ctrl;
+        stage->cache_mixer = card_ctxt->cache_mixer;
+        stage->cache_str = card_ctxt->cache_str;
+        card_ctxt->cache_addr = NULL;
+        card_ctxt->cache_size = 0;
+        card_ctxt->cache_ctrl = NULL;
+        card_ctxt->cache_mixer = NULL;
+        card_ctxt->cache_str = NULL;
+    }
+    /* Staged values refer to the old verb indexes */
+    snd_ucm_stage_clear(card_ctxt);
+    /* Calibration is sent again for the reloaded configuration */
+    memset(card_ctxt->cal_audio, 0, sizeof(card_ctxt->cal_audio));
+    uc_mgr->current_rx_device = -1;
+    uc_mgr->current_tx_device = -1;
+    if (affected) {
+        if (verb_index < 0) {
+            LOGE("Use case verb %s removed on reload", card_ctxt->current_verb);
+            strlcpy(card_ctxt->current_verb, SND_USE_CASE_VERB_INACTIVE, MAX_STR_LEN);
+            card_ctxt->current_verb_index = -1;
+        } else {
+            card_ctxt->current_verb_index = verb_index;
+            snd_ucm_apply_routing(uc_mgr, 1);
         }
-        *uc_mgr = uc_mgr_ptr;
+        if (snd_ucm_plan_commit(card_ctxt) < 0)
+            LOGE("Failed to apply controls after reload for %s", card_ctxt->current_verb);
+    } else if (verb_index >= 0) {
+        card_ctxt->current_verb_index = verb_index;
     }
-    LOGV("snd_use_case_open(): returning instance %p", uc_mgr_ptr);
-    return ret;
-}
+    /* Readers of the old tables are gone once the new state is out */
+    snd_ucm_publish_state(card_ctxt);
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    LOGD("Reloaded %d of %d verbs for %s", parsed, card_ctxt->verb_count, card_ctxt->card_name);
 
-
-/**
- * \brief Reload and re-parse use case configuration files for sound card.
- * \param uc_mgr Use case manager
- * \return zero if success, otherwise a negative error code
- */
-int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr) {
-    LOGE("Reload is not implemented for now as there is no use case currently");
-    return 0;
+done:
+    /* The scratch context holds the tables not in use anymore */
+    snd_ucm_free_mixer_list(&stage_ptr);
+    pthread_cond_destroy(&stage->verb_cond);
+    pthread_mutex_destroy(&stage->card_lock);
+    free(stage);
+    free(reuse);
+    free(loaded);
+    if (!ret && (parsed || affected) && (snd_ucm_cache_write(uc_mgr) < 0))
+        LOGV("Compiled config not written for %s", card_ctxt->card_name);
+    pthread_mutex_unlock(&card_ctxt->reload_lock);
+    return ret;
 }
 
 /**
@@ -1093,7 +2974,7 @@ int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr) {
  */
 int snd_use_case_mgr_close(snd_use_case_mgr_t *uc_mgr)
 {
-    int ret = 0;
+    int index, ret = 0;
 
     if ((uc_mgr->snd_card_index >= (int)MAX_NUM_CARDS) ||
         (uc_mgr->snd_card_index < 0) || (uc_mgr->card_ctxt_ptr == NULL)) {
@@ -1102,13 +2983,40 @@ int snd_use_case_mgr_close(snd_use_case_mgr_t *uc_mgr)
     }
 
     LOGV("snd_use_case_close(): instance %p", uc_mgr);
+    /* Requests already queued are applied before closing */
+    snd_ucm_async_stop(uc_mgr->card_ctxt_ptr);
+    /* Verbs being parsed are finished, the remaining ones are skipped */
+    pthread_mutex_lock(&uc_mgr->card_ctxt_ptr->card_lock);
+    uc_mgr->card_ctxt_ptr->parse_stop = 1;
+    pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    for (index = 0; index < uc_mgr->card_ctxt_ptr->parse_threads; index++)
+        pthread_join(uc_mgr->card_ctxt_ptr->parse_thr[index], NULL);
+    uc_mgr->card_ctxt_ptr->parse_threads = 0;
     ret = snd_use_case_mgr_reset(uc_mgr);
     if (ret < 0)
         LOGE("Failed to reset ucm session");
     snd_ucm_free_mixer_list(&uc_mgr);
-    acdb_loader_deallocate_ACDB();
+    snd_ucm_ctl_pool_destroy(uc_mgr->card_ctxt_ptr->ctl_pool);
+    uc_mgr->card_ctxt_ptr->ctl_pool = NULL;
+    snd_ucm_str_pool_destroy(uc_mgr->card_ctxt_ptr->str_pool);
+    uc_mgr->card_ctxt_ptr->str_pool = NULL;
+    free(uc_mgr->card_ctxt_ptr->plan.writes);
+    free(uc_mgr->card_ctxt_ptr->plan.last);
+    free(uc_mgr->card_ctxt_ptr->plan.undo);
+    free(uc_mgr->card_ctxt_ptr->stage.slot);
+    free(uc_mgr->card_ctxt_ptr->stage.values);
+    pthread_mutex_lock(&card_list_lock);
+    if (--acdb_users == 0)
+        acdb_loader_deallocate_ACDB();
+    pthread_mutex_unlock(&card_list_lock);
     pthread_mutexattr_destroy(&uc_mgr->card_ctxt_ptr->card_lock_attr);
     pthread_mutex_destroy(&uc_mgr->card_ctxt_ptr->card_lock);
+    pthread_mutex_destroy(&uc_mgr->card_ctxt_ptr->reload_lock);
+    pthread_cond_destroy(&uc_mgr->card_ctxt_ptr->verb_cond);
+    pthread_mutex_destroy(&uc_mgr->card_ctxt_ptr->async_lock);
+    pthread_cond_destroy(&uc_mgr->card_ctxt_ptr->async_cond);
+    if (uc_mgr->card_ctxt_ptr->async_fd >= 0)
+        close(uc_mgr->card_ctxt_ptr->async_fd);
     if (uc_mgr->card_ctxt_ptr->mixer_handle) {
         mixer_close(uc_mgr->card_ctxt_ptr->mixer_handle);
         uc_mgr->card_ctxt_ptr->mixer_handle = NULL;
@@ -1133,7 +3041,8 @@ int snd_use_case_mgr_close(snd_use_case_mgr_t *uc_mgr)
  */
 int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
 {
-    char *ident_value;
+    const char **list;
+    const char *ident_value;
     int index, list_size, ret = 0;
 
     LOGV("snd_use_case_reset(): instance %p", uc_mgr);
@@ -1145,25 +3054,15 @@ int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
         return -EINVAL;
     }
 
+    snd_ucm_stats_begin(uc_mgr->card_ctxt_ptr, "_reset", NULL);
     /* Disable mixer controls of all the enabled modifiers */
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->mod_list_head);
+    list_size = uc_mgr->card_ctxt_ptr->mod_set.count;
     for (index = (list_size-1); index >= 0; index--) {
-        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->mod_list_head, index);
-        snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->mod_list_head, ident_value);
+        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, index);
+        snd_ucm_del_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->mod_set, ident_value);
         ret = snd_use_case_ident_set_controls_for_all_devices(uc_mgr, ident_value, 0);
 	if (ret != 0)
 		LOGE("Failed to disable mixer controls for %s", ident_value);
-	free(ident_value);
-    }
-    /* Clear the enabled modifiers list */
-    if (uc_mgr->modifier_list_count) {
-        for (index = 0; index < uc_mgr->modifier_list_count; index++) {
-            free(uc_mgr->current_modifier_list[index]);
-            uc_mgr->current_modifier_list[index] = NULL;
-        }
-        free(uc_mgr->current_modifier_list);
-        uc_mgr->current_modifier_list = NULL;
-        uc_mgr->modifier_list_count = 0;
     }
     /* Disable mixer controls of current use case verb */
     if(strncmp(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, strlen(SND_USE_CASE_VERB_INACTIVE))) {
@@ -1173,185 +3072,116 @@ int snd_use_case_mgr_reset(snd_use_case_mgr_t *uc_mgr)
         strlcpy(uc_mgr->card_ctxt_ptr->current_verb, SND_USE_CASE_VERB_INACTIVE, MAX_STR_LEN);
     }
     /* Disable mixer controls of all the enabled devices */
-    list_size = snd_ucm_get_size_of_list(uc_mgr->card_ctxt_ptr->dev_list_head);
+    list_size = uc_mgr->card_ctxt_ptr->dev_set.count;
     for (index = (list_size-1); index >= 0; index--) {
-        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr->dev_list_head, index);
-        snd_ucm_del_ident_from_list(&uc_mgr->card_ctxt_ptr->dev_list_head, ident_value);
+        ident_value = snd_ucm_get_value_at_index(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, index);
+        snd_ucm_del_ident(uc_mgr->card_ctxt_ptr, &uc_mgr->card_ctxt_ptr->dev_set, ident_value);
         ret = snd_use_case_set_device_for_all_ident(uc_mgr, ident_value, 0);
 	if (ret != 0)
             LOGE("Failed to disable or no mixer controls set for %s", ident_value);
-	free(ident_value);
-    }
-    /* Clear the enabled devices list */
-    if (uc_mgr->device_list_count) {
-        for (index = 0; index < uc_mgr->device_list_count; index++) {
-            free(uc_mgr->current_device_list[index]);
-            uc_mgr->current_device_list[index] = NULL;
-        }
-        free(uc_mgr->current_device_list);
-        uc_mgr->current_device_list = NULL;
-        uc_mgr->device_list_count = 0;
     }
     uc_mgr->current_tx_device = -1;
     uc_mgr->current_rx_device = -1;
+    snd_ucm_stage_clear(uc_mgr->card_ctxt_ptr);
+    snd_ucm_stats_end(uc_mgr->card_ctxt_ptr, 1, ret);
+    snd_ucm_publish_state(uc_mgr->card_ctxt_ptr);
     pthread_mutex_unlock(&uc_mgr->card_ctxt_ptr->card_lock);
+    /* Clear the enabled modifiers and devices lists */
+    snd_ucm_copy_list(&uc_mgr->current_modifier_list, &uc_mgr->modifier_list_count,
+        NULL, 0, &list);
+    snd_ucm_copy_list(&uc_mgr->current_device_list, &uc_mgr->device_list_count,
+        NULL, 0, &list);
     return ret;
 }
 
-/* 2nd stage parsing done in seperate thread */
-void *second_stage_parsing_thread(void *uc_mgr_ptr)
+/* Load a use case verb if it is not loaded yet, card_lock must be held.
+ * A verb claimed by a parsing thread is waited for, an unclaimed one is
+ * parsed by the caller with card_lock released meanwhile.
+ * uc_mgr - use case manager structure
+ * index - index of the verb in the list
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_load_verb(snd_use_case_mgr_t *uc_mgr, int index)
 {
-    char path[200];
-    struct stat st;
-    int fd, index = 0, ret = 0, rc = 0;
-    char *read_buf, *next_str, *current_str, *buf, *p, *verb_name, *file_name = NULL, *temp_ptr;
-    snd_use_case_mgr_t **uc_mgr = (snd_use_case_mgr_t **)&uc_mgr_ptr;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    use_case_verb_t *verb = &card_ctxt->use_case_verb_list[index];
+    int ret;
 
-    strlcpy(path, CONFIG_DIR, (strlen(CONFIG_DIR)+1));
-    strlcat(path, (*uc_mgr)->card_ctxt_ptr->card_name, sizeof(path));
-    LOGV("master config file path:%s", path);
-    fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        LOGE("failed to open config file %s error %d\n", path, errno);
-        return NULL;
-    }
-    if (fstat(fd, &st) < 0) {
-        LOGE("failed to stat %s error %d\n", path, errno);
-        close(fd);
-        return NULL;
-    }
-    read_buf = (char *) mmap(0, st.st_size, PROT_READ | PROT_WRITE,
-               MAP_PRIVATE, fd, 0);
-    if (read_buf == MAP_FAILED) {
-        LOGE("failed to mmap file error %d\n", errno);
-        close(fd);
-        return NULL;
-    }
-    current_str = read_buf;
-    verb_name = NULL;
-    while (*current_str != (char)EOF)  {
-        next_str = strchr(current_str, '\n');
-        if (!next_str)
-            break;
-        *next_str++ = '\0';
-        if (verb_name == NULL) {
-            buf = strstr(current_str, "SectionUseCase");
-            if (buf == NULL) {
-                if((current_str = next_str) == NULL)
-                    break;
-                else
-                    continue;
-            }
-            /* Ignore parsing first use case (HiFi) as it is already parsed
-             * in 1st stage of parsing */
-            if (index == 0) {
-                index++;
-                if((current_str = next_str) == NULL)
-                    break;
-                else
-                    continue;
-            }
-            p = strtok_r(buf, ".", &temp_ptr);
-            while (p != NULL) {
-                p = strtok_r(NULL, "\"", &temp_ptr);
-                if (p == NULL)
-                    break;
-                verb_name = (char *)malloc((strlen(p)+1)*sizeof(char));
-                if(verb_name == NULL) {
-                    ret = -ENOMEM;
-                    break;
-                }
-                strlcpy(verb_name, p, (strlen(p)+1)*sizeof(char));
-                break;
-            }
+    while (verb->load_state == UCM_VERB_LOADING)
+        pthread_cond_wait(&card_ctxt->verb_cond, &card_ctxt->card_lock);
+    if (verb->load_state == UCM_VERB_UNLOADED) {
+        verb->load_state = UCM_VERB_LOADING;
+        pthread_mutex_unlock(&card_ctxt->card_lock);
+        if (verb->file_name == NULL) {
+            LOGE("No config file for use case verb %s", verb->use_case_name);
+            ret = -EINVAL;
         } else {
-            buf = strstr(current_str, "File");
-            if (buf == NULL) {
-                if((current_str = next_str) == NULL)
-                    break;
-                else
-                    continue;
-            }
-            p = strtok_r(buf, "\"", &temp_ptr);
-            while (p != NULL) {
-                p = strtok_r(NULL, "\"", &temp_ptr);
-                if (p == NULL)
-                    break;
-                file_name = (char *)malloc((strlen(p)+1)*sizeof(char));
-                if(file_name == NULL) {
-                    ret = -ENOMEM;
-                    break;
-                }
-                strlcpy(file_name, p, (strlen(p)+1)*sizeof(char));
+            ret = snd_ucm_parse_verb(&uc_mgr, verb->file_name, index);
+            if (ret < 0)
+                LOGE("Failed to parse config file %s\n", verb->file_name);
+        }
+        pthread_mutex_lock(&card_ctxt->card_lock);
+        verb->load_state = (ret < 0) ? UCM_VERB_FAILED : UCM_VERB_LOADED;
+        pthread_cond_broadcast(&card_ctxt->verb_cond);
+    }
+    return (verb->load_state == UCM_VERB_LOADED) ? 0 : -EINVAL;
+}
+
+/* Parsing thread, loads the verbs not loaded yet one at a time. The last
+ * thread to finish writes the compiled config once all verbs are loaded */
+static void *snd_ucm_parse_worker(void *uc_mgr_ptr)
+{
+    snd_use_case_mgr_t *uc_mgr = (snd_use_case_mgr_t *)uc_mgr_ptr;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    int index, failed = 0, last;
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    while (!card_ctxt->parse_stop) {
+        for (index = 0; index < card_ctxt->verb_count; index++) {
+            if (card_ctxt->use_case_verb_list[index].load_state == UCM_VERB_UNLOADED)
                 break;
-            }
-            if (file_name != NULL) {
-                ret = snd_ucm_parse_verb(uc_mgr, file_name, index);
-                pthread_mutex_lock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
-                (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_name =
-                    (char *)malloc((strlen(verb_name)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_name,
-                    verb_name, ((strlen(verb_name)+1)*sizeof(char)));
-                /* Verb list might have been appended with END OF LIST in 1st stage parsing
-                 * Delete this entry so that new verbs are appended from here and END OF LIST
-                 * will be added again at the end of 2nd stage parsing
-                 */
-                if((*uc_mgr)->card_ctxt_ptr->verb_list[index]) {
-                    free((*uc_mgr)->card_ctxt_ptr->verb_list[index]);
-                    (*uc_mgr)->card_ctxt_ptr->verb_list[index] = NULL;
-                }
-                (*uc_mgr)->card_ctxt_ptr->verb_list[index] =
-                    (char *)malloc((strlen(verb_name)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->verb_list[index], verb_name, ((strlen(verb_name)+1)*sizeof(char)));
-                index++;
-                (*uc_mgr)->card_ctxt_ptr->verb_list[index] =
-                    (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->verb_list[index], SND_UCM_END_OF_LIST,
-                       ((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char)));
-                pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
-                free(verb_name);
-                verb_name = NULL;
-                free(file_name);
-                file_name = NULL;
-            } else {
-                pthread_mutex_lock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
-                index++;
-                (*uc_mgr)->card_ctxt_ptr->verb_list[index] =
-                    (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->verb_list[index], SND_UCM_END_OF_LIST,
-                        ((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char)));
-                pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
-            }
         }
-        if((current_str = next_str) == NULL)
+        if (index == card_ctxt->verb_count)
             break;
+        snd_ucm_load_verb(uc_mgr, index);
     }
-    munmap(read_buf, st.st_size);
-    close(fd);
+    last = (--card_ctxt->parse_workers == 0);
+    if (last) {
+        /* Verbs loaded on demand may still be in progress */
+        for (index = 0; index < card_ctxt->verb_count; index++) {
+            while (card_ctxt->use_case_verb_list[index].load_state == UCM_VERB_LOADING)
+                pthread_cond_wait(&card_ctxt->verb_cond, &card_ctxt->card_lock);
+            if (card_ctxt->use_case_verb_list[index].load_state != UCM_VERB_LOADED)
+                failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    if (last && !failed) {
 #if PARSE_DEBUG
         /* Prints use cases and mixer controls parsed from config files */
-        snd_ucm_print((*uc_mgr));
+        snd_ucm_print(uc_mgr);
 #endif
-    if(ret < 0)
-        LOGE("Failed to parse config files: %d", ret);
-    LOGE("Exiting parsing thread uc_mgr %p\n", uc_mgr);
+        if (snd_ucm_cache_write(uc_mgr) < 0)
+            LOGV("Compiled config not written for %s", card_ctxt->card_name);
+    }
+    LOGV("Exiting parsing thread uc_mgr %p\n", uc_mgr);
     return NULL;
 }
 
-/* Parse config files and update mixer controls for the use cases
- * 1st stage parsing done to parse HiFi config file
- * uc_mgr - use case manager structure
+/* Read the verb names and config file names from the master config file,
+ * the verbs are left unloaded
+ * card_ctxt - card context to fill
  * Returns 0 on sucess, negative error code otherwise
  */
-static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr)
+static int snd_ucm_parse_master(card_ctxt_t *card_ctxt)
 {
     struct stat st;
-    int fd, verb_count, index = 0, ret = 0, rc;
-    char *read_buf, *next_str, *current_str, *buf, *p, *verb_name, *file_name = NULL, *temp_ptr;
+    int fd, verb_count, index = 0, ret = 0;
+    char *read_buf, *next_str, *current_str, *buf, *p, *verb_name = NULL, *temp_ptr;
     char path[200];
 
-    strlcpy(path, CONFIG_DIR, (strlen(CONFIG_DIR)+1));
-    strlcat(path, (*uc_mgr)->card_ctxt_ptr->card_name, sizeof(path));
+    strlcpy(path, ucm_config_dir, sizeof(path));
+    strlcat(path, card_ctxt->card_name, sizeof(path));
     LOGV("master config file path:%s", path);
     fd = open(path, O_RDONLY);
     if (fd < 0) {
@@ -1363,6 +3193,8 @@ static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr)
         close(fd);
         return -EINVAL;
     }
+    card_ctxt->config_mtime = st.st_mtime;
+    card_ctxt->config_size = st.st_size;
     read_buf = (char *) mmap(0, st.st_size, PROT_READ | PROT_WRITE,
                MAP_PRIVATE, fd, 0);
     if (read_buf == MAP_FAILED) {
@@ -1372,102 +3204,126 @@ static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr)
     }
     current_str = read_buf;
     verb_count = get_verb_count(current_str);
-    (*uc_mgr)->card_ctxt_ptr->use_case_verb_list =
-        (use_case_verb_t *)malloc((verb_count+1)*(sizeof(use_case_verb_t)));
-    (*uc_mgr)->card_ctxt_ptr->verb_list =
-        (char **)malloc((verb_count+2)*(sizeof(char *)));
-    verb_name = NULL;
-    while (*current_str != (char)EOF)  {
+    if (verb_count < 0) {
+        munmap(read_buf, st.st_size);
+        close(fd);
+        return verb_count;
+    }
+    card_ctxt->use_case_verb_list =
+        (use_case_verb_t *)calloc(verb_count+1, sizeof(use_case_verb_t));
+    card_ctxt->verb_list = (char **)calloc(verb_count+2, sizeof(char *));
+    if (!card_ctxt->use_case_verb_list || !card_ctxt->verb_list) {
+        free(card_ctxt->use_case_verb_list);
+        card_ctxt->use_case_verb_list = NULL;
+        free(card_ctxt->verb_list);
+        card_ctxt->verb_list = NULL;
+        munmap(read_buf, st.st_size);
+        close(fd);
+        return -ENOMEM;
+    }
+    while ((*current_str != (char)EOF) && (index < verb_count) && !ret)  {
         next_str = strchr(current_str, '\n');
         if (!next_str)
             break;
         *next_str++ = '\0';
         if (verb_name == NULL) {
             buf = strstr(current_str, "SectionUseCase");
-            if (buf == NULL) {
-                if((current_str = next_str) == NULL)
-                    break;
-                else
-                    continue;
-            }
-            p = strtok_r(buf, ".", &temp_ptr);
-            while (p != NULL) {
-                p = strtok_r(NULL, "\"", &temp_ptr);
-                if (p == NULL)
-                    break;
-                verb_name = (char *)malloc((strlen(p)+1)*sizeof(char));
-                if(verb_name == NULL) {
-                    ret = -ENOMEM;
-                    break;
+            if (buf != NULL) {
+                p = strtok_r(buf, ".", &temp_ptr);
+                if (p != NULL)
+                    p = strtok_r(NULL, "\"", &temp_ptr);
+                if (p != NULL) {
+                    verb_name = strdup(p);
+                    card_ctxt->verb_list[index] = strdup(p);
+                    card_ctxt->use_case_verb_list[index].use_case_name = verb_name;
+                    if (!verb_name || !card_ctxt->verb_list[index])
+                        ret = -ENOMEM;
                 }
-                strlcpy(verb_name, p, (strlen(p)+1)*sizeof(char));
-                (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_name =
-                    (char *)malloc((strlen(verb_name)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_name,
-                    verb_name, ((strlen(verb_name)+1)*sizeof(char)));
-                (*uc_mgr)->card_ctxt_ptr->verb_list[index] =
-                    (char *)malloc((strlen(verb_name)+1)*sizeof(char));
-                strlcpy((*uc_mgr)->card_ctxt_ptr->verb_list[index], verb_name,
-                        ((strlen(verb_name)+1)*sizeof(char)));
-                break;
             }
         } else {
             buf = strstr(current_str, "File");
-            if (buf == NULL) {
-                if((current_str = next_str) == NULL)
-                    break;
-                else
-                    continue;
-            }
-            p = strtok_r(buf, "\"", &temp_ptr);
-            while (p != NULL) {
-                p = strtok_r(NULL, "\"", &temp_ptr);
-                if (p == NULL)
-                    break;
-                file_name = (char *)malloc((strlen(p)+1)*sizeof(char));
-                if(file_name == NULL) {
-                    ret = -ENOMEM;
-                    break;
+            if (buf != NULL) {
+                p = strtok_r(buf, "\"", &temp_ptr);
+                if (p != NULL)
+                    p = strtok_r(NULL, "\"", &temp_ptr);
+                if (p != NULL) {
+                    card_ctxt->use_case_verb_list[index].file_name = strdup(p);
+                    if (card_ctxt->use_case_verb_list[index].file_name == NULL)
+                        ret = -ENOMEM;
                 }
-                strlcpy(file_name, p, (strlen(p)+1)*sizeof(char));
-                break;
-            }
-            if (file_name != NULL) {
-                ret = snd_ucm_parse_verb(uc_mgr, file_name, index);
-                if (ret < 0)
-                    LOGE("Failed to parse config file %s\n", file_name);
-                free(verb_name);
                 verb_name = NULL;
-                free(file_name);
-                file_name = NULL;
+                index++;
             }
-            index++;
-            /* Break here so that only one first use case config file (HiFi)
-             * from master config file is parsed initially and all other
-             * config files are parsed in seperate thread created below so
-             * that audio HAL can initialize faster during boot-up
-             */
-            break;
         }
         if((current_str = next_str) == NULL)
             break;
     }
     munmap(read_buf, st.st_size);
     close(fd);
-    (*uc_mgr)->card_ctxt_ptr->verb_list[index] =
-        (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
-    strlcpy((*uc_mgr)->card_ctxt_ptr->verb_list[index], SND_UCM_END_OF_LIST,
-            ((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char)));
-    if (!ret) {
-        LOGD("Creating Parsing thread uc_mgr %p\n", uc_mgr);
-        rc = pthread_create(&(*uc_mgr)->thr, 0, second_stage_parsing_thread, (void*)(*uc_mgr));
-        if(rc < 0) {
-            LOGE("Failed to create parsing thread rc %d errno %d\n", rc, errno);
-        } else {
-            LOGV("Prasing thread created successfully\n");
+    /* A verb without a file entry is still listed, it fails to load */
+    if (verb_name != NULL)
+        index++;
+    card_ctxt->verb_list[index] = strdup(SND_UCM_END_OF_LIST);
+    if (card_ctxt->verb_list[index] == NULL)
+        ret = -ENOMEM;
+    card_ctxt->verb_count = index;
+    return ret;
+}
+
+/* Parse config files and update mixer controls for the use cases
+ * All verb names are read from the master config file first so that the
+ * verb list is complete, the first use case (HiFi) is parsed right away and
+ * the others are parsed by a pool of threads
+ * uc_mgr - use case manager structure
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr)
+{
+    card_ctxt_t *card_ctxt = (*uc_mgr)->card_ctxt_ptr;
+    int threads, index, ret, rc;
+
+    if (card_ctxt->str_pool == NULL)
+        return -ENOMEM;
+    /* Use the compiled config if it is still up to date, no parsing
+     * thread is needed in that case */
+    if (!snd_ucm_cache_load(*uc_mgr))
+        return 0;
+
+    ret = snd_ucm_parse_master(card_ctxt);
+    if (ret < 0)
+        return ret;
+
+    /* Only the first use case config file (HiFi) is parsed here so
+     * that audio HAL can initialize faster during boot-up */
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    if (card_ctxt->verb_count > 0)
+        ret = snd_ucm_load_verb(*uc_mgr, 0);
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    if (ret < 0)
+        return ret;
+
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > UCM_MAX_PARSE_THREADS)
+        threads = UCM_MAX_PARSE_THREADS;
+    if (threads > card_ctxt->verb_count - 1)
+        threads = card_ctxt->verb_count - 1;
+    if (threads < 1)
+        threads = 1;
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    for (index = 0; index < threads; index++) {
+        card_ctxt->parse_workers++;
+        rc = pthread_create(&card_ctxt->parse_thr[index], 0, snd_ucm_parse_worker,
+                 (void *)(*uc_mgr));
+        if (rc != 0) {
+            LOGE("Failed to create parsing thread rc %d\n", rc);
+            card_ctxt->parse_workers--;
+            break;
         }
+        card_ctxt->parse_threads++;
     }
-    return ret;
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    LOGD("Created %d parsing threads uc_mgr %p\n", card_ctxt->parse_threads, *uc_mgr);
+    return 0;
 }
 
 /* Gets the number of use case verbs defined by master config file */
@@ -1501,6 +3357,251 @@ static int get_verb_count(const char *nxt_str)
     return count;
 }
 
+/* Get the file a verb config file inherits its sections from
+ * path - path of the verb config file
+ * base - returns the name of the inherited file
+ * size - size of base
+ * Returns 1 if the file inherits, 0 if not, negative error code otherwise
+ */
+static int snd_ucm_get_inherit(const char *path, char *base, size_t size)
+{
+    FILE *fp;
+    char line[MAX_STR_LEN], *p, *end;
+    int ret = 0;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        LOGE("failed to open config file %s error %d\n", path, errno);
+        return -EINVAL;
+    }
+    /* Only the lines before the first section are looked at */
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (!strncasecmp(line, "Section", 7))
+            break;
+        p = line;
+        while ((*p == ' ') || (*p == '\t'))
+            p++;
+        if (strncasecmp(p, "Inherit", 7) && strncasecmp(p, "Include", 7))
+            continue;
+        p = strchr(p, '\"');
+        end = p ? strchr(p + 1, '\"') : NULL;
+        if ((end == NULL) || (end == p + 1) || ((size_t)(end - p) > size)) {
+            LOGE("Invalid inherit line in %s: %s", path, line);
+            ret = -EINVAL;
+            break;
+        }
+        *end = '\0';
+        strlcpy(base, p + 1, size);
+        ret = 1;
+        break;
+    }
+    fclose(fp);
+    return ret;
+}
+
+/* Get the modification time and size of a verb config file and of the
+ * files it inherits from, so that a change in any of them is noticed
+ * file_name - verb config file name
+ * mtime - returns the latest modification time
+ * size - returns the total size
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_stat_verb_file(const char *file_name, time_t *mtime, off_t *size)
+{
+    struct stat st;
+    char path[200], base[MAX_STR_LEN];
+    int depth, ret;
+
+    *mtime = 0;
+    *size = 0;
+    strlcpy(base, file_name, sizeof(base));
+    for (depth = 0; depth <= UCM_MAX_INHERIT_DEPTH; depth++) {
+        strlcpy(path, ucm_config_dir, sizeof(path));
+        strlcat(path, base, sizeof(path));
+        if (stat(path, &st) < 0) {
+            LOGE("failed to stat %s error %d\n", path, errno);
+            return -EINVAL;
+        }
+        if (st.st_mtime > *mtime)
+            *mtime = st.st_mtime;
+        *size += st.st_size;
+        ret = snd_ucm_get_inherit(path, base, sizeof(base));
+        if (ret <= 0)
+            return ret;
+    }
+    LOGE("Too many levels of inheritance from %s", file_name);
+    return -ELOOP;
+}
+
+/* Split a config file text into its sections
+ * buf - NUL terminated config file text
+ * sects - returns the allocated array of sections
+ * Returns the number of sections, negative error code otherwise
+ */
+static int snd_ucm_text_sections(const char *buf, ucm_text_sect_t **sects)
+{
+    ucm_text_sect_t *list = NULL, *tmp, *sect = NULL;
+    const char *line, *next, *p, *end;
+    int count = 0, alloc = 0;
+
+    for (line = buf; *line != '\0'; line = next) {
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+        if (sect == NULL) {
+            if (strncasecmp(line, "Section", 7))
+                continue;
+            if (count == alloc) {
+                alloc = alloc ? alloc * 2 : 32;
+                tmp = (ucm_text_sect_t *)realloc(list, alloc * sizeof(ucm_text_sect_t));
+                if (tmp == NULL) {
+                    free(list);
+                    return -ENOMEM;
+                }
+                list = tmp;
+            }
+            sect = &list[count++];
+            memset(sect, 0, sizeof(ucm_text_sect_t));
+            sect->start = line;
+            sect->type = line;
+            for (p = line; (*p != '\0') && !isspace(*p); p++)
+                ;
+            sect->type_len = p - line;
+        } else if (!strncasecmp(line, "EndSection", 10)) {
+            sect->len = next - sect->start;
+            sect = NULL;
+        } else if ((sect->name == NULL) && (strcasestr(line, "Name") != NULL) &&
+                   ((p = strchr(line, '\"')) != NULL) && (p < next) &&
+                   ((end = strchr(p + 1, '\"')) != NULL) && (end < next)) {
+            sect->name = p + 1;
+            sect->name_len = end - p - 1;
+        }
+    }
+    if (sect != NULL)
+        sect->len = strlen(sect->start);
+    *sects = list;
+    return count;
+}
+
+/* Read a verb config file, merging in the sections of the files it
+ * inherits from
+ * file_name - verb config file name
+ * depth - inheritance level of the file
+ * len - returns the length of the text
+ * Returns the NUL terminated text, NULL on failure
+ */
+static char *snd_ucm_read_verb_file(const char *file_name, int depth, size_t *len)
+{
+    struct stat st;
+    ucm_text_sect_t *own = NULL, *inh = NULL;
+    char path[200], base[MAX_STR_LEN];
+    char *text = NULL, *inherited = NULL, *merged = NULL, *out, *used = NULL;
+    const char *pos;
+    size_t inh_len = 0;
+    int fd, ret, own_count, inh_count, index, match;
+
+    strlcpy(path, ucm_config_dir, sizeof(path));
+    strlcat(path, file_name, sizeof(path));
+    LOGV("path:%s", path);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE("failed to open config file %s error %d\n", path, errno);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0) {
+        LOGE("failed to stat %s error %d\n", path, errno);
+        close(fd);
+        return NULL;
+    }
+    text = (char *)malloc(st.st_size + 1);
+    if (text == NULL) {
+        close(fd);
+        return NULL;
+    }
+    if (read(fd, text, st.st_size) != st.st_size) {
+        LOGE("failed to read config file %s error %d\n", path, errno);
+        close(fd);
+        free(text);
+        return NULL;
+    }
+    close(fd);
+    text[st.st_size] = '\0';
+    *len = st.st_size;
+
+    ret = snd_ucm_get_inherit(path, base, sizeof(base));
+    if (ret <= 0) {
+        if (ret < 0) {
+            free(text);
+            return NULL;
+        }
+        return text;
+    }
+    if (depth >= UCM_MAX_INHERIT_DEPTH) {
+        LOGE("Too many levels of inheritance from %s", file_name);
+        free(text);
+        return NULL;
+    }
+    inherited = snd_ucm_read_verb_file(base, depth + 1, &inh_len);
+    if (inherited == NULL) {
+        free(text);
+        return NULL;
+    }
+    own_count = snd_ucm_text_sections(text, &own);
+    inh_count = snd_ucm_text_sections(inherited, &inh);
+    if ((own_count < 0) || (inh_count < 0))
+        goto out;
+    used = (char *)calloc(own_count + 1, sizeof(char));
+    merged = (char *)malloc(*len + inh_len + own_count + 1);
+    if ((used == NULL) || (merged == NULL)) {
+        free(merged);
+        merged = NULL;
+        goto out;
+    }
+    /* Inherited text in order, sections of the same type and name are
+     * taken from the file itself and the remaining ones appended */
+    out = merged;
+    pos = inherited;
+    for (index = 0; index < inh_count; index++) {
+        memcpy(out, pos, inh[index].start - pos);
+        out += inh[index].start - pos;
+        pos = inh[index].start + inh[index].len;
+        for (match = 0; match < own_count; match++) {
+            if (!used[match] && (own[match].type_len == inh[index].type_len) &&
+                (own[match].name_len == inh[index].name_len) && own[match].name &&
+                inh[index].name &&
+                !strncasecmp(own[match].type, inh[index].type, inh[index].type_len) &&
+                !strncmp(own[match].name, inh[index].name, inh[index].name_len))
+                break;
+        }
+        if (match < own_count) {
+            used[match] = 1;
+            memcpy(out, own[match].start, own[match].len);
+            out += own[match].len;
+        } else {
+            memcpy(out, inh[index].start, inh[index].len);
+            out += inh[index].len;
+        }
+    }
+    memcpy(out, pos, strlen(pos));
+    out += strlen(pos);
+    for (match = 0; match < own_count; match++) {
+        if (used[match])
+            continue;
+        if ((out > merged) && (out[-1] != '\n'))
+            *out++ = '\n';
+        memcpy(out, own[match].start, own[match].len);
+        out += own[match].len;
+    }
+    *out = '\0';
+    *len = out - merged;
+out:
+    free(used);
+    free(own);
+    free(inh);
+    free(inherited);
+    free(text);
+    return merged;
+}
+
 /* Parse a use case verb config files and update mixer controls for the verb
  * uc_mgr - use case manager structure
  * file_name - use case verb config file name
@@ -1509,41 +3610,57 @@ static int get_verb_count(const char *nxt_str)
  */
 static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name, int index)
 {
-    struct stat st;
+    time_t mtime;
+    off_t size;
+    char *text;
+    size_t len;
+    int ret;
+
+    ret = snd_ucm_stat_verb_file(file_name, &mtime, &size);
+    if (ret < 0)
+        return ret;
+    text = snd_ucm_read_verb_file(file_name, 0, &len);
+    if (text == NULL)
+        return -EINVAL;
+    (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].file_mtime = mtime;
+    (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].file_size = size;
+    ret = snd_ucm_parse_verb_text(uc_mgr, text, len, index);
+    free(text);
+    return ret;
+}
+
+/* Parse the text of a use case verb config file and update mixer controls
+ * for the verb
+ * uc_mgr - use case manager structure
+ * text - NUL terminated config file text, inherited sections merged in
+ * len - length of the text
+ * index - index of the verb in the list
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_parse_verb_text(snd_use_case_mgr_t **uc_mgr, const char *text, size_t len, int index)
+{
     card_mctrl_t *list;
+    ucm_arena_t *arena = &(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].arena;
     int device_count, modifier_count;
-    int fd, ret = 0, parse_count = 0;
+    int ret = 0, parse_count = 0;
     char *read_buf, *next_str, *current_str, *verb_ptr;
-    char path[200];
 
-    strlcpy(path, CONFIG_DIR, (strlen(CONFIG_DIR)+1));
-    strlcat(path, file_name, sizeof(path));
-    LOGV("path:%s", path);
     while(1) {
         device_count = 0; modifier_count = 0;
         if (parse_count == 0) {
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count = 0;
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].device_list = NULL;
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].modifier_list = NULL;
-            (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl = NULL;
-        }
-        fd = open(path, O_RDONLY);
-        if (fd < 0) {
-             LOGE("failed to open config file %s error %d\n", path, errno);
-             return -EINVAL;
-        }
-        if (fstat(fd, &st) < 0) {
-            LOGE("failed to stat %s error %d\n", path, errno);
-            close(fd);
-            return -EINVAL;
-        }
-        read_buf = (char *) mmap(0, st.st_size, PROT_READ | PROT_WRITE,
-                   MAP_PRIVATE, fd, 0);
-        if (read_buf == MAP_FAILED) {
-            LOGE("failed to mmap file error %d\n", errno);
-            close(fd);
-            return -EINVAL;
+            (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl = NULL;
+            (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].section_hash = NULL;
+            (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].ctl_values = NULL;
+            (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].section_hash_size = 0;
         }
+        /* Each pass tokenizes its own copy of the text */
+        read_buf = (char *)malloc(len + 1);
+        if (read_buf == NULL)
+            return -ENOMEM;
+        memcpy(read_buf, text, len + 1);
         current_str = read_buf;
         while (*current_str != (char)EOF)  {
             next_str = strchr(current_str, '\n');
@@ -1569,14 +3686,8 @@ static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name
                     } else {
                         list = ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl +
                             ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count - 1));
-                        verb_ptr = (char *)malloc((strlen(list->case_name)+1)*sizeof(char));
-                        if (verb_ptr == NULL) {
-                            ret = -ENOMEM;
-                            break;
-                        }
-                        strlcpy(verb_ptr, list->case_name, ((strlen(list->case_name)+1)*sizeof(char)));
                         (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].device_list[device_count]
-                            = verb_ptr;
+                            = list->case_name;
                         device_count++;
                     }
                 }
@@ -1591,14 +3702,8 @@ static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name
                     } else {
                         list = ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl +
                             ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count - 1));
-                        verb_ptr = (char *)malloc((strlen(list->case_name)+1)*sizeof(char));
-                        if (verb_ptr == NULL) {
-                            ret = -ENOMEM;
-                            break;
-                        }
-                        strlcpy(verb_ptr, list->case_name, ((strlen(list->case_name)+1)*sizeof(char)));
                         (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].modifier_list[modifier_count]
-                            = verb_ptr;
+                            = list->case_name;
                         modifier_count++;
                     }
                 }
@@ -1606,22 +3711,21 @@ static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name
             if((current_str = next_str) == NULL)
                 break;
         }
-        munmap(read_buf, st.st_size);
-        close(fd);
+        free(read_buf);
         if(ret < 0)
             return ret;
         if (parse_count == 0) {
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].device_list =
-                (char **)malloc((device_count+1)*sizeof(char *));
+                (char **)snd_ucm_arena_alloc(arena, (device_count+1)*sizeof(char *));
             if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].device_list == NULL)
                 return -ENOMEM;
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].modifier_list =
-                (char **)malloc((modifier_count+1)*sizeof(char *));
+                (char **)snd_ucm_arena_alloc(arena, (modifier_count+1)*sizeof(char *));
             if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].modifier_list == NULL)
                 return -ENOMEM;
             parse_count = (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count;
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl =
-                (card_mctrl_t *)malloc((parse_count+1)*sizeof(card_mctrl_t));
+                (card_mctrl_t *)snd_ucm_arena_alloc(arena, (parse_count+1)*sizeof(card_mctrl_t));
             if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl == NULL) {
                ret = -ENOMEM;
                break;
@@ -1629,27 +3733,16 @@ static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count = 0;
             continue;
         } else {
-            verb_ptr = (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
+            verb_ptr = snd_ucm_intern((*uc_mgr)->card_ctxt_ptr->str_pool, SND_UCM_END_OF_LIST);
             if (verb_ptr == NULL)
                 return -ENOMEM;
-            strlcpy(verb_ptr, SND_UCM_END_OF_LIST, ((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char)));
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].device_list[device_count]
                 = verb_ptr;
-            verb_ptr = (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
-            if (verb_ptr == NULL)
-                return -ENOMEM;
-            strlcpy(verb_ptr, SND_UCM_END_OF_LIST, ((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char)));
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].modifier_list[modifier_count]
                 = verb_ptr;
             list = ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl +
                     (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].use_case_count);
-            list->case_name = (char *)malloc((strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
-            if(list->case_name == NULL) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index].card_ctrl);
-                return -ENOMEM;
-            }
-            strlcpy(list->case_name, SND_UCM_END_OF_LIST,
-               (strlen(SND_UCM_END_OF_LIST)+1)*sizeof(char));
+            list->case_name = verb_ptr;
             list->ena_mixer_list = NULL;
             list->dis_mixer_list = NULL;
             list->ena_mixer_count = 0;
@@ -1658,7 +3751,16 @@ static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name
             list->capture_dev_name = NULL;
             list->acdb_id = 0;
             list->capability = 0;
+            list->ena_shared = NULL;
+            list->dis_shared = NULL;
             parse_count = 0;
+            ret = snd_ucm_index_verb(&(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index]);
+            if (!ret && (*uc_mgr)->card_ctxt_ptr->mixer_handle)
+                ret = snd_ucm_bind_verb((*uc_mgr)->card_ctxt_ptr->mixer_handle,
+                          &(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index]);
+            if (!ret)
+                snd_ucm_intern_verb((*uc_mgr)->card_ctxt_ptr,
+                    &(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[index]);
             break;
         }
     }
@@ -1755,9 +3857,14 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
     char **nxt_str, int verb_index)
 {
     card_mctrl_t *list;
+    ucm_arena_t *arena = &(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].arena;
+    ucm_str_pool_t *pool = (*uc_mgr)->card_ctxt_ptr->str_pool;
+    ucm_arena_mark_t mark;
     int enable_seq = 0, disable_seq = 0, controls_count = 0, ret = 0;
     char *p, *current_str, *next_str, *name;
 
+    /* Control lists go to the pool, their arena copies are dropped */
+    snd_ucm_arena_mark(arena, &mark);
     list = ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl +
             (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count);
     list->case_name = NULL;
@@ -1769,6 +3876,8 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
     list->capture_dev_name = NULL;
     list->acdb_id = 0;
     list->capability = 0;
+    list->ena_shared = NULL;
+    list->dis_shared = NULL;
     current_str = *cur_str; next_str = *nxt_str;
     while(strncasecmp(current_str, "EndSection", 10)) {
         current_str = next_str;
@@ -1785,7 +3894,7 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
                 LOGE("Error: improper config file\n");
         }
         if (enable_seq == 1) {
-            ret = snd_ucm_extract_controls(current_str, &list->ena_mixer_list, list->ena_mixer_count);
+            ret = snd_ucm_extract_controls(arena, pool, current_str, &list->ena_mixer_list, list->ena_mixer_count);
             if (ret < 0) {
                 LOGV("Failed extracting a control, ignore and parse next control\n");
                 break;
@@ -1793,7 +3902,7 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
                 list->ena_mixer_count++;
             }
         } else if (disable_seq == 1) {
-            ret = snd_ucm_extract_controls(current_str, &list->dis_mixer_list, list->dis_mixer_count);
+            ret = snd_ucm_extract_controls(arena, pool, current_str, &list->dis_mixer_list, list->dis_mixer_count);
             if (ret < 0) {
                 LOGV("Failed extracting a control, ignore and parse next control\n");
                 break;
@@ -1801,17 +3910,17 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
                 list->dis_mixer_count++;
             }
         } else if (strcasestr(current_str, "Name") != NULL) {
-            ret = snd_ucm_extract_name(current_str, &list->case_name);
+            ret = snd_ucm_extract_name(pool, current_str, &list->case_name);
             if (ret < 0)
                 break;
             LOGV("Name of section is %s\n", list->case_name);
         } else if (strcasestr(current_str, "PlaybackPCM") != NULL) {
-            ret = snd_ucm_extract_dev_name(current_str, &list->playback_dev_name);
+            ret = snd_ucm_extract_dev_name(pool, current_str, &list->playback_dev_name);
             if (ret < 0)
                 break;
             LOGV("Device name of playback is %s\n", list->playback_dev_name);
         } else if (strcasestr(current_str, "CapturePCM") != NULL) {
-            ret = snd_ucm_extract_dev_name(current_str, &list->capture_dev_name);
+            ret = snd_ucm_extract_dev_name(pool, current_str, &list->capture_dev_name);
             if (ret < 0)
                 break;
             LOGV("Device name of capture is %s\n", list->capture_dev_name);
@@ -1827,7 +3936,8 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
                 ret = -ENOMEM;
                 break;
             }
-            list->ena_mixer_list = (mixer_control_t *)malloc((controls_count*sizeof(mixer_control_t)));
+            list->ena_mixer_list = (mixer_control_t *)snd_ucm_arena_alloc(arena,
+                controls_count*sizeof(mixer_control_t));
             if (list->ena_mixer_list == NULL) {
                 ret = -ENOMEM;
                 break;
@@ -1839,7 +3949,8 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
                 ret = -ENOMEM;
                 break;
             }
-            list->dis_mixer_list = (mixer_control_t *)malloc((controls_count*sizeof(mixer_control_t)));
+            list->dis_mixer_list = (mixer_control_t *)snd_ucm_arena_alloc(arena,
+                controls_count*sizeof(mixer_control_t));
             if (list->dis_mixer_list == NULL) {
                 ret = -ENOMEM;
                 break;
@@ -1850,15 +3961,24 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
              break;
     }
     if ((list->case_name == NULL) && (ret == 0)) {
-        list->case_name = (char *)malloc((strlen((*uc_mgr)->card_ctxt_ptr->card_name)+1)*sizeof(char));
-        if(list->case_name == NULL) {
-            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl);
+        list->case_name = snd_ucm_intern(pool, (*uc_mgr)->card_ctxt_ptr->card_name);
+        if(list->case_name == NULL)
             return -ENOMEM;
-        }
-        strlcpy(list->case_name, (*uc_mgr)->card_ctxt_ptr->card_name,
-            (strlen((*uc_mgr)->card_ctxt_ptr->card_name)+1)*sizeof(char));
     }
     if(ret == 0) {
+        /* Identical control lists of other sections and verbs are shared */
+        list->ena_mixer_list = snd_ucm_share_controls((*uc_mgr)->card_ctxt_ptr->ctl_pool,
+            list->ena_mixer_list, list->ena_mixer_count, &list->ena_shared);
+        list->dis_mixer_list = snd_ucm_share_controls((*uc_mgr)->card_ctxt_ptr->ctl_pool,
+            list->dis_mixer_list, list->dis_mixer_count, &list->dis_shared);
+        if ((list->ena_shared || !list->ena_mixer_count) &&
+            (list->dis_shared || !list->dis_mixer_count)) {
+            snd_ucm_arena_reset(arena, &mark);
+            if (!list->ena_mixer_count)
+                list->ena_mixer_list = NULL;
+            if (!list->dis_mixer_count)
+                list->dis_mixer_list = NULL;
+        }
         *cur_str = current_str; *nxt_str = next_str;
         (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count++;
     }
@@ -1868,7 +3988,7 @@ static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str,
 /* Extract a mixer control name from config file
  * Returns 0 on sucess, negative error code otherwise
  */
-static int snd_ucm_extract_name(char *buf, char **case_name)
+static int snd_ucm_extract_name(ucm_str_pool_t *pool, char *buf, char **case_name)
 {
     int ret = 0;
     char *p, *name = *case_name, *temp_ptr;
@@ -1878,12 +3998,11 @@ static int snd_ucm_extract_name(char *buf, char **case_name)
         p = strtok_r(NULL, "\"", &temp_ptr);
         if (p == NULL)
             break;
-        name = (char *)malloc((strlen(p)+1)*sizeof(char));
+        name = snd_ucm_intern(pool, p);
         if(name == NULL) {
             ret = -ENOMEM;
             break;
         }
-        strlcpy(name, p, (strlen(p)+1)*sizeof(char));
         *case_name = name;
         break;
     }
@@ -1918,12 +4037,12 @@ static int snd_ucm_extract_acdb(char *buf, int *id, int *cap)
 /* Extract a playback and capture device name of use case from config file
  * Returns 0 on sucess, negative error code otherwise
  */
-static int snd_ucm_extract_dev_name(char *buf, char **dev_name)
+static int snd_ucm_extract_dev_name(ucm_str_pool_t *pool, char *buf, char **dev_name)
 {
     char key[] = "0123456789";
     char *p, *name = *dev_name;
     char dev_pre[] = "hw:0,";
-    char *temp_ptr;
+    char *temp_ptr, dev[MAX_STR_LEN];
 
     p = strpbrk(buf, key);
     if (p == NULL) {
@@ -1933,11 +4052,11 @@ static int snd_ucm_extract_dev_name(char *buf, char **dev_name)
         if (p == NULL) {
             *dev_name = NULL;
         } else {
-            name = (char *)malloc((strlen(p)+strlen(dev_pre)+1)*sizeof(char));
+            strlcpy(dev, dev_pre, sizeof(dev));
+            strlcat(dev, p, sizeof(dev));
+            name = snd_ucm_intern(pool, dev);
             if(name == NULL)
                  return -ENOMEM;
-            strlcpy(name, dev_pre, (strlen(p)+strlen(dev_pre)+1)*sizeof(char));
-            strlcat(name, p, (strlen(p)+strlen(dev_pre)+1)*sizeof(char));
             *dev_name = name;
         }
     }
@@ -1970,7 +4089,8 @@ static int get_num_values(const char *buf)
 /* Extract a mixer control from config file
  * Returns 0 on sucess, negative error code otherwise
  */
-static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int size)
+static int snd_ucm_extract_controls(ucm_arena_t *arena, ucm_str_pool_t *pool, char *buf,
+    mixer_control_t **mixer_list, int size)
 {
     uint32_t temp;
     int ret = -EINVAL, i, index = 0, count = 0;
@@ -1985,17 +4105,16 @@ static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int
         if (p == NULL)
             break;
         list = ((*mixer_list)+size);
-        list->control_name = (char *)malloc((strlen(p)+1)*sizeof(char));
+        list->control_name = snd_ucm_intern(pool, p);
         if(list->control_name == NULL) {
             ret = -ENOMEM;
             break;
         }
-        strlcpy(list->control_name, p, (strlen(p)+1)*sizeof(char));
+        list->ctl = NULL;
+        list->values = NULL;
         p = strtok_r(NULL, ":", &temp_ptr);
-        if (p == NULL) {
-            free(list->control_name);
+        if (p == NULL)
             break;
-        }
         if(!strncmp(p, "0", 1)) {
             list->type = TYPE_STR;
         } else if(!strncmp(p, "1", 1)) {
@@ -2006,35 +4125,40 @@ static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int
             LOGE("Unknown type: p %s\n", p);
         }
         p = strtok_r(NULL, seps, &temp_ptr);
-        if (p == NULL) {
-            free(list->control_name);
+        if (p == NULL)
             break;
-        }
         if(list->type == TYPE_INT) {
             list->value = atoi(p);
             list->string = NULL;
             list->mulval = NULL;
         } else if(list->type == TYPE_STR) {
             list->value = -1;
-            list->string = (char *)malloc((strlen(p)+1)*sizeof(char));
+            list->string = snd_ucm_intern(pool, p);
             list->mulval = NULL;
             if(list->string == NULL) {
                 ret = -ENOMEM;
-                free(list->control_name);
                 break;
             }
-            strlcpy(list->string, p, (strlen(p)+1)*sizeof(char));
         } else if(list->type == TYPE_MULTI_VAL) {
             if (p != NULL) {
                 count = get_num_values(p);
-                list->mulval = (char **)malloc(count*sizeof(char *));
+                if (count < 0) {
+                    ret = count;
+                    break;
+                }
+                list->mulval = (char **)snd_ucm_arena_alloc(arena, count*sizeof(char *));
+                if (list->mulval == NULL) {
+                    ret = -ENOMEM;
+                    break;
+                }
                 index = 0;
                 /* To support volume values in percentage */
                 if ((count == 1) && (strstr(p, "%") != NULL)) {
                     pmv = strtok_r(p, " ", &temp_vol_ptr);
                     while (pmv != NULL) {
-                        list->mulval[index] = (char *)malloc((strlen(pmv)+1)*sizeof(char));
-                        strlcpy(list->mulval[index], pmv, (strlen(pmv)+1));
+                        list->mulval[index] = snd_ucm_intern(pool, pmv);
+                        if (list->mulval[index] == NULL)
+                            break;
                         index++;
                         pmv = strtok_r(NULL, " ", &temp_vol_ptr);
                         if (pmv == NULL)
@@ -2044,15 +4168,20 @@ static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int
                     pmv = strtok_r(p, " ", &temp_vol_ptr);
                     while (pmv != NULL) {
                         temp = (uint32_t)strtoul(pmv, &ps, 16);
-                        snprintf(temp_coeff, sizeof(temp_coeff),"%lu", temp);
-                        list->mulval[index] = (char *)malloc((strlen(temp_coeff)+1)*sizeof(char));
-                        strlcpy(list->mulval[index], temp_coeff, (strlen(temp_coeff)+1));
+                        snprintf(temp_coeff, sizeof(temp_coeff),"%u", temp);
+                        list->mulval[index] = snd_ucm_intern(pool, temp_coeff);
+                        if (list->mulval[index] == NULL)
+                            break;
                         index++;
                         pmv = strtok_r(NULL, " ", &temp_vol_ptr);
                         if (pmv == NULL)
                             break;
                     }
                 }
+                if (index < count) {
+                    ret = -ENOMEM;
+                    break;
+                }
                 list->value = count;
                 list->string = NULL;
             }
@@ -2069,271 +4198,868 @@ static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int
 
 void snd_ucm_free_mixer_list(snd_use_case_mgr_t **uc_mgr)
 {
-    int case_index = 0, index = 0, verb_index = 0, mul_index = 0;
+    card_mctrl_t *section;
+    int case_index = 0, verb_index = 0;
 
     pthread_mutex_lock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
+    if ((*uc_mgr)->card_ctxt_ptr->verb_list == NULL) {
+        pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
+        return;
+    }
     while(strncmp((*uc_mgr)->card_ctxt_ptr->verb_list[verb_index], SND_UCM_END_OF_LIST, 3)) {
-        for(case_index = 0; case_index < (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count; case_index++) {
-            for(index = 0; index < (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_count; index++) {
-                if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].control_name) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].control_name);
-                }
-                if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].string) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].string);
-                }
-                if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].mulval) {
-                    for(mul_index = 0;
-                        mul_index < (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].value;
-                        mul_index++) {
-                        free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].mulval[mul_index]);
-                    }
-                    if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].mulval)
-                        free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list[index].mulval);
-                }
-            }
-            for(index = 0; index < (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_count; index++) {
-                if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list[index].control_name) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list[index].control_name);
-                }
-                if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list[index].string) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list[index].string);
-                }
-            }
-            if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].case_name) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].case_name);
-            }
-            if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].ena_mixer_list);
-            }
-            if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].dis_mixer_list);
-            }
-            if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].playback_dev_name) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].playback_dev_name);
-            }
-            if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].capture_dev_name) {
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index].capture_dev_name);
-            }
-        }
-        index = 0;
-        while(1) {
-            if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index]) {
-                if (!strncmp((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index],
-                    SND_UCM_END_OF_LIST, 3)) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index]);
-                    break;
-                } else {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list[index]);
-                    index++;
-                }
-            }
+        if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].cached) {
+            /* Sections and lists of verbs loaded from the compiled config
+             * live in the mapping */
+            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_name);
+            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].file_name);
+            snd_ucm_arena_free(&(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].arena);
+            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].ctl_values);
+            free((*uc_mgr)->card_ctxt_ptr->verb_list[verb_index]);
+            verb_index++;
+            continue;
         }
-        if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list)
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].device_list);
-        index = 0;
-        while(1) {
-            if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index]) {
-                if (!strncmp((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index],
-                    SND_UCM_END_OF_LIST, 3)) {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index]);
-                    break;
-                } else {
-                    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list[index]);
-                    index++;
-                }
-            }
+        /* Verbs not loaded or failed to load have some of the lists unset,
+         * all but the shared control lists live in the arena of the verb */
+        for(case_index = 0; ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl != NULL) &&
+            (case_index < (*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_count); case_index++) {
+            section = &(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].card_ctrl[case_index];
+            if (section->ena_shared)
+                snd_ucm_release_controls((*uc_mgr)->card_ctxt_ptr->ctl_pool, section->ena_shared);
+            if (section->dis_shared)
+                snd_ucm_release_controls((*uc_mgr)->card_ctxt_ptr->ctl_pool, section->dis_shared);
         }
-        if ((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list)
-                free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].modifier_list);
+        snd_ucm_arena_free(&(*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].arena);
         if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_name)
             free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].use_case_name);
+        if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].file_name)
+            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].file_name);
+        if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].ctl_values)
+            free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list[verb_index].ctl_values);
         if((*uc_mgr)->card_ctxt_ptr->verb_list[verb_index]) {
             free((*uc_mgr)->card_ctxt_ptr->verb_list[verb_index]);
         }
         verb_index++;
     }
-    if((*uc_mgr)->card_ctxt_ptr->use_case_verb_list)
-        free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list);
-    if((*uc_mgr)->card_ctxt_ptr->verb_list)
-        free((*uc_mgr)->card_ctxt_ptr->verb_list);
+    free((*uc_mgr)->card_ctxt_ptr->verb_list[verb_index]);
+    free((*uc_mgr)->card_ctxt_ptr->use_case_verb_list);
+    (*uc_mgr)->card_ctxt_ptr->use_case_verb_list = NULL;
+    free((*uc_mgr)->card_ctxt_ptr->verb_list);
+    (*uc_mgr)->card_ctxt_ptr->verb_list = NULL;
+    (*uc_mgr)->card_ctxt_ptr->verb_count = 0;
+    if ((*uc_mgr)->card_ctxt_ptr->cache_addr != NULL) {
+        free((*uc_mgr)->card_ctxt_ptr->cache_ctrl);
+        (*uc_mgr)->card_ctxt_ptr->cache_ctrl = NULL;
+        free((*uc_mgr)->card_ctxt_ptr->cache_mixer);
+        (*uc_mgr)->card_ctxt_ptr->cache_mixer = NULL;
+        free((*uc_mgr)->card_ctxt_ptr->cache_str);
+        (*uc_mgr)->card_ctxt_ptr->cache_str = NULL;
+        munmap((*uc_mgr)->card_ctxt_ptr->cache_addr, (*uc_mgr)->card_ctxt_ptr->cache_size);
+        (*uc_mgr)->card_ctxt_ptr->cache_addr = NULL;
+        (*uc_mgr)->card_ctxt_ptr->cache_size = 0;
+    }
     pthread_mutex_unlock(&(*uc_mgr)->card_ctxt_ptr->card_lock);
 }
 
-/* Add an identifier to the respective list
- * head - list head
- * value - node value that needs to be added
+/* Continue hashing with a NUL terminated string (FNV-1a), hashing two
+ * strings in a row gives the hash of their concatenation */
+static uint32_t snd_ucm_hash_add(uint32_t hash, const char *str)
+{
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t snd_ucm_hash(const char *str)
+{
+    return snd_ucm_hash_add(UCM_HASH_INIT, str);
+}
+
+/* Path of the compiled config for a card */
+static void snd_ucm_cache_path(card_ctxt_t *card_ctxt, char *path, size_t size)
+{
+    strlcpy(path, ucm_cache_dir, size);
+    strlcat(path, card_ctxt->card_name, size);
+    strlcat(path, UCM_CACHE_SUFFIX, size);
+}
+
+/* Add a string to the compiled config string table
+ * off - returns offset of the string, UCM_CACHE_NONE for a NULL string
  * Returns 0 on sucess, negative error code otherwise
  */
-static int snd_ucm_add_ident_to_list(struct snd_ucm_ident_node **head, const char *value)
+static int ucm_strtab_add(ucm_strtab_t *tab, const char *str, uint32_t *off)
 {
-    struct snd_ucm_ident_node *temp, *node;
+    uint32_t i, j, size, len, *hash;
+    char *buf;
 
-    node = (struct snd_ucm_ident_node *)malloc(sizeof(struct snd_ucm_ident_node));
-    if (node == NULL) {
-        LOGE("Failed to allocate memory for new node");
-        return -ENOMEM;
-    } else {
-        node->next = NULL;
-        strlcpy(node->ident, value, MAX_STR_LEN);
-        node->active = 0;
+    if (str == NULL) {
+        *off = UCM_CACHE_NONE;
+        return 0;
     }
-    if (*head == NULL) {
-        *head = node;
-    } else {
-        temp = *head;
-        while (temp->next != NULL) {
-            temp = temp->next;
+    if ((tab->count + 1) * 2 > tab->hash_size) {
+        size = tab->hash_size ? tab->hash_size * 2 : 256;
+        hash = (uint32_t *)calloc(size, sizeof(uint32_t));
+        if (hash == NULL)
+            return -ENOMEM;
+        /* Slots hold offset + 1 so that 0 marks a free slot */
+        for (i = 0; i < tab->hash_size; i++) {
+            if (!tab->hash[i])
+                continue;
+            j = snd_ucm_hash(tab->buf + tab->hash[i] - 1) & (size - 1);
+            while (hash[j])
+                j = (j + 1) & (size - 1);
+            hash[j] = tab->hash[i];
         }
-        temp->next = node;
+        free(tab->hash);
+        tab->hash = hash;
+        tab->hash_size = size;
     }
-    LOGV("add_to_list: head %p, value %s", *head, node->ident);
+    i = snd_ucm_hash(str) & (tab->hash_size - 1);
+    while (tab->hash[i]) {
+        if (!strcmp(tab->buf + tab->hash[i] - 1, str)) {
+            *off = tab->hash[i] - 1;
+            return 0;
+        }
+        i = (i + 1) & (tab->hash_size - 1);
+    }
+    len = strlen(str) + 1;
+    if (tab->len + len > tab->size) {
+        size = tab->size ? tab->size : 4096;
+        while (size < tab->len + len)
+            size *= 2;
+        buf = (char *)realloc(tab->buf, size);
+        if (buf == NULL)
+            return -ENOMEM;
+        tab->buf = buf;
+        tab->size = size;
+    }
+    memcpy(tab->buf + tab->len, str, len);
+    *off = tab->len;
+    tab->hash[i] = tab->len + 1;
+    tab->len += len;
+    tab->count++;
     return 0;
 }
 
-/* Get the status of identifier at particulare index of the list
- * head - list head
- * ident - identifier value for which status needs to be get
- * status - status to be set (1 - active, 0 - inactive)
- */
-static int snd_ucm_get_status_at_index(struct snd_ucm_ident_node *head, const char *ident)
+/* Add count strings of a list to the compiled config string list */
+static int ucm_cache_add_list(ucm_strtab_t *tab, uint32_t *strs, uint32_t *str_count,
+    char **list, int count)
 {
-    while (head != NULL) {
-        if(!strncmp(ident, head->ident, (strlen(head->ident)+1))) {
-            break;
+    int index, ret;
+
+    for (index = 0; index < count; index++) {
+        ret = ucm_strtab_add(tab, list[index], &strs[(*str_count)++]);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/* Add a control sequence to the compiled config control table */
+static int ucm_cache_add_controls(ucm_strtab_t *tab, ucm_cache_ctl_t *ctls, uint32_t *ctl_count,
+    uint32_t *strs, uint32_t *str_count, mixer_control_t *mixer_list, int count)
+{
+    ucm_cache_ctl_t *ctl;
+    int index, ret;
+
+    for (index = 0; index < count; index++) {
+        ctl = &ctls[(*ctl_count)++];
+        ctl->type = mixer_list[index].type;
+        ctl->value = mixer_list[index].value;
+        ctl->mulval = UCM_CACHE_NONE;
+        ret = ucm_strtab_add(tab, mixer_list[index].control_name, &ctl->name);
+        if (ret == 0)
+            ret = ucm_strtab_add(tab, mixer_list[index].string, &ctl->string);
+        if ((ret == 0) && (mixer_list[index].type == TYPE_MULTI_VAL) &&
+            (mixer_list[index].mulval != NULL)) {
+            ctl->mulval = *str_count;
+            ret = ucm_cache_add_list(tab, strs, str_count, mixer_list[index].mulval,
+                mixer_list[index].value);
         }
-        head = head->next;
+        if (ret < 0)
+            return ret;
     }
-    if (head == NULL) {
-        LOGV("Element not found in the list");
-    } else {
-        return(head->active);
+    return 0;
+}
+
+/* Number of entries of an "end" terminated list, including the "end" entry */
+static int ucm_cache_list_size(char **list)
+{
+    int count = 0;
+
+    while (strncmp(list[count], SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST)+1))
+        count++;
+    return count + 1;
+}
+
+static int ucm_cache_write_buf(int fd, const void *buf, size_t size)
+{
+    const char *p = (const char *)buf;
+    ssize_t n;
+
+    while (size > 0) {
+        n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += n;
+        size -= n;
     }
-    return -EINVAL;
+    return 0;
 }
 
-/* Set the status of identifier at particulare index of the list
- * head - list head
- * ident - identifier value for which status needs to be set
- * status - status to be set (1 - active, 0 - inactive)
+/* Write the parsed config of all verbs to the compiled config file
+ * uc_mgr - use case manager structure
+ * Returns 0 on sucess, negative error code otherwise
  */
-static void snd_ucm_set_status_at_index(struct snd_ucm_ident_node *head, const char *ident, int status)
+static int snd_ucm_cache_write(snd_use_case_mgr_t *uc_mgr)
 {
-    while (head != NULL) {
-        if(!strncmp(ident, head->ident, (strlen(head->ident)+1))) {
-            break;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    use_case_verb_t *verb;
+    card_mctrl_t *list;
+    ucm_cache_hdr_t hdr;
+    ucm_cache_file_t *files = NULL;
+    ucm_cache_verb_t *verbs = NULL;
+    ucm_cache_sect_t *sects = NULL;
+    ucm_cache_ctl_t *ctls = NULL;
+    uint32_t *strs = NULL, nverbs = 0, nsects = 0, nctls = 0, nstrs = 0, ncount = 0;
+    ucm_strtab_t tab;
+    char path[200], tmp_path[240];
+    int fd, verb_index, case_index, index, ret = 0;
+
+    memset(&tab, 0, sizeof(tab));
+    memset(&hdr, 0, sizeof(hdr));
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    /* Size all the tables first */
+    while (strncmp(card_ctxt->verb_list[nverbs], SND_UCM_END_OF_LIST, 3)) {
+        verb = &card_ctxt->use_case_verb_list[nverbs];
+        if ((verb->card_ctrl == NULL) || (verb->device_list == NULL) ||
+            (verb->modifier_list == NULL) || (verb->file_name == NULL)) {
+            pthread_mutex_unlock(&card_ctxt->card_lock);
+            return -EINVAL;
+        }
+        nsects += verb->use_case_count + 1;
+        nstrs += ucm_cache_list_size(verb->device_list) +
+            ucm_cache_list_size(verb->modifier_list);
+        for (case_index = 0; case_index < verb->use_case_count; case_index++) {
+            list = &verb->card_ctrl[case_index];
+            nctls += list->ena_mixer_count + list->dis_mixer_count;
+            for (index = 0; index < list->ena_mixer_count; index++) {
+                if (list->ena_mixer_list[index].type == TYPE_MULTI_VAL)
+                    nstrs += list->ena_mixer_list[index].value;
+            }
+            for (index = 0; index < list->dis_mixer_count; index++) {
+                if (list->dis_mixer_list[index].type == TYPE_MULTI_VAL)
+                    nstrs += list->dis_mixer_list[index].value;
+            }
         }
-        head = head->next;
+        nverbs++;
     }
-    if (head == NULL) {
-        LOGE("Element not found to set the status");
+    files = (ucm_cache_file_t *)calloc(nverbs + 1, sizeof(ucm_cache_file_t));
+    verbs = (ucm_cache_verb_t *)calloc(nverbs + 1, sizeof(ucm_cache_verb_t));
+    sects = (ucm_cache_sect_t *)calloc(nsects + 1, sizeof(ucm_cache_sect_t));
+    ctls = (ucm_cache_ctl_t *)calloc(nctls + 1, sizeof(ucm_cache_ctl_t));
+    strs = (uint32_t *)calloc(nstrs + 1, sizeof(uint32_t));
+    if (!files || !verbs || !sects || !ctls || !strs) {
+        ret = -ENOMEM;
+        goto unlock;
+    }
+
+    ret = ucm_strtab_add(&tab, card_ctxt->card_name, &hdr.card_name);
+    if (ret < 0)
+        goto unlock;
+    ret = ucm_strtab_add(&tab, card_ctxt->card_name, &files[0].name);
+    if (ret < 0)
+        goto unlock;
+    files[0].mtime = card_ctxt->config_mtime;
+    files[0].size = card_ctxt->config_size;
+    nsects = nctls = nstrs = 0;
+    for (verb_index = 0; verb_index < (int)nverbs; verb_index++) {
+        verb = &card_ctxt->use_case_verb_list[verb_index];
+        files[verb_index + 1].mtime = verb->file_mtime;
+        files[verb_index + 1].size = verb->file_size;
+        ret = ucm_strtab_add(&tab, verb->file_name, &files[verb_index + 1].name);
+        if (ret == 0)
+            ret = ucm_strtab_add(&tab, card_ctxt->verb_list[verb_index], &verbs[verb_index].name);
+        if (ret < 0)
+            goto unlock;
+        verbs[verb_index].file = verb_index + 1;
+        verbs[verb_index].sect_first = nsects;
+        verbs[verb_index].sect_count = verb->use_case_count;
+        ncount = ucm_cache_list_size(verb->device_list);
+        verbs[verb_index].dev_first = nstrs;
+        verbs[verb_index].dev_count = ncount - 1;
+        ret = ucm_cache_add_list(&tab, strs, &nstrs, verb->device_list, ncount);
+        if (ret < 0)
+            goto unlock;
+        ncount = ucm_cache_list_size(verb->modifier_list);
+        verbs[verb_index].mod_first = nstrs;
+        verbs[verb_index].mod_count = ncount - 1;
+        ret = ucm_cache_add_list(&tab, strs, &nstrs, verb->modifier_list, ncount);
+        if (ret < 0)
+            goto unlock;
+        /* Sections including the "end" entry */
+        for (case_index = 0; case_index <= verb->use_case_count; case_index++) {
+            list = &verb->card_ctrl[case_index];
+            sects[nsects].acdb_id = list->acdb_id;
+            sects[nsects].capability = list->capability;
+            ret = ucm_strtab_add(&tab, list->case_name, &sects[nsects].name);
+            if (ret == 0)
+                ret = ucm_strtab_add(&tab, list->playback_dev_name, &sects[nsects].playback_dev_name);
+            if (ret == 0)
+                ret = ucm_strtab_add(&tab, list->capture_dev_name, &sects[nsects].capture_dev_name);
+            if (ret < 0)
+                goto unlock;
+            sects[nsects].ena_first = nctls;
+            sects[nsects].ena_count = list->ena_mixer_count;
+            ret = ucm_cache_add_controls(&tab, ctls, &nctls, strs, &nstrs,
+                list->ena_mixer_list, list->ena_mixer_count);
+            if (ret < 0)
+                goto unlock;
+            sects[nsects].dis_first = nctls;
+            sects[nsects].dis_count = list->dis_mixer_count;
+            ret = ucm_cache_add_controls(&tab, ctls, &nctls, strs, &nstrs,
+                list->dis_mixer_list, list->dis_mixer_count);
+            if (ret < 0)
+                goto unlock;
+            nsects++;
+        }
+    }
+unlock:
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    if (ret < 0)
+        goto done;
+
+    hdr.magic = UCM_CACHE_MAGIC;
+    hdr.version = UCM_CACHE_VERSION;
+    hdr.file_count = nverbs + 1;
+    hdr.file_off = sizeof(hdr);
+    hdr.verb_count = nverbs;
+    hdr.verb_off = hdr.file_off + hdr.file_count * sizeof(ucm_cache_file_t);
+    hdr.sect_count = nsects;
+    hdr.sect_off = hdr.verb_off + hdr.verb_count * sizeof(ucm_cache_verb_t);
+    hdr.ctl_count = nctls;
+    hdr.ctl_off = hdr.sect_off + hdr.sect_count * sizeof(ucm_cache_sect_t);
+    hdr.str_count = nstrs;
+    hdr.str_off = hdr.ctl_off + hdr.ctl_count * sizeof(ucm_cache_ctl_t);
+    hdr.strtab_size = tab.len;
+    hdr.strtab_off = hdr.str_off + hdr.str_count * sizeof(uint32_t);
+    hdr.size = hdr.strtab_off + hdr.strtab_size;
+
+    /* Write to a temporary file first so that a reader never maps
+     * a partially written file, managers of other cards or processes
+     * sharing the configuration use their own temporary file */
+    snd_ucm_cache_path(card_ctxt, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%d.tmp", path, getpid(),
+             card_ctxt->card_number);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ret = -errno;
+        LOGV("failed to create %s error %d", tmp_path, errno);
+        goto done;
+    }
+    ret = ucm_cache_write_buf(fd, &hdr, sizeof(hdr));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, files, hdr.file_count * sizeof(ucm_cache_file_t));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, verbs, hdr.verb_count * sizeof(ucm_cache_verb_t));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, sects, hdr.sect_count * sizeof(ucm_cache_sect_t));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, ctls, hdr.ctl_count * sizeof(ucm_cache_ctl_t));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, strs, hdr.str_count * sizeof(uint32_t));
+    if (ret == 0)
+        ret = ucm_cache_write_buf(fd, tab.buf, hdr.strtab_size);
+    if ((ret == 0) && (fsync(fd) < 0))
+        ret = -errno;
+    close(fd);
+    if ((ret == 0) && (rename(tmp_path, path) < 0))
+        ret = -errno;
+    if (ret < 0) {
+        LOGE("failed to write compiled config %s error %d", path, ret);
+        unlink(tmp_path);
     } else {
-        head->active = status;
+        LOGD("Compiled config written to %s: %u verbs %u sections %u controls",
+             path, nverbs, nsects, nctls);
     }
+done:
+    free(files);
+    free(verbs);
+    free(sects);
+    free(ctls);
+    free(strs);
+    free(tab.buf);
+    free(tab.hash);
+    return ret;
+}
+
+/* Check that count records of size bytes at off are inside the file */
+static int ucm_cache_check_range(uint32_t off, uint32_t count, size_t size, size_t file_size)
+{
+    if ((off > file_size) || (count > (file_size - off) / size))
+        return -EINVAL;
+    return 0;
+}
+
+/* Check that first + count entries of a table are inside the table */
+static int ucm_cache_check_index(uint32_t first, uint64_t count, uint32_t total)
+{
+    if ((uint64_t)first + count > total)
+        return -EINVAL;
+    return 0;
 }
 
-/* Get the identifier value at particulare index of the list
- * head - list head
- * index - node index value
- * Returns node idetifier value at index on sucess, NULL otherwise
+static int ucm_cache_check_str(const ucm_cache_hdr_t *hdr, uint32_t off, int optional)
+{
+    if (off == UCM_CACHE_NONE)
+        return optional ? 0 : -EINVAL;
+    return (off < hdr->strtab_size) ? 0 : -EINVAL;
+}
+
+/* Lists are walked up to their "end" entry, which has to be there */
+static int ucm_cache_check_end(const char *strtab, uint32_t off)
+{
+    if ((off == UCM_CACHE_NONE) ||
+        strncmp(strtab + off, SND_UCM_END_OF_LIST, strlen(SND_UCM_END_OF_LIST)+1))
+        return -EINVAL;
+    return 0;
+}
+
+static char *ucm_cache_str(const char *strtab, uint32_t off)
+{
+    return (off == UCM_CACHE_NONE) ? NULL : (char *)(strtab + off);
+}
+
+/* Load the compiled config of the card if it is valid and the config
+ * files it was compiled from did not change since.
+ * uc_mgr - use case manager structure
+ * Returns 0 on sucess, negative error code otherwise
  */
-static char *snd_ucm_get_value_at_index(struct snd_ucm_ident_node *head, int index)
+static int snd_ucm_cache_load(snd_use_case_mgr_t *uc_mgr)
 {
-    if (head == NULL) {
-        LOGV("Empty list");
-        return NULL;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    const ucm_cache_hdr_t *hdr;
+    const ucm_cache_file_t *files;
+    const ucm_cache_verb_t *verbs;
+    const ucm_cache_sect_t *sects;
+    const ucm_cache_ctl_t *ctls;
+    const uint32_t *strs;
+    const char *strtab;
+    use_case_verb_t *verb_list = NULL;
+    card_mctrl_t *ctrl = NULL;
+    mixer_control_t *mixer = NULL;
+    char **str = NULL, **names = NULL;
+    char path[200];
+    struct stat st;
+    time_t file_mtime;
+    off_t file_size;
+    void *addr;
+    size_t size;
+    uint32_t index;
+    int fd, ret = -EINVAL;
+
+    snd_ucm_cache_path(card_ctxt, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGV("No compiled config %s error %d", path, errno);
+        return -ENOENT;
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(ucm_cache_hdr_t))) {
+        close(fd);
+        return -EINVAL;
+    }
+    size = st.st_size;
+    addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOGE("failed to mmap %s error %d\n", path, errno);
+        return -EINVAL;
+    }
+    hdr = (const ucm_cache_hdr_t *)addr;
+    if ((hdr->magic != UCM_CACHE_MAGIC) || (hdr->version != UCM_CACHE_VERSION) ||
+        (hdr->size != size) || (hdr->file_count < 1) ||
+        ucm_cache_check_range(hdr->file_off, hdr->file_count, sizeof(*files), size) ||
+        ucm_cache_check_range(hdr->verb_off, hdr->verb_count, sizeof(*verbs), size) ||
+        ucm_cache_check_range(hdr->sect_off, hdr->sect_count, sizeof(*sects), size) ||
+        ucm_cache_check_range(hdr->ctl_off, hdr->ctl_count, sizeof(*ctls), size) ||
+        ucm_cache_check_range(hdr->str_off, hdr->str_count, sizeof(*strs), size) ||
+        ucm_cache_check_range(hdr->strtab_off, hdr->strtab_size, 1, size) ||
+        (hdr->strtab_size == 0) || (hdr->file_off % sizeof(int64_t)) ||
+        (hdr->verb_off % sizeof(uint32_t)) || (hdr->sect_off % sizeof(uint32_t)) ||
+        (hdr->ctl_off % sizeof(uint32_t)) || (hdr->str_off % sizeof(uint32_t))) {
+        LOGE("Invalid compiled config %s", path);
+        goto fail;
+    }
+    files = (const ucm_cache_file_t *)((const char *)addr + hdr->file_off);
+    verbs = (const ucm_cache_verb_t *)((const char *)addr + hdr->verb_off);
+    sects = (const ucm_cache_sect_t *)((const char *)addr + hdr->sect_off);
+    ctls = (const ucm_cache_ctl_t *)((const char *)addr + hdr->ctl_off);
+    strs = (const uint32_t *)((const char *)addr + hdr->str_off);
+    strtab = (const char *)addr + hdr->strtab_off;
+    if ((strtab[hdr->strtab_size - 1] != '\0') || ucm_cache_check_str(hdr, hdr->card_name, 0) ||
+        strcmp(strtab + hdr->card_name, card_ctxt->card_name)) {
+        LOGE("Invalid compiled config %s", path);
+        goto fail;
     }
 
-    if ((index < 0) || (index >= (snd_ucm_get_size_of_list(head)))) {
-        LOGE("Element with given index %d doesn't exist in the list", index);
-        return NULL;
+    /* The cache is stale if any config file changed */
+    for (index = 0; index < hdr->file_count; index++) {
+        if (ucm_cache_check_str(hdr, files[index].name, 0))
+            goto fail;
+        /* Verb files include the files they inherit from */
+        if (index == 0) {
+            strlcpy(path, ucm_config_dir, sizeof(path));
+            strlcat(path, strtab + files[index].name, sizeof(path));
+            if (stat(path, &st) < 0)
+                goto stale;
+            file_mtime = st.st_mtime;
+            file_size = st.st_size;
+        } else if (snd_ucm_stat_verb_file(strtab + files[index].name,
+                       &file_mtime, &file_size) < 0) {
+            goto stale;
+        }
+        if ((file_mtime != files[index].mtime) || (file_size != files[index].size)) {
+stale:
+            LOGD("Compiled config is out of date: %s changed", strtab + files[index].name);
+            goto fail;
+        }
+    }
+    for (index = 0; index < hdr->str_count; index++) {
+        if (ucm_cache_check_str(hdr, strs[index], 0))
+            goto fail;
+    }
+    for (index = 0; index < hdr->verb_count; index++) {
+        if (ucm_cache_check_str(hdr, verbs[index].name, 0) ||
+            (verbs[index].file >= hdr->file_count) ||
+            ucm_cache_check_index(verbs[index].sect_first,
+                (uint64_t)verbs[index].sect_count + 1, hdr->sect_count) ||
+            ucm_cache_check_index(verbs[index].dev_first,
+                (uint64_t)verbs[index].dev_count + 1, hdr->str_count) ||
+            ucm_cache_check_index(verbs[index].mod_first,
+                (uint64_t)verbs[index].mod_count + 1, hdr->str_count))
+            goto fail;
+    }
+    for (index = 0; index < hdr->sect_count; index++) {
+        if (ucm_cache_check_str(hdr, sects[index].name, 1) ||
+            ucm_cache_check_str(hdr, sects[index].playback_dev_name, 1) ||
+            ucm_cache_check_str(hdr, sects[index].capture_dev_name, 1) ||
+            ucm_cache_check_index(sects[index].ena_first, sects[index].ena_count, hdr->ctl_count) ||
+            ucm_cache_check_index(sects[index].dis_first, sects[index].dis_count, hdr->ctl_count))
+            goto fail;
+    }
+    for (index = 0; index < hdr->verb_count; index++) {
+        if (ucm_cache_check_end(strtab, strs[verbs[index].dev_first + verbs[index].dev_count]) ||
+            ucm_cache_check_end(strtab, strs[verbs[index].mod_first + verbs[index].mod_count]) ||
+            ucm_cache_check_end(strtab, sects[verbs[index].sect_first + verbs[index].sect_count].name)) {
+            LOGE("Invalid compiled config %s: unterminated list", path);
+            goto fail;
+        }
+    }
+    for (index = 0; index < hdr->ctl_count; index++) {
+        if (ucm_cache_check_str(hdr, ctls[index].name, 0) ||
+            ucm_cache_check_str(hdr, ctls[index].string, 1) ||
+            ((ctls[index].mulval != UCM_CACHE_NONE) &&
+             ucm_cache_check_index(ctls[index].mulval, ctls[index].value, hdr->str_count)))
+            goto fail;
+    }
+
+    /* A handful of arrays is all that is needed, strings are used in place */
+    verb_list = (use_case_verb_t *)calloc(hdr->verb_count + 1, sizeof(use_case_verb_t));
+    names = (char **)calloc(hdr->verb_count + 2, sizeof(char *));
+    ctrl = (card_mctrl_t *)calloc(hdr->sect_count + 1, sizeof(card_mctrl_t));
+    mixer = (mixer_control_t *)calloc(hdr->ctl_count + 1, sizeof(mixer_control_t));
+    str = (char **)calloc(hdr->str_count + 1, sizeof(char *));
+    if (!verb_list || !names || !ctrl || !mixer || !str) {
+        ret = -ENOMEM;
+        goto fail;
+    }
+    for (index = 0; index < hdr->str_count; index++)
+        str[index] = ucm_cache_str(strtab, strs[index]);
+    for (index = 0; index < hdr->ctl_count; index++) {
+        mixer[index].control_name = ucm_cache_str(strtab, ctls[index].name);
+        mixer[index].type = ctls[index].type;
+        mixer[index].value = ctls[index].value;
+        mixer[index].string = ucm_cache_str(strtab, ctls[index].string);
+        mixer[index].mulval = (ctls[index].mulval == UCM_CACHE_NONE) ?
+            NULL : &str[ctls[index].mulval];
+    }
+    for (index = 0; index < hdr->sect_count; index++) {
+        ctrl[index].case_name = ucm_cache_str(strtab, sects[index].name);
+        ctrl[index].ena_mixer_count = sects[index].ena_count;
+        ctrl[index].ena_mixer_list = sects[index].ena_count ?
+            &mixer[sects[index].ena_first] : NULL;
+        ctrl[index].dis_mixer_count = sects[index].dis_count;
+        ctrl[index].dis_mixer_list = sects[index].dis_count ?
+            &mixer[sects[index].dis_first] : NULL;
+        ctrl[index].playback_dev_name = ucm_cache_str(strtab, sects[index].playback_dev_name);
+        ctrl[index].capture_dev_name = ucm_cache_str(strtab, sects[index].capture_dev_name);
+        ctrl[index].acdb_id = sects[index].acdb_id;
+        ctrl[index].capability = sects[index].capability;
+    }
+    for (index = 0; index < hdr->verb_count; index++) {
+        /* Verb names are copied so that they can outlive the mapping
+         * when some of the verbs are replaced on reload */
+        names[index] = strdup(ucm_cache_str(strtab, verbs[index].name));
+        verb_list[index].use_case_name = strdup(names[index] ? names[index] : "");
+        verb_list[index].file_name = strdup(ucm_cache_str(strtab, files[verbs[index].file].name));
+        verb_list[index].cached = 1;
+        if (!names[index] || !verb_list[index].use_case_name || !verb_list[index].file_name) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+        verb_list[index].device_list = &str[verbs[index].dev_first];
+        verb_list[index].modifier_list = &str[verbs[index].mod_first];
+        verb_list[index].use_case_count = verbs[index].sect_count;
+        verb_list[index].card_ctrl = &ctrl[verbs[index].sect_first];
+        verb_list[index].file_mtime = files[verbs[index].file].mtime;
+        verb_list[index].file_size = files[verbs[index].file].size;
+        verb_list[index].load_state = UCM_VERB_LOADED;
+        if (snd_ucm_index_verb(&verb_list[index]) < 0) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+        if (card_ctxt->mixer_handle &&
+            snd_ucm_bind_verb(card_ctxt->mixer_handle, &verb_list[index]) < 0) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+        snd_ucm_intern_verb(card_ctxt, &verb_list[index]);
     }
+    names[hdr->verb_count] = strdup(SND_UCM_END_OF_LIST);
+    if (names[hdr->verb_count] == NULL) {
+        ret = -ENOMEM;
+        goto fail;
+    }
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    card_ctxt->use_case_verb_list = verb_list;
+    card_ctxt->verb_list = names;
+    card_ctxt->verb_count = hdr->verb_count;
+    card_ctxt->config_mtime = files[0].mtime;
+    card_ctxt->config_size = files[0].size;
+    card_ctxt->cache_addr = addr;
+    card_ctxt->cache_size = hdr->size;
+    card_ctxt->cache_ctrl = ctrl;
+    card_ctxt->cache_mixer = mixer;
+    card_ctxt->cache_str = str;
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    LOGD("Using compiled config for %s: %u verbs", card_ctxt->card_name, hdr->verb_count);
+    return 0;
 
-    while (index) {
-        head = head->next;
-        index--;
+fail:
+    if (verb_list) {
+        for (index = 0; index < hdr->verb_count; index++) {
+            free(verb_list[index].use_case_name);
+            free(verb_list[index].file_name);
+            snd_ucm_arena_free(&verb_list[index].arena);
+            free(verb_list[index].ctl_values);
+        }
     }
+    if (names) {
+        for (index = 0; index <= hdr->verb_count; index++)
+            free(names[index]);
+    }
+    free(verb_list);
+    free(names);
+    free(ctrl);
+    free(mixer);
+    free(str);
+    munmap(addr, size);
+    return ret;
+}
+
+/* Look up the id of an interned device or modifier name
+ * card_ctxt - card context
+ * name - device or modifier name
+ * Returns the id on sucess, negative error code otherwise
+ */
+static int snd_ucm_ident_lookup(card_ctxt_t *card_ctxt, const char *name)
+{
+    unsigned slot;
+    int id;
 
-    return (strdup(head->ident));
+    slot = snd_ucm_hash(name) & (UCM_IDENT_HASH_SIZE - 1);
+    while (card_ctxt->ident_hash[slot]) {
+        id = card_ctxt->ident_hash[slot] - 1;
+        if (!strncmp(card_ctxt->ident_name[id], name, MAX_STR_LEN))
+            return id;
+        slot = (slot + 1) & (UCM_IDENT_HASH_SIZE - 1);
+    }
+    return -ENOENT;
 }
 
-/* Get the size of the list
- * head - list head
- * Returns size of list on sucess, negative error code otherwise
+/* Intern a device or modifier name. The name table lives in the card
+ * context so that names seen for the first time at runtime do not need
+ * any allocation either.
+ * card_ctxt - card context
+ * name - device or modifier name
+ * Returns the id on sucess, negative error code otherwise
  */
-static int snd_ucm_get_size_of_list(struct snd_ucm_ident_node *head)
+static int snd_ucm_ident_intern(card_ctxt_t *card_ctxt, const char *name)
 {
-    int index = 0;
+    unsigned slot;
+    int id;
 
-    if (head == NULL) {
-        LOGV("Empty list");
-        return 0;
+    id = snd_ucm_ident_lookup(card_ctxt, name);
+    if (id >= 0)
+        return id;
+    if (strlen(name) >= MAX_STR_LEN) {
+        LOGE("Identifier too long: %s", name);
+        return -EINVAL;
+    }
+    if (card_ctxt->ident_count == MAX_UCM_IDENTS) {
+        LOGE("Too many identifiers, can't add %s", name);
+        return -ENOSPC;
     }
+    id = card_ctxt->ident_count++;
+    strlcpy(card_ctxt->ident_name[id], name, MAX_STR_LEN);
+    /* Queries look names up without card_lock, the name has to be in
+     * place before its slot is */
+    __sync_synchronize();
+    slot = snd_ucm_hash(name) & (UCM_IDENT_HASH_SIZE - 1);
+    while (card_ctxt->ident_hash[slot])
+        slot = (slot + 1) & (UCM_IDENT_HASH_SIZE - 1);
+    card_ctxt->ident_hash[slot] = id + 1;
+    return id;
+}
 
-    while (head->next != NULL) {
-        index++;
-        head = head->next;
+/* Intern the device and modifier names of a verb
+ * card_ctxt - card context
+ * verb - verb loaded from the config
+ */
+static void snd_ucm_intern_verb(card_ctxt_t *card_ctxt, use_case_verb_t *verb)
+{
+    int index;
+
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    for (index = 0; verb->device_list &&
+         strncmp(verb->device_list[index], SND_UCM_END_OF_LIST, 3); index++)
+        snd_ucm_ident_intern(card_ctxt, verb->device_list[index]);
+    for (index = 0; verb->modifier_list &&
+         strncmp(verb->modifier_list[index], SND_UCM_END_OF_LIST, 3); index++)
+        snd_ucm_ident_intern(card_ctxt, verb->modifier_list[index]);
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+}
+
+#define UCM_BIT_TEST(bits, id) ((bits)[(id) >> 5] & (1u << ((id) & 31)))
+#define UCM_BIT_SET(bits, id) ((bits)[(id) >> 5] |= (1u << ((id) & 31)))
+#define UCM_BIT_CLEAR(bits, id) ((bits)[(id) >> 5] &= ~(1u << ((id) & 31)))
+
+/* Add an identifier to the respective set, it is appended to the enable
+ * order and starts inactive
+ * card_ctxt - card context
+ * set - device or modifier set
+ * value - identifier that needs to be added
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int snd_ucm_add_ident(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *value)
+{
+    int id;
+
+    id = snd_ucm_ident_intern(card_ctxt, value);
+    if (id < 0)
+        return id;
+    if (UCM_BIT_TEST(set->member, id)) {
+        LOGV("add_ident: %s already in the set", value);
+        return 0;
     }
+    UCM_BIT_SET(set->member, id);
+    UCM_BIT_CLEAR(set->active, id);
+    set->ids[set->count++] = id;
+    LOGV("add_ident: value %s id %d", value, id);
+    return 0;
+}
+
+/* Get the status of an identifier of the set
+ * card_ctxt - card context
+ * set - device or modifier set
+ * ident - identifier value for which status needs to be get
+ * Returns 1 if active, 0 if inactive, negative error code if not in the set
+ */
+static int snd_ucm_get_status(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *ident)
+{
+    int id;
 
-    return (index+1);
+    id = snd_ucm_ident_lookup(card_ctxt, ident);
+    if (id < 0 || !UCM_BIT_TEST(set->member, id)) {
+        LOGV("Element not found in the list");
+        return -EINVAL;
+    }
+    return UCM_BIT_TEST(set->active, id) ? 1 : 0;
 }
 
-static void snd_ucm_print_list(struct snd_ucm_ident_node *head)
+/* Set the status of an identifier of the set
+ * card_ctxt - card context
+ * set - device or modifier set
+ * ident - identifier value for which status needs to be set
+ * status - status to be set (1 - active, 0 - inactive)
+ */
+static void snd_ucm_set_status(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *ident, int status)
 {
-    int index = 0;
+    int id;
 
-    LOGV("print_list: head %p", head);
-    if (head == NULL) {
-        LOGV("Empty list");
-        return;
+    id = snd_ucm_ident_lookup(card_ctxt, ident);
+    if (id < 0 || !UCM_BIT_TEST(set->member, id)) {
+        LOGE("Element not found to set the status");
+    } else if (status) {
+        UCM_BIT_SET(set->active, id);
+    } else {
+        UCM_BIT_CLEAR(set->active, id);
     }
+}
 
-    while (head->next != NULL) {
-        LOGV("index: %d, value: %s", index, head->ident);
-        index++;
-        head = head->next;
+/* Get the identifier value at particulare index of the enable order
+ * card_ctxt - card context
+ * set - device or modifier set
+ * index - index in the set
+ * Returns the interned identifier on sucess, NULL otherwise
+ */
+static const char *snd_ucm_get_value_at_index(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, int index)
+{
+    if ((index < 0) || (index >= set->count)) {
+        LOGE("Element with given index %d doesn't exist in the list", index);
+        return NULL;
     }
-    LOGV("index: %d, value: %s", index, head->ident);
+    return card_ctxt->ident_name[set->ids[index]];
 }
 
-/* Delete an identifier from respective list
- * head - list head
- * value - node value that needs to be deleted
+static void snd_ucm_print_set(card_ctxt_t *card_ctxt, ucm_ident_set_t *set)
+{
+    int index;
+
+    LOGV("print_set: %d entries", set->count);
+    for (index = 0; index < set->count; index++)
+        LOGV("index: %d, value: %s", index, card_ctxt->ident_name[set->ids[index]]);
+}
+
+/* Delete an identifier from the respective set
+ * card_ctxt - card context
+ * set - device or modifier set
+ * value - identifier that needs to be deleted
  * Returns 0 on sucess, negative error code otherwise
- *
  */
-static int snd_ucm_del_ident_from_list(struct snd_ucm_ident_node **head, const char *value)
+static int snd_ucm_del_ident(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *value)
 {
-    struct snd_ucm_ident_node *temp1, *temp2;
-    int ret = -EINVAL;
+    int id, index;
 
-    if (*head == NULL) {
+    if (set->count == 0) {
         LOGE("del_from_list: Empty list");
         return -EINVAL;
-    } else if (!strncmp((*head)->ident, value, (strlen(value)+1))) {
-            temp2 = *head;
-            *head = temp2->next;
-            ret = 0;
-    } else {
-        temp1 = *head;
-        temp2 = temp1->next;
-        while (temp2 != NULL) {
-            if (!strncmp(temp2->ident, value, (strlen(value)+1))) {
-                temp1->next = temp2->next;
-                ret = 0;
-                break;
-            }
-            temp1 = temp1->next;
-            temp2 = temp1->next;
-        }
     }
-    if (ret < 0) {
+    id = snd_ucm_ident_lookup(card_ctxt, value);
+    if (id < 0 || !UCM_BIT_TEST(set->member, id)) {
         LOGE("Element not found in enabled list");
-    } else {
-        temp2->next = NULL;
-        temp2->ident[0] = 0;
-        temp2->active = 0;
-        free(temp2);
-        temp2 = NULL;
+        return -EINVAL;
     }
-    return ret;
+    UCM_BIT_CLEAR(set->member, id);
+    UCM_BIT_CLEAR(set->active, id);
+    for (index = 0; set->ids[index] != id; index++)
+        ;
+    set->count--;
+    memmove(&set->ids[index], &set->ids[index + 1], set->count - index);
+    return 0;
 }
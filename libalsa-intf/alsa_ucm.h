@@ -229,6 +229,8 @@ int snd_use_case_get_list(snd_use_case_mgr_t *uc_mgr,
  * Known identifiers:
  *   NULL 		- return current card
  *   _verb		- return current verb
+ *   _stats		- return timings and control counts of the
+ *			  most recent routing transitions, one per line
  *
  *   [=]<NAME>[/[<modifier>|</device>][/<verb>]]
  *                      - value identifier <NAME>
@@ -288,6 +290,58 @@ int snd_use_case_geti(snd_use_case_mgr_t *uc_mgr,
 		      const char *identifier,
 		      long *value);
 
+/**
+ * \brief Get current - borrowed string
+ * \param uc_mgr Use case manager
+ * \param identifier Same identifiers as snd_use_case_get
+ * \param value Value pointer
+ * \return Zero if success, otherwise a negative error code
+ *
+ * Note: String is owned by the use case manager, do not free it. It
+ * stays valid until the next snd_use_case_set, snd_use_case_mgr_reset,
+ * snd_use_case_mgr_reload or snd_use_case_mgr_close on uc_mgr.
+ */
+int snd_use_case_get_ref(snd_use_case_mgr_t *uc_mgr,
+                         const char *identifier,
+                         const char **value);
+
+/**
+ * \brief Get current - string copied to a caller buffer
+ * \param uc_mgr Use case manager
+ * \param identifier Same identifiers as snd_use_case_get
+ * \param buf Buffer the value is copied to, empty string for no value
+ * \param size Size of buf
+ * \return Zero if success, -ENOSPC if the value does not fit in buf,
+ * otherwise a negative error code
+ */
+int snd_use_case_get_buf(snd_use_case_mgr_t *uc_mgr,
+                         const char *identifier,
+                         char *buf, size_t size);
+
+/**
+ * \brief Get PCM device number
+ * \param uc_mgr Use case manager
+ * \param identifier PlaybackPCM/<device|modifier> or
+ *                   CapturePCM/<device|modifier>
+ * \return PCM device number if success, otherwise a negative error code
+ */
+int snd_use_case_get_pcm_id(snd_use_case_mgr_t *uc_mgr,
+                            const char *identifier);
+
+/**
+ * \brief Get enabled devices or modifiers without allocating
+ * \param uc_mgr Use case manager
+ * \param identifier _enadevs or _enamods
+ * \param list Array filled with names owned by the use case manager,
+ *             valid until snd_use_case_mgr_close
+ * \param size Number of entries of list
+ * \return Number of entries if success, -ENOSPC if list is too small,
+ * otherwise a negative error code
+ */
+int snd_use_case_get_enabled(snd_use_case_mgr_t *uc_mgr,
+                             const char *identifier,
+                             const char *list[], int size);
+
 /**
  * \brief Set new
  * \param uc_mgr Use case manager
@@ -309,11 +363,64 @@ int snd_use_case_geti(snd_use_case_mgr_t *uc_mgr,
  *			- disable old_modifier and then enable new_modifier
  *			- if old_modifier is not enabled just return
  *			- check transmit sequence firstly
+ *   _acdbforce		- 1 to send ACDB calibration on every enable,
+ *			  0 to only send it when it is not resident
+ *   _stageverb		- prepare the change to verb = value
+ *			- load the verb and resolve its controls and
+ *			  voice calibration for the enabled devices
+ *			- the next _verb only writes the controls not
+ *			  already holding their value, any other request
+ *			  drops the prepared change
  */
 int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
                      const char *identifier,
                      const char *value);
 
+/**
+ * \brief Completion callback of snd_use_case_set_async
+ * \param uc_mgr Use case manager
+ * \param identifier Identifier of the request
+ * \param value Value of the request
+ * \param result Zero if success, otherwise a negative error code
+ */
+typedef void (*snd_use_case_cb_t)(snd_use_case_mgr_t *uc_mgr,
+                                  const char *identifier,
+                                  const char *value,
+                                  int result);
+
+/**
+ * \brief Set new asynchronously
+ * \param uc_mgr Use case manager
+ * \param identifier Same identifiers as snd_use_case_set
+ * \param value Value
+ * \param cb Called from the worker thread once the request completed,
+ *           may be NULL
+ * \return Zero if the request was queued, otherwise a negative error code
+ *
+ * Requests are applied in order by a worker thread. Requests queued while
+ * the worker is busy are applied together as a single transition, mixer
+ * controls are only written with the value they have after the last one.
+ */
+int snd_use_case_set_async(snd_use_case_mgr_t *uc_mgr,
+                           const char *identifier,
+                           const char *value,
+                           snd_use_case_cb_t cb);
+
+/**
+ * \brief Get eventfd signalled by completed asynchronous requests
+ * \param uc_mgr Use case manager
+ * \return eventfd counting the completed requests, otherwise a negative
+ * error code. The descriptor is closed by snd_use_case_mgr_close.
+ */
+int snd_use_case_async_fd(snd_use_case_mgr_t *uc_mgr);
+
+/**
+ * \brief Wait until all asynchronous requests are applied
+ * \param uc_mgr Use case manager
+ * \return zero if success, otherwise a negative error code
+ */
+int snd_use_case_async_wait(snd_use_case_mgr_t *uc_mgr);
+
 /**
  * \brief Open and initialise use case core for sound card
  * \param uc_mgr Returned use case manager pointer
@@ -322,11 +429,28 @@ int snd_use_case_set(snd_use_case_mgr_t *uc_mgr,
  */
 int snd_use_case_mgr_open(snd_use_case_mgr_t **uc_mgr, const char *card_name);
 
+/**
+ * \brief Open and initialise use case core for every sound card
+ * \param uc_mgr Returned use case manager pointers, one per card
+ * \param size Number of entries of uc_mgr
+ * \return Number of managers opened if success, otherwise a negative error code
+ *
+ * Cards are found from /proc/asound/cards, or from the control devices
+ * when it is not available. Each manager has its own lock and is closed
+ * with snd_use_case_mgr_close().
+ */
+int snd_use_case_mgr_open_all(snd_use_case_mgr_t *uc_mgr[], int size);
+
 
 /**
  * \brief Reload and re-parse use case configuration files for sound card.
+ * Only changed config files are parsed again and the current routing is
+ * applied again when its verb changed. Lists returned for _verbs, _devices
+ * and _modifiers are not valid after a reload. Verbs being loaded on
+ * demand are waited for.
  * \param uc_mgr Use case manager
- * \return zero if success, otherwise a negative error code
+ * \return zero if success, -EBUSY if a routing change holds the current
+ * tables, otherwise a negative error code
  */
 int snd_use_case_mgr_reload(snd_use_case_mgr_t *uc_mgr);
 
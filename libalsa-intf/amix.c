@@ -27,9 +27,31 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <string.h>
+#include <getopt.h>
+#include <time.h>
 
 #include "alsa_audio.h"
 
+#define MAX_LINE_LEN 1024
+#define MAX_LINE_ARGS 128
+
+struct batch_line {
+    int line_no;
+    char *buf;
+    struct mixer_ctl *ctl;
+    int argc;
+    char *argv[MAX_LINE_ARGS];
+    struct snd_ctl_elem_value *old;
+    long long usec;
+};
+
+static long long now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
 struct mixer_ctl *get_ctl(struct mixer *mixer, char *name)
 {
@@ -48,19 +70,333 @@ struct mixer_ctl *get_ctl(struct mixer *mixer, char *name)
     return mixer_get_control(mixer, name, idx);
 }
 
+static int set_ctl(struct mixer_ctl *ctl, int argc, char **argv)
+{
+    if (isdigit(argv[0][0]) || argv[0][0] == '-')
+        return mixer_ctl_set_value(ctl, argc, argv);
+    return mixer_ctl_select(ctl, argv[0]);
+}
+
+/* Resolve a script line to the element values it writes */
+static int resolve_line(struct batch_line *l, long long *values)
+{
+    if (isdigit(l->argv[0][0]) || l->argv[0][0] == '-')
+        return mixer_ctl_resolve_mulvalues(l->ctl, l->argc, l->argv, values);
+    return mixer_ctl_resolve_enum(l->ctl, l->argv[0], values);
+}
+
+/* Split a script line into whitespace separated tokens in place.
+ * Tokens may be quoted with '' or "" to keep embedded spaces, which
+ * is needed for most control names. A '#' at the start of a token
+ * begins a comment. Returns the number of tokens or -1 on a quoting
+ * error.
+ */
+static int split_line(char *p, char **argv, int max)
+{
+    int argc = 0;
+    char *d, q;
+
+    for (;;) {
+        while (isspace(*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+        if (argc == max)
+            return -1;
+        argv[argc++] = d = p;
+        q = 0;
+        while (*p && (q || !isspace(*p))) {
+            if (!q && (*p == '\'' || *p == '"')) {
+                q = *p++;
+            } else if (q && *p == q) {
+                q = 0;
+                p++;
+            } else {
+                *d++ = *p++;
+            }
+        }
+        if (q)
+            return -1;
+        if (*p)
+            p++;
+        *d = '\0';
+    }
+    return argc;
+}
+
+/* Check a value list against a control before anything is written so
+ * that a typo late in a script does not leave the card half configured.
+ */
+static int validate_line(struct batch_line *l)
+{
+    struct snd_ctl_elem_info *info = l->ctl->info;
+    unsigned n;
+
+    if (isdigit(l->argv[0][0]) || l->argv[0][0] == '-') {
+        if (info->type != SNDRV_CTL_ELEM_TYPE_BOOLEAN &&
+            info->type != SNDRV_CTL_ELEM_TYPE_INTEGER &&
+            info->type != SNDRV_CTL_ELEM_TYPE_INTEGER64)
+            return -EINVAL;
+        if ((unsigned)l->argc != info->count)
+            return -EINVAL;
+        return 0;
+    }
+    if (info->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+        return -EINVAL;
+    for (n = 0; n < info->value.enumerated.items; n++) {
+        if (!strncmp(l->argv[0], l->ctl->ename[n],
+                     strnlen(l->ctl->ename[n], 64)))
+            return 0;
+    }
+    return -EINVAL;
+}
+
+static int load_script(struct mixer *mixer, FILE *fp,
+                       struct batch_line **lines, int *nlines)
+{
+    char buf[MAX_LINE_LEN];
+    struct batch_line *l, *tmp;
+    int line_no = 0, count = 0, size = 0, ret = 0, argc;
+
+    *lines = NULL;
+    while (fgets(buf, sizeof(buf), fp)) {
+        line_no++;
+        if (!strchr(buf, '\n') && !feof(fp)) {
+            fprintf(stderr, "line %d: too long\n", line_no);
+            ret = -EINVAL;
+            break;
+        }
+        if (count == size) {
+            size = size ? size * 2 : 32;
+            tmp = realloc(*lines, size * sizeof(**lines));
+            if (tmp == NULL) {
+                ret = -ENOMEM;
+                break;
+            }
+            *lines = tmp;
+        }
+        l = &(*lines)[count];
+        memset(l, 0, sizeof(*l));
+        l->line_no = line_no;
+        l->buf = strdup(buf);
+        if (l->buf == NULL) {
+            ret = -ENOMEM;
+            break;
+        }
+        argc = split_line(l->buf, l->argv, MAX_LINE_ARGS);
+        if (argc == 0) {
+            free(l->buf);
+            continue;
+        }
+        count++;
+        if (argc < 2) {
+            fprintf(stderr, "line %d: %s\n", line_no, argc < 0 ?
+                    "malformed line" : "missing value");
+            ret = -EINVAL;
+            continue;
+        }
+        l->ctl = get_ctl(mixer, l->argv[0]);
+        if (l->ctl == NULL) {
+            fprintf(stderr, "line %d: can't find control %s\n",
+                    line_no, l->argv[0]);
+            ret = -EINVAL;
+            continue;
+        }
+        l->argc = argc - 1;
+        memmove(l->argv, l->argv + 1, l->argc * sizeof(char *));
+        if (validate_line(l) < 0) {
+            fprintf(stderr, "line %d: invalid value for %s\n",
+                    line_no, l->ctl->info->id.name);
+            ret = -EINVAL;
+        }
+    }
+    *nlines = count;
+    return ret;
+}
+
+/* Apply all script lines through one mixer handle. The previous value
+ * of every control is saved before it is written and, unless force is
+ * set, the lines applied so far are rolled back in reverse order as
+ * soon as one of them fails. Only the write itself is timed.
+ */
+static int run_script(struct batch_line *lines, int nlines, int force)
+{
+    long long values[MIXER_MAX_VALUES];
+    struct batch_line *l;
+    long long start;
+    int i, ret = 0, r;
+
+    for (i = 0; i < nlines; i++) {
+        l = &lines[i];
+        r = resolve_line(l, values);
+        if (r < 0) {
+            fprintf(stderr, "line %d: invalid value for %s\n",
+                    l->line_no, l->ctl->info->id.name);
+            ret = r;
+            if (!force)
+                break;
+            continue;
+        }
+        if (!force) {
+            l->old = malloc(sizeof(*l->old));
+            if (l->old == NULL) {
+                ret = -ENOMEM;
+                break;
+            }
+            r = mixer_ctl_read_elem(l->ctl, l->old);
+            if (r < 0) {
+                fprintf(stderr, "line %d: failed to read %s: %s\n",
+                        l->line_no, l->ctl->info->id.name, strerror(-r));
+                free(l->old);
+                l->old = NULL;
+                ret = r;
+                break;
+            }
+        }
+        start = now_usec();
+        r = mixer_ctl_write_values(l->ctl, values);
+        l->usec = now_usec() - start;
+        if (r < 0) {
+            fprintf(stderr, "line %d: failed to set %s: %s\n",
+                    l->line_no, l->ctl->info->id.name, strerror(-r));
+            ret = r;
+            if (!force)
+                break;
+        }
+    }
+
+    if (ret && !force) {
+        for (; i >= 0; i--) {
+            l = &lines[i];
+            if (l->old && mixer_ctl_write_elem(l->ctl, l->old) < 0)
+                fprintf(stderr, "line %d: failed to restore %s\n",
+                        l->line_no, l->ctl->info->id.name);
+        }
+        fprintf(stderr, "script rolled back\n");
+    }
+    return ret;
+}
+
+static void print_report(struct batch_line *lines, int nlines,
+                         long long open_usec, long long total_usec)
+{
+    long long sum = 0;
+    int i;
+
+    printf("%6s %10s  %s\n", "line", "usec", "control");
+    printf("%6s %10lld  %s\n", "-", open_usec, "(mixer_open)");
+    for (i = 0; i < nlines; i++) {
+        printf("%6d %10lld  %s\n", lines[i].line_no, lines[i].usec,
+               lines[i].ctl ? (char *)lines[i].ctl->info->id.name : "?");
+        sum += lines[i].usec;
+    }
+    printf("%d controls in %lld usec, %lld usec total\n",
+           nlines, sum, total_usec);
+}
+
+static int batch_main(struct mixer *mixer, const char *script, int force,
+                      int report, long long start, long long open_usec)
+{
+    struct batch_line *lines = NULL;
+    int nlines = 0, ret, i;
+    FILE *fp;
+
+    if (!strcmp(script, "-")) {
+        fp = stdin;
+    } else {
+        fp = fopen(script, "r");
+        if (fp == NULL) {
+            fprintf(stderr, "can't open %s: %s\n", script, strerror(errno));
+            return -errno;
+        }
+    }
+    ret = load_script(mixer, fp, &lines, &nlines);
+    if (fp != stdin)
+        fclose(fp);
+
+    if (!ret)
+        ret = run_script(lines, nlines, force);
+    if (!ret && report)
+        print_report(lines, nlines, open_usec, now_usec() - start);
+
+    for (i = 0; i < nlines; i++) {
+        free(lines[i].buf);
+        free(lines[i].old);
+    }
+    free(lines);
+    return ret;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-D device] [name[#idx] value...]\n"
+            "       %s [-D device] [-k] [-q] -f script|-\n"
+            "       %s [-D device] -s file\n"
+            "  -f  apply one 'name[#idx] value...' line at a time from\n"
+            "      a script file or stdin, rolled back on failure\n"
+            "  -k  keep going on failure instead of rolling back\n"
+            "  -q  don't print the per line timing report\n"
+            "  -s  save the element list of the card, as used by\n"
+            "      ucmlint and ucmbench\n",
+            prog, prog, prog);
+}
+
 int main(int argc, char **argv)
 {
     struct mixer *mixer;
     struct mixer_ctl *ctl;
     unsigned value;
-    int r;
+    int r, opt, force = 0, report = 1;
     const char* device = "/dev/snd/controlC0";
+    const char *script = NULL, *elems = NULL;
+    long long start, open_usec;
+
+    while ((opt = getopt(argc, argv, "+D:f:kqs:h")) != -1) {
+        switch (opt) {
+        case 'D':
+            device = optarg;
+            break;
+        case 'f':
+            script = optarg;
+            break;
+        case 'k':
+            force = 1;
+            break;
+        case 'q':
+            report = 0;
+            break;
+        case 's':
+            elems = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
 
+    start = now_usec();
     mixer = mixer_open(device);
     if (!mixer){
         fprintf(stderr,"oops: %s: %d\n", strerror(errno), __LINE__);
         return -1;
     }
+    open_usec = now_usec() - start;
+
+    if (elems) {
+        r = mixer_elems_save(mixer, elems);
+        if (r)
+            fprintf(stderr, "can't save %s: %s\n", elems, strerror(-r));
+        mixer_close(mixer);
+        return r ? -1 : 0;
+    }
+
+    if (script) {
+        r = batch_main(mixer, script, force, report, start, open_usec);
+        mixer_close(mixer);
+        return r ? -1 : 0;
+    }
 
     if (argc == 1) {
         mixer_dump(mixer);
@@ -78,10 +414,7 @@ int main(int argc, char **argv)
         return -1;
     }
     if (argc) {
-        if (isdigit(argv[0][0]))
-            r = mixer_ctl_set_value(ctl, argc, argv);
-        else
-            r = mixer_ctl_select(ctl, argv[0]);
+        r = set_ctl(ctl, argc, argv);
         if (r)
             fprintf(stderr,"oops: %s: %d\n", strerror(errno), __LINE__);
     } else {
@@ -24,7 +24,10 @@
 #include <errno.h>
 #include <sys/poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <sound/asound.h>
 #include "alsa_audio.h"
@@ -42,6 +45,26 @@ static uint32_t play_max_sz = 2147483648LL;
 static int format = SNDRV_PCM_FORMAT_S16_LE;
 static int period = 0;
 static int compressed = 0;
+static int duration = 0;
+
+/*
+ * The input is mapped when it is a regular file, and read by a prefetch
+ * thread into a ring buffer otherwise, so that the playback loop only ever
+ * copies from memory. Either way ahead_sec seconds of audio are kept ahead
+ * of what is being played. in and out count the bytes put in and taken out
+ * of the ring.
+ */
+static int ahead_sec = 1;
+static char *map;
+static size_t map_len, map_pos, map_advised;
+static unsigned lead;
+static char *ring;
+static unsigned ring_size, ring_low, ring_stalls;
+static unsigned long long ring_in, ring_out;
+static int ring_eof, ring_done, ring_err;
+static pthread_t ring_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
 
 static struct option long_options[] =
 {
@@ -54,6 +77,8 @@ static struct option long_options[] =
     {"format", 1, 0, 'F'},
     {"period", 1, 0, 'B'},
     {"compressed", 0, 0, 'T'},
+    {"ahead", 1, 0, 'S'},
+    {"duration", 1, 0, 'd'},
     {0, 0, 0, 0}
 };
 
@@ -73,6 +98,195 @@ struct wav_header {
     uint32_t data_sz;
 };
 
+/*
+ * Ask for the next lead bytes of a mapped file once half of the last
+ * window has been played.
+ */
+static void reader_advise(void)
+{
+    size_t off, len;
+
+    if (map_advised >= map_len || map_advised >= map_pos + lead / 2)
+        return;
+    off = map_advised & ~((size_t)getpagesize() - 1);
+    len = map_len - off < lead ? map_len - off : lead;
+    madvise(map + off, len, MADV_WILLNEED);
+    map_advised = off + len;
+}
+
+static void *reader_thread(void *arg)
+{
+    int fd = (int)(long)arg;
+    struct pollfd pfd;
+    unsigned pos, len;
+    ssize_t ret;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pthread_mutex_lock(&ring_lock);
+    for (;;) {
+        while (!ring_done && (ring_in - ring_out == ring_size))
+            pthread_cond_wait(&ring_cond, &ring_lock);
+        if (ring_done)
+            break;
+        pos = ring_in % ring_size;
+        len = ring_size - (ring_in - ring_out);
+        if (len > ring_size - pos)
+            len = ring_size - pos;
+        if (len > 64 * 1024)
+            len = 64 * 1024;
+        pthread_mutex_unlock(&ring_lock);
+
+        /* Do not block in read() on a quiet pipe, so that stop can join */
+        if (poll(&pfd, 1, 100) == 0) {
+            pthread_mutex_lock(&ring_lock);
+            continue;
+        }
+        ret = read(fd, ring + pos, len);
+        if (ret < 0 && errno == EINTR) {
+            pthread_mutex_lock(&ring_lock);
+            continue;
+        }
+        if (ret < 0) {
+            ret = -errno;
+            fprintf(stderr, "Aplay:read error %d\n", (int)-ret);
+        }
+
+        pthread_mutex_lock(&ring_lock);
+        if (ret <= 0) {
+            ring_err = ret;
+            ring_eof = 1;
+            pthread_cond_signal(&ring_cond);
+            break;
+        }
+        ring_in += ret;
+        pthread_cond_signal(&ring_cond);
+    }
+    pthread_mutex_unlock(&ring_lock);
+    return NULL;
+}
+
+/*
+ * Map the input if it is a regular file, otherwise start the prefetch
+ * thread and wait for it to fill the ring. The lead is ahead_sec seconds
+ * of audio and at least two periods.
+ */
+static int reader_start(int fd, unsigned bufsize, unsigned rate, unsigned channels)
+{
+    struct stat st;
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+
+    lead = ((rate * channels * 2 * ahead_sec + bufsize - 1) / bufsize) * bufsize;
+    if (lead < 2 * bufsize)
+        lead = 2 * bufsize;
+
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && pos >= 0 && st.st_size > pos &&
+        (unsigned long long)st.st_size <= (size_t)-1) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            map_len = st.st_size;
+            map_pos = map_advised = pos;
+            madvise(map, map_len, MADV_SEQUENTIAL);
+            reader_advise();
+            if (debug)
+                fprintf(stderr, "Aplay:mapped %d bytes, lead %d bytes\n", (int)map_len, lead);
+            return 0;
+        }
+        map = NULL;
+    }
+
+    ring_size = lead;
+    ring = malloc(ring_size);
+    if (!ring) {
+        fprintf(stderr, "Aplay:could not allocate %d bytes\n", ring_size);
+        return -ENOMEM;
+    }
+    ring_in = ring_out = 0;
+    ring_low = ring_size;
+    ring_stalls = 0;
+    ring_eof = ring_done = ring_err = 0;
+    if (pthread_create(&ring_thread, NULL, reader_thread, (void *)(long)fd)) {
+        fprintf(stderr, "Aplay:could not start the prefetch thread\n");
+        free(ring);
+        ring = NULL;
+        return -EAGAIN;
+    }
+    pthread_mutex_lock(&ring_lock);
+    while (!ring_eof && (ring_in < ring_size))
+        pthread_cond_wait(&ring_cond, &ring_lock);
+    pthread_mutex_unlock(&ring_lock);
+    if (debug)
+        fprintf(stderr, "Aplay:prefetch ring %d bytes\n", ring_size);
+    return 0;
+}
+
+/*
+ * Copies the next len bytes of the input to buf. Less than len is only
+ * returned at the end of the input, 0 once it is all played or a negative
+ * error.
+ */
+static int reader_get(char *buf, unsigned len)
+{
+    unsigned n, pos, first;
+    unsigned long long used;
+
+    if (map) {
+        n = map_len - map_pos < len ? map_len - map_pos : len;
+        memcpy(buf, map + map_pos, n);
+        map_pos += n;
+        reader_advise();
+        return n;
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    used = ring_in - ring_out;
+    if (!ring_eof && (used < ring_low))
+        ring_low = used;
+    if (!ring_eof && (used < len))
+        ring_stalls++;
+    while (!ring_eof && (ring_in - ring_out < len))
+        pthread_cond_wait(&ring_cond, &ring_lock);
+    used = ring_in - ring_out;
+    pthread_mutex_unlock(&ring_lock);
+
+    n = used < len ? used : len;
+    pos = ring_out % ring_size;
+    first = n < ring_size - pos ? n : ring_size - pos;
+    memcpy(buf, ring + pos, first);
+    memcpy(buf + first, ring, n - first);
+
+    pthread_mutex_lock(&ring_lock);
+    ring_out += n;
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    return n ? (int)n : ring_err;
+}
+
+static void reader_stop(struct pcm *pcm)
+{
+    unsigned byte_rate = pcm->rate * pcm->channels * 2;
+
+    if (map) {
+        fprintf(stderr, "Aplay:mapped input, read-ahead %d ms, pcm underruns %d\n",
+                (int)(lead * 1000ULL / byte_rate), pcm->underruns);
+        munmap(map, map_len);
+        map = NULL;
+        return;
+    }
+    if (!ring)
+        return;
+    pthread_mutex_lock(&ring_lock);
+    ring_done = 1;
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    pthread_join(ring_thread, NULL);
+    fprintf(stderr, "Aplay:prefetch %d ms, low water %d ms, stalls %d, pcm underruns %d\n",
+            (int)(ring_size * 1000ULL / byte_rate), (int)(ring_low * 1000ULL / byte_rate),
+            ring_stalls, pcm->underruns);
+    free(ring);
+    ring = NULL;
+}
+
 static int set_params(struct pcm *pcm)
 {
      struct snd_pcm_hw_params *params;
@@ -222,17 +436,13 @@ static int play_file(unsigned rate, unsigned channels, int fd,
     }
 
     if (!pcm_flag) {
-       if (pcm_prepare(pcm)) {
-          fprintf(stderr, "Aplay:Failed in pcm_prepare\n");
-          pcm_close(pcm);
-          return -errno;
-       }
-       if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_START)) {
-          fprintf(stderr, "Aplay: Hostless IOCTL_START Error no %d \n", errno);
-          pcm_close(pcm);
-          return -errno;
-       }
-        while(1);
+        err = pcm_hostless_run(pcm, duration);
+        if (err >= 0)
+            fprintf(stderr, "Aplay:Hostless session ran %d s, xruns %d\n", err, pcm->underruns);
+        else
+            fprintf(stderr, "Aplay:Hostless session failed, Error no %d \n", -err);
+        pcm_close(pcm);
+        return err < 0 ? err : 0;
     }
 
     if (flags & PCM_MMAP) {
@@ -256,10 +466,18 @@ static int play_file(unsigned rate, unsigned channels, int fd,
         pfd[0].events = POLLIN;
 
         frames = (pcm->flags & PCM_MONO) ? (bufsize / 2) : (bufsize / 4);
+        err = reader_start(fd, bufsize, rate, channels);
+        if (err) {
+            pcm_close(pcm);
+            return err;
+        }
         for (;;) {
              if (!pcm->running) {
-                  if (pcm_prepare(pcm))
-                      return --errno;
+                  if (pcm_prepare(pcm)) {
+                      err = -errno;
+                      reader_stop(pcm);
+                      return err;
+                  }
                   pcm->running = 1;
                   start = 0;
              }
@@ -278,8 +496,10 @@ static int play_file(unsigned rate, unsigned channels, int fd,
               * less than avail_min we need to wait
               */
              avail = pcm_avail(pcm);
-             if (avail < 0)
+             if (avail < 0) {
+                 reader_stop(pcm);
                  return avail;
+             }
              if (avail < pcm->sw_p->avail_min) {
                  poll(pfd, nfds, TIMEOUT_INFINITE);
                  continue;
@@ -300,15 +520,17 @@ static int play_file(unsigned rate, unsigned channels, int fd,
                             pcm->sync_ptr->c.control.appl_ptr);
              }
              /*
-              * Read from the file to the destination buffer in kernel mmaped buffer
-              * This reduces a extra copy of intermediate buffer.
+              * Copy the read-ahead data to the destination buffer in kernel
+              * mmaped buffer. Only the tail of a short last period is filled
+              * with silence.
               */
-             memset(dst_addr, 0x0, bufsize);
-             err = read(fd, dst_addr , bufsize);
+             err = reader_get((char *)dst_addr, bufsize);
              if (debug)
                  fprintf(stderr, "read %d bytes from file\n", err);
              if (err <= 0)
                  break;
+             if ((unsigned)err < bufsize)
+                 memset(dst_addr + err, 0x0, bufsize - err);
              /*
               * Increment the application pointer with data written to kernel.
               * Update kernel with the new sync pointer.
@@ -333,7 +555,7 @@ static int play_file(unsigned rate, unsigned channels, int fd,
 		    if (ioctl(pcm->fd, SNDRV_COMPRESS_TSTAMP, &tstamp))
 			fprintf(stderr, "Aplay: failed SNDRV_COMPRESS_TSTAMP\n");
                     else
-	                fprintf(stderr, "timestamp = %lld\n", tstamp.timestamp);
+	                fprintf(stderr, "timestamp = %llu\n", (unsigned long long)tstamp.timestamp);
 		}
              }
              /*
@@ -352,7 +574,8 @@ static int play_file(unsigned rate, unsigned channels, int fd,
                          continue;
                     } else {
                         fprintf(stderr, "Aplay:Error no %d \n", errno);
-                        return -errno;
+                        reader_stop(pcm);
+                        return err;
                     }
                 } else
                     start = 1;
@@ -374,6 +597,7 @@ start_done:
             } else
                 poll(pfd, nfds, TIMEOUT_INFINITE);
         }
+        reader_stop(pcm);
     } else {
         if (pcm_prepare(pcm)) {
             fprintf(stderr, "Aplay:Failed in pcm_prepare\n");
@@ -390,14 +614,26 @@ start_done:
             return -ENOMEM;
         }
 
-        while (read(fd, data, bufsize) == bufsize) {
-            if (pcm_write(pcm, data, bufsize)){
+        err = reader_start(fd, bufsize, rate, channels);
+        if (err) {
+            free(data);
+            pcm_close(pcm);
+            return err;
+        }
+        /* A short last period is written as it is */
+        while ((err = reader_get(data, bufsize)) > 0) {
+            if (pcm_write(pcm, data, err)){
                 fprintf(stderr, "Aplay: pcm_write failed\n");
+                err = -errno;
+                reader_stop(pcm);
                 free(data);
                 pcm_close(pcm);
-                return -errno;
+                return err;
             }
+            if ((unsigned)err < bufsize)
+                break;
         }
+        reader_stop(pcm);
         free(data);
     }
     fprintf(stderr, "Aplay: Done playing\n");
@@ -510,6 +746,8 @@ int main(int argc, char **argv)
 		"-F             -- Format\n"
                 "-B             -- Period\n"
                 "-T             -- Compressed\n"
+                "-S <sec>       -- Seconds of audio read ahead of playback [1]\n"
+                "-d <sec>       -- Duration of a hostless session [until signalled]\n"
                 "<file> \n");
            fprintf(stderr, "Formats Supported:\n");
            for (i = 0; i <= SNDRV_PCM_FORMAT_LAST; ++i)
@@ -518,7 +756,7 @@ int main(int argc, char **argv)
            fprintf(stderr, "\nSome of these may not be available on selected hardware\n");
            return 0;
      }
-     while ((c = getopt_long(argc, argv, "PVMD:R:C:F:B:T:", long_options, &option_index)) != -1) {
+     while ((c = getopt_long(argc, argv, "PVMD:R:C:F:B:T:S:d:", long_options, &option_index)) != -1) {
        switch (c) {
        case 'P':
           pcm_flag = 0;
@@ -547,6 +785,12 @@ int main(int argc, char **argv)
        case 'T':
           compressed = 1;
           break;
+       case 'S':
+          ahead_sec = (int)strtol(optarg, NULL, 0);
+          break;
+       case 'd':
+          duration = (int)strtol(optarg, NULL, 0);
+          break;
        default:
           printf("\nUsage: aplay [options] <file>\n"
                 "options:\n"
@@ -559,6 +803,8 @@ int main(int argc, char **argv)
 		"-F             -- Format\n"
                 "-B             -- Period\n"
                 "-T             -- Compressed\n"
+                "-S <sec>       -- Seconds of audio read ahead of playback [1]\n"
+                "-d <sec>       -- Duration of a hostless session [until signalled]\n"
                 "<file> \n");
            fprintf(stderr, "Formats Supported:\n");
            for (i = 0; i < SNDRV_PCM_FORMAT_LAST; ++i)
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/poll.h>
 #include <sys/ioctl.h>
 #include <getopt.h>
@@ -47,6 +48,25 @@ static char *data;
 static int format = SNDRV_PCM_FORMAT_S16_LE;
 static int period = 0;
 static int piped = 0;
+static int hdr_interval = 0;
+static uint32_t hdr_synced = 0;
+static volatile sig_atomic_t stop_capture = 0;
+/* Data size the writer has written out, for the SIGABRT handler */
+static volatile sig_atomic_t data_written = 0;
+
+/*
+ * Captured periods go through a ring buffer to a writer thread, so that a
+ * stall of the storage does not hold up the capture loop. in and out count
+ * the bytes put in and taken out of the ring.
+ */
+static int ring_sec = 2;
+static char *ring;
+static unsigned ring_size, ring_batch, ring_high, ring_dropped;
+static unsigned long long ring_in, ring_out;
+static int ring_done, ring_err;
+static pthread_t ring_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
 
 static struct option long_options[] =
 {
@@ -59,6 +79,8 @@ static struct option long_options[] =
     {"duration", 1, 0, 'T'},
     {"format", 1, 0, 'F'},
     {"period", 1, 0, 'B'},
+    {"update", 1, 0, 'U'},
+    {"buffer", 1, 0, 'S'},
     {0, 0, 0, 0}
 };
 
@@ -78,6 +100,189 @@ struct wav_header {
     uint32_t data_sz;
 };
 
+/*
+ * The WAV header is written once with the sizes left at zero and the sizes
+ * are filled in when recording stops. With -U they are also brought up to
+ * date every given number of seconds of audio, so a file cut short by a
+ * crash stays playable up to the last update.
+ */
+static void finalize_header(void)
+{
+    if (piped || (fd < 0) || (hdr.riff_id != ID_RIFF))
+        return;
+    hdr.riff_sz = hdr.data_sz + 44 - 8;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return;
+    hdr_synced = hdr.data_sz;
+}
+
+static void update_header(void)
+{
+    if (hdr_interval && (hdr.data_sz - hdr_synced >= hdr.byte_rate * hdr_interval))
+        finalize_header();
+}
+
+/*
+ * Start writeback of what was just written and wait for the batch before,
+ * whose pages are then dropped from the page cache. The writer thread never
+ * has more than two batches of dirty pages.
+ */
+static void writer_flush(int fd, off_t off, size_t len, off_t prev_off, size_t prev_len)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(fd, off, len, SYNC_FILE_RANGE_WRITE);
+    if (prev_len)
+        sync_file_range(fd, prev_off, prev_len, SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    if (prev_len)
+        posix_fadvise(fd, prev_off, prev_len, POSIX_FADV_DONTNEED);
+#endif
+}
+
+static void *writer_thread(void *arg)
+{
+    int fd = (int)(long)arg;
+    off_t off, prev_off = 0;
+    size_t len, prev_len = 0;
+    unsigned pos;
+    sigset_t set;
+    ssize_t ret;
+
+    /* Signals stopping the recording go to the capture loop */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    off = piped ? -1 : lseek(fd, 0, SEEK_CUR);
+
+    pthread_mutex_lock(&ring_lock);
+    for (;;) {
+        while (!ring_done && (ring_in - ring_out < ring_batch))
+            pthread_cond_wait(&ring_cond, &ring_lock);
+        if (ring_in == ring_out)
+            break;
+        pos = ring_out % ring_size;
+        len = ring_in - ring_out;
+        if (len > ring_batch)
+            len = ring_batch;
+        if (len > ring_size - pos)
+            len = ring_size - pos;
+        pthread_mutex_unlock(&ring_lock);
+
+        ret = write(fd, ring + pos, len);
+        if (ret != (ssize_t)len) {
+            fprintf(stderr, "Arec:could not write %d bytes\n", (int)len);
+            pthread_mutex_lock(&ring_lock);
+            ring_err = ret < 0 ? -errno : -ENOSPC;
+            break;
+        }
+        if (off >= 0) {
+            writer_flush(fd, off, len, prev_off, prev_len);
+            prev_off = off;
+            prev_len = len;
+            off += len;
+        }
+        hdr.data_sz += len;
+        data_written = hdr.data_sz;
+        update_header();
+
+        pthread_mutex_lock(&ring_lock);
+        ring_out += len;
+    }
+    pthread_mutex_unlock(&ring_lock);
+    return NULL;
+}
+
+/*
+ * Set up the ring for ring_sec seconds of audio, at least four periods, and
+ * start the writer. The pages are touched here so that the capture loop
+ * does not fault them in.
+ */
+static int writer_start(int fd, unsigned bufsize, unsigned rate, unsigned channels)
+{
+    unsigned periods = (rate * channels * 2 * ring_sec + bufsize - 1) / bufsize;
+
+    if (periods < 4)
+        periods = 4;
+    ring_size = periods * bufsize;
+    ring_batch = (periods / 4) * bufsize;
+    if (ring_batch > 256 * 1024)
+        ring_batch = (256 * 1024 / bufsize) * bufsize;
+    if (ring_batch < bufsize)
+        ring_batch = bufsize;
+    ring = malloc(ring_size);
+    if (!ring) {
+        fprintf(stderr, "Arec:could not allocate %d bytes\n", ring_size);
+        return -ENOMEM;
+    }
+    memset(ring, 0, ring_size);
+    ring_in = ring_out = 0;
+    ring_high = ring_dropped = 0;
+    data_written = 0;
+    ring_done = ring_err = 0;
+    if (pthread_create(&ring_thread, NULL, writer_thread, (void *)(long)fd)) {
+        fprintf(stderr, "Arec:could not start the writer thread\n");
+        free(ring);
+        ring = NULL;
+        return -EAGAIN;
+    }
+    if (debug)
+        fprintf(stderr, "Arec:ring %d bytes, batch %d bytes\n", ring_size, ring_batch);
+    return 0;
+}
+
+/*
+ * Returns the ring space for the next period, NULL if the ring is full
+ * in which case the period is dropped and counted as an overrun.
+ */
+static char *writer_get(unsigned bufsize)
+{
+    unsigned long long used;
+
+    pthread_mutex_lock(&ring_lock);
+    used = ring_in - ring_out;
+    pthread_mutex_unlock(&ring_lock);
+    if (used + bufsize > ring_size) {
+        ring_dropped++;
+        return NULL;
+    }
+    return ring + ring_in % ring_size;
+}
+
+static void writer_put(unsigned bufsize)
+{
+    unsigned used;
+
+    pthread_mutex_lock(&ring_lock);
+    ring_in += bufsize;
+    used = ring_in - ring_out;
+    if (used > ring_high)
+        ring_high = used;
+    if (used >= ring_batch)
+        pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static int writer_stop(unsigned bufsize)
+{
+    unsigned byte_rate = pcm->rate * pcm->channels * 2;
+
+    pthread_mutex_lock(&ring_lock);
+    ring_done = 1;
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    pthread_join(ring_thread, NULL);
+    fprintf(stderr, "Arec:ring %d ms, high water %d ms, overruns %d (%d ms dropped), pcm overruns %d\n",
+            (int)(ring_size * 1000ULL / byte_rate), (int)(ring_high * 1000ULL / byte_rate),
+            ring_dropped, (int)((unsigned long long)ring_dropped * bufsize * 1000 / byte_rate),
+            pcm->overruns);
+    free(ring);
+    ring = NULL;
+    return ring_err;
+}
+
 static int set_params(struct pcm *pcm)
 {
      struct snd_pcm_hw_params *params;
@@ -156,7 +361,7 @@ static int set_params(struct pcm *pcm)
 
 }
 
-int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsigned flags, const char *device)
+int record_file(unsigned rate, unsigned channels, unsigned count,  unsigned flags, const char *device)
 {
     unsigned avail, xfer, bufsize;
     int r;
@@ -168,6 +373,7 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
     int err;
     struct pollfd pfd[1];
     int rec_size = 0;
+    char *buf;
 
     flags |= PCM_IN;
 
@@ -192,18 +398,14 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
     }
 
     if (!pcm_flag) {
-        if (pcm_prepare(pcm)) {
-            fprintf(stderr, "Arec:Failed in pcm_prepare\n");
-            pcm_close(pcm);
-            return -errno;
-        }
-	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_START)) {
-            fprintf(stderr, "Arec: Hostless IOCTL_START Error no %d \n", errno);
-            pcm_close(pcm);
-            return -errno;
-	}
-        while(1);
-   }
+        err = pcm_hostless_run(pcm, duration);
+        if (err >= 0)
+            fprintf(stderr, "Arec:Hostless session ran %d s, overruns %d\n", err, pcm->overruns);
+        else
+            fprintf(stderr, "Arec:Hostless session failed, Error no %d \n", -err);
+        pcm_close(pcm);
+        return err < 0 ? err : 0;
+    }
 
     if (flags & PCM_MMAP) {
         u_int8_t *dst_addr = NULL;
@@ -242,12 +444,18 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
         pfd[0].events = POLLIN;
 
         hdr.data_sz = 0;
+        if (writer_start(fd, bufsize, rate, channels)) {
+            pcm_close(pcm);
+            return -ENOMEM;
+        }
         frames = (pcm->flags & PCM_MONO) ? (bufsize / 2) : (bufsize / 4);
         x.frames = (pcm->flags & PCM_MONO) ? (bufsize / 2) : (bufsize / 4);
-        for(;;) {
+        while (!stop_capture && !ring_err) {
 		if (!pcm->running) {
-                    if (pcm_prepare(pcm))
-                        return --errno;
+                    if (pcm_prepare(pcm) || ioctl(pcm->fd, SNDRV_PCM_IOCTL_START)) {
+                        fprintf(stderr, "Arec:Failed to restart after overrun\n");
+                        break;
+                    }
                     start = 0;
                 }
                 /* Sync the current Application pointer from the kernel */
@@ -256,7 +464,7 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
                 if (err == EPIPE) {
                      fprintf(stderr, "Arec:Failed in sync_ptr \n");
                      /* we failed to make our window -- try to restart */
-                     //pcm->overruns++;
+                     pcm->overruns++;
                      pcm->running = 0;
                      continue;
                 }
@@ -268,7 +476,7 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
                 if (debug)
                      fprintf(stderr, "Arec:avail 1 = %d frames = %d\n",avail, frames);
                 if (avail < 0)
-                        return avail;
+                        break;
                 if (avail < pcm->sw_p->avail_min) {
                         poll(pfd, nfds, TIMEOUT_INFINITE);
                         continue;
@@ -283,13 +491,12 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
                 dst_addr = dst_address(pcm);
 
                /*
-                * Write to the file at the destination address from kernel mmaped buffer
-                * This reduces a extra copy of intermediate buffer.
+                * Copy the period out of the kernel mmaped buffer into the ring,
+                * the writer thread takes it to the file from there.
                 */
-                if (write(fd, dst_addr, bufsize) != bufsize) {
-                    fprintf(stderr, "Arec:could not write %d bytes\n", bufsize);
-                    return -errno;
-                }
+                buf = writer_get(bufsize);
+                if (buf)
+                    memcpy(buf, dst_addr, bufsize);
                 x.frames -= frames;
                 pcm->sync_ptr->c.control.appl_ptr += frames;
 		pcm->sync_ptr->flags = 0;
@@ -297,17 +504,13 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
                 if (err == EPIPE) {
                      fprintf(stderr, "Arec:Failed in sync_ptr \n");
                      /* we failed to make our window -- try to restart */
+                     pcm->overruns++;
                      pcm->running = 0;
                      continue;
                 }
+                if (buf)
+                    writer_put(bufsize);
                 rec_size += bufsize;
-                hdr.data_sz += bufsize;
-                hdr.riff_sz = hdr.data_sz + 44 - 8;
-                if (!piped) {
-                    lseek(fd, 0, SEEK_SET);
-                    write(fd, &hdr, sizeof(hdr));
-                    lseek(fd, 0, SEEK_END);
-                }
                 if (rec_size >= count)
                       break;
            }
@@ -325,28 +528,31 @@ int record_file(unsigned rate, unsigned channels, int fd, unsigned count,  unsig
 		return -ENOMEM;
 	    }
 
-	    while (!pcm_read(pcm, data, bufsize)) {
-		if (write(fd, data, bufsize) != bufsize) {
-		    fprintf(stderr, "Arec:could not write %d bytes\n", bufsize);
+	    if (writer_start(fd, bufsize, rate, channels)) {
+		pcm_close(pcm);
+		return -ENOMEM;
+	    }
+
+	    /* Periods are read straight into the ring, into data if it is full */
+	    while (!stop_capture && !ring_err) {
+		buf = writer_get(bufsize);
+		if (pcm_read(pcm, buf ? buf : data, bufsize))
 		    break;
-		}
+		if (buf)
+		    writer_put(bufsize);
                 rec_size += bufsize;
-                hdr.data_sz += bufsize;
-                hdr.riff_sz = hdr.data_sz + 44 - 8;
-                if (!piped) {
-                    lseek(fd, 0, SEEK_SET);
-                    write(fd, &hdr, sizeof(hdr));
-                    lseek(fd, 0, SEEK_END);
-                }
                 if (rec_size >= count)
                     break;
 	    }
     }
+    err = writer_stop(bufsize);
     fprintf(stderr, " rec_size =%d count =%d\n", rec_size, count);
+    finalize_header();
     close(fd);
+    fd = -1;
     free(data);
     pcm_close(pcm);
-    return hdr.data_sz;
+    return err;
 
 fail:
     fprintf(stderr, "Arec:pcm error: %s\n", pcm_error(pcm));
@@ -387,7 +593,7 @@ int rec_raw(const char *fg, const char *device, int rate, int ch,
     } else if (!strncmp(fg, "N", sizeof("N"))) {
         flag = PCM_NMMAP;
     }
-    return record_file(rate, ch, fd, count, flag, device);
+    return record_file(rate, ch, count, flag, device);
 }
 
 int rec_wav(const char *fg, const char *device, int rate, int ch, const char *fn)
@@ -448,24 +654,32 @@ int rec_wav(const char *fg, const char *device, int rate, int ch, const char *fn
     } else if (!strncmp(fg, "N", sizeof("N"))) {
         flag = PCM_NMMAP;
     }
-    return record_file(hdr.sample_rate, hdr.num_channels, fd, count, flag, device);
+    return record_file(hdr.sample_rate, hdr.num_channels, count, flag, device);
 }
 
-static void signal_handler(int sig)
+static void stop_handler(int sig)
 {
-    long file_size;
-    FILE *fp;
+    stop_capture = 1;
+}
 
-    fprintf(stderr, "Arec:Aborted by signal %s...\n", strsignal(sig));
-    fprintf(stderr, "Arec:lseeked to %d", (int) lseek(fd, 0, SEEK_SET));
-    hdr.riff_sz = hdr.data_sz + 44 - 8;
-    fprintf(stderr, "Arec: hdr.data_sz =%d\n", hdr.data_sz);
-    fprintf(stderr, "Arec: hdr.riff_sz =%d\n", hdr.riff_sz);
-    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
-	if (debug)
+static void signal_handler(int sig)
+{
+    struct wav_header abort_hdr;
+
+    /*
+     * The writer thread may be updating the header, which is then
+     * written from a copy with the size the writer last wrote out. The
+     * signal terminates once raised again, data still in the ring is lost.
+     */
+    if (!piped && (fd >= 0) && (hdr.riff_id == ID_RIFF)) {
+        abort_hdr = hdr;
+        abort_hdr.data_sz = (uint32_t)data_written;
+        abort_hdr.riff_sz = abort_hdr.data_sz + 44 - 8;
+        if (pwrite(fd, &abort_hdr, sizeof(abort_hdr), 0) != sizeof(abort_hdr))
             fprintf(stderr, "Arec:arec: cannot write header\n");
-    } else
-       fd = -1;
+    }
+    fprintf(stderr, "Arec:Aborted by signal %s...\n", strsignal(sig));
+    fprintf(stderr, "Arec: hdr.data_sz =%u\n", (unsigned)data_written);
 
     if (fd > 1) {
         close(fd);
@@ -498,9 +712,11 @@ int main(int argc, char **argv)
                 "-V		-- verbose\n"
                 "-C		-- Channels\n"
                 "-R		-- Rate\n"
-                "-T		-- Time in seconds for recording\n"
+                "-T		-- Time in seconds for recording or a hostless session\n"
 		"-F             -- Format\n"
                 "-B             -- Period\n"
+                "-U <sec>       -- Update the WAV header every <sec> seconds\n"
+                "-S <sec>       -- Seconds of audio buffered for the writer [2]\n"
                 "<file> \n");
            for (i = 0; i < SNDRV_PCM_FORMAT_LAST; ++i)
                if (get_format_name(i))
@@ -508,7 +724,7 @@ int main(int argc, char **argv)
            fprintf(stderr, "\nSome of these may not be available on selected hardware\n");
           return 0;
     }
-    while ((c = getopt_long(argc, argv, "PVMD:R:C:T:F:B:", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "PVMD:R:C:T:F:B:U:S:", long_options, &option_index)) != -1) {
        switch (c) {
        case 'P':
           pcm_flag = 0;
@@ -537,6 +753,12 @@ int main(int argc, char **argv)
        case 'B':
           period = (int)strtol(optarg, NULL, 0);
           break;
+       case 'U':
+          hdr_interval = (int)strtol(optarg, NULL, 0);
+          break;
+       case 'S':
+          ring_sec = (int)strtol(optarg, NULL, 0);
+          break;
        default:
           printf("\nUsage: arec [options] <file>\n"
                 "options:\n"
@@ -546,9 +768,11 @@ int main(int argc, char **argv)
                 "-V		-- verbose\n"
                 "-C		-- Channels\n"
                 "-R		-- Rate\n"
-                "-T		-- Time in seconds for recording\n"
+                "-T		-- Time in seconds for recording or a hostless session\n"
 		"-F             -- Format\n"
                 "-B             -- Period\n"
+                "-U <sec>       -- Update the WAV header every <sec> seconds\n"
+                "-S <sec>       -- Seconds of audio buffered for the writer [2]\n"
                 "<file> \n");
            for (i = 0; i < SNDRV_PCM_FORMAT_LAST; ++i)
                if (get_format_name(i))
@@ -571,7 +795,16 @@ int main(int argc, char **argv)
 
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = &signal_handler;
+    /* The handler raises the signal again to terminate */
+    sa.sa_flags = SA_RESETHAND;
     sigaction(SIGABRT, &sa, NULL);
+    /*
+     * SIGINT and SIGTERM stop the capture loop, which lets the writer
+     * empty the ring and finalizes the header. A second one terminates.
+     */
+    sa.sa_handler = &stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
     if (pcm_flag) {
 	 if (format == SNDRV_PCM_FORMAT_S16_LE)
@@ -581,6 +814,8 @@ int main(int argc, char **argv)
     } else {
         rc = rec_wav(mmap, device, rate, ch, "dummy");
     }
+    /* Recording stopped on an error, keep what was written playable */
+    finalize_header();
     if (filename)
         free(filename);
 
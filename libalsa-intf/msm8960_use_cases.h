@@ -36,13 +36,19 @@ extern "C" {
 #include "alsa_ucm.h"
 #include "alsa_audio.h"
 #include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
 #define SND_UCM_END_OF_LIST "end"
 #define CONFIG_DIR "/system/etc/snd_soc_msm/"
+/* Compiled config files are kept here, one per card */
+#define UCM_CACHE_DIR "/data/misc/audio/"
+#define UCM_CACHE_SUFFIX ".ucm"
 
 /* ACDB Device ID macros */
 #define CAP_RX 0x1
 #define CAP_TX 0x2
 #define CAP_VOICE 0x4
+#define UCM_CAL_SLOTS 3
 #define DEVICE_HANDSET_RX_ACDB_ID                       7 // HANDSET_SPKR
 #define DEVICE_HANDSET_TX_ACDB_ID                       4 // HANDSET_MIC
 #define DEVICE_SPEAKER_RX_ACDB_ID                       15// SPKR_PHONE_SPKR_STEREO
@@ -82,8 +88,74 @@ typedef struct mixer_control {
     unsigned value;
     char *string;
     char **mulval;
+    /* Bound control and its resolved element values, set once the
+     * mixer is open. values is NULL if the value does not fit the
+     * control. */
+    struct mixer_ctl *ctl;
+    long long *values;
 }mixer_control_t;
 
+/* Bump allocator for the parsed tables of a verb. Memory is only given
+ * back when the whole arena is freed. */
+#define UCM_ARENA_BLOCK_SIZE    16384
+#define UCM_ARENA_ALIGN         8
+
+typedef struct ucm_arena_block {
+    struct ucm_arena_block *next;
+    size_t size;
+    size_t used;
+    long long data[];
+}ucm_arena_block_t;
+
+typedef struct ucm_arena {
+    ucm_arena_block_t *head;
+    size_t total;
+}ucm_arena_t;
+
+typedef struct ucm_arena_mark {
+    ucm_arena_block_t *block;
+    size_t used;
+}ucm_arena_mark_t;
+
+/* Strings of the parsed tables of a card, interned once for all verbs
+ * and kept until the card is closed */
+#define UCM_STR_POOL_SIZE   1024
+
+typedef struct ucm_str {
+    struct ucm_str *next;
+    uint32_t hash;
+    char str[];
+}ucm_str_t;
+
+typedef struct ucm_str_pool {
+    pthread_mutex_t lock;
+    ucm_arena_t arena;
+    int count;
+    ucm_str_t *hash[UCM_STR_POOL_SIZE];
+}ucm_str_pool_t;
+
+/* Mixer control list shared by all the sections of a card with the same
+ * controls. The list is bound to the mixer once and owned by the pool,
+ * the entry, controls, values and multi value arrays are one allocation. */
+typedef struct ucm_ctl_list {
+    struct ucm_ctl_list *next;
+    uint32_t hash;
+    int refs;
+    int count;
+    mixer_control_t *list;
+    long long *values;
+}ucm_ctl_list_t;
+
+#define UCM_CTL_POOL_SIZE   256
+
+typedef struct ucm_ctl_pool {
+    pthread_mutex_t lock;
+    struct mixer *mixer;
+    int lists;
+    int shared;
+    ucm_ctl_list_t *hash[UCM_CTL_POOL_SIZE];
+}ucm_ctl_pool_t;
+
 /* Use case mixer controls structure */
 typedef struct card_mctrl {
     char *case_name;
@@ -95,39 +167,323 @@ typedef struct card_mctrl {
     char *capture_dev_name;
     int acdb_id;
     int capability;
+    /* Set when the control lists are shared through the pool */
+    ucm_ctl_list_t *ena_shared;
+    ucm_ctl_list_t *dis_shared;
 }card_mctrl_t;
 
-/* identifier node structure for identifier list*/
-struct snd_ucm_ident_node {
+/* A verb config file can start with Inherit "<file>" (or Include) to
+ * take over the sections of another file, sections with the same type
+ * and name replace the inherited ones */
+#define UCM_MAX_INHERIT_DEPTH   4
+
+/* Section of a config file text, used to merge inherited files */
+typedef struct ucm_text_sect {
+    const char *start;
+    size_t len;
+    const char *type;
+    size_t type_len;
+    const char *name;
+    size_t name_len;
+}ucm_text_sect_t;
+
+/* Maximum number of distinct device and modifier names of a card */
+#define MAX_UCM_IDENTS      256
+#define UCM_IDENT_WORDS     (MAX_UCM_IDENTS / 32)
+#define UCM_IDENT_HASH_SIZE 512
+
+/* Enabled devices or modifiers. Names are interned to small ids in the
+ * card context, membership and active status are bitsets indexed by id
+ * and ids keeps the enable order. */
+typedef struct ucm_ident_set {
+    uint32_t member[UCM_IDENT_WORDS];
+    uint32_t active[UCM_IDENT_WORDS];
+    int count;
+    unsigned char ids[MAX_UCM_IDENTS];
+}ucm_ident_set_t;
+
+/* Control writes of a routing transition. While a plan is active the
+ * sections only record their writes, which are committed together so
+ * that every control is written once with its final value. */
+typedef struct ucm_plan {
     int active;
-    char ident[MAX_STR_LEN];
-    struct snd_ucm_ident_node *next;
-};
+    /* Set while a batch of requests is applied as one transition, the
+     * requests then neither restart nor commit the plan */
+    int hold;
+    int count;
+    int size;
+    mixer_control_t **writes;
+    /* Index in writes of the last write of each mixer control */
+    int *last;
+    /* Values the controls written by a commit held before, each followed
+     * by the index of its write, to undo the commit if a write fails */
+    long long *undo;
+    int undo_size;
+}ucm_plan_t;
+
+/* Transition prepared by _stageverb ahead of a verb change. The controls
+ * written by the transition are read while staging and kept up to date
+ * by later writes, the commit then compares against these values instead
+ * of reading every control again. Values the card reports as changed are
+ * not trusted, see snd_ucm_plan_commit(). Any other request, a change to
+ * another verb and a reload drop the stage. */
+typedef struct ucm_stage {
+    /* Index of the staged verb, -1 once a verb change consumed it */
+    int verb_index;
+    /* Set while the transition is resolved without touching the card */
+    int dry;
+    /* Voice calibration the transition sends, -1 if none */
+    int rx_id;
+    int tx_id;
+    /* Offset + 1 in values of each mixer control, 0 if not staged */
+    int *slot;
+    long long *values;
+    int used;
+    int size;
+}ucm_stage_t;
+
+/* Measurements of a routing transition, times are in microseconds.
+ * lookup is the time spent outside of control writes and calibration,
+ * resolving the sections and planning the writes. */
+#define UCM_STATS_RING          16
+#define UCM_STATS_LINE          256
+
+typedef struct ucm_transition {
+    unsigned int seq;
+    char identifier[MAX_STR_LEN];
+    char value[MAX_STR_LEN];
+    int requests;
+    int result;
+    unsigned int total_us;
+    unsigned int lookup_us;
+    unsigned int write_us;
+    unsigned int write_max_us;
+    unsigned int acdb_us;
+    int writes;
+    int skipped;
+    int failed;
+    int rolled_back;
+    int acdb_sends;
+    int acdb_cached;
+}ucm_transition_t;
+
+/* Ring of the most recent transitions, updated under card_lock */
+typedef struct ucm_stats {
+    ucm_transition_t ring[UCM_STATS_RING];
+    unsigned int count;
+    /* Transition being measured, NULL outside of a transition */
+    ucm_transition_t *cur;
+    long long start_us;
+}ucm_stats_t;
+
+/* Request queued by snd_use_case_set_async. Requests waiting for the
+ * worker are applied together as one transition. */
+typedef struct ucm_async_req {
+    struct ucm_async_req *next;
+    snd_use_case_mgr_t *uc_mgr;
+    char identifier[MAX_STR_LEN * 2];
+    char value[MAX_STR_LEN];
+    snd_use_case_cb_t cb;
+    int result;
+}ucm_async_req_t;
+
+/* Load state of a use case verb. Verbs are parsed by a pool of threads
+ * after the first one, a verb selected before its turn is parsed on demand
+ * by the caller. */
+#define UCM_VERB_UNLOADED       0
+#define UCM_VERB_LOADING        1
+#define UCM_VERB_LOADED         2
+#define UCM_VERB_FAILED         3
+#define UCM_MAX_PARSE_THREADS   4
 
 /* Structure to maintain the valid devices and
  * modifiers list per each use case */
 typedef struct use_case_verb {
     char *use_case_name;
+    int load_state;
+    /* Set when the sections and lists live in the compiled config */
+    int cached;
     char **device_list;
     char **modifier_list;
     int use_case_count;
     card_mctrl_t *card_ctrl;
+    char *file_name;
+    time_t file_mtime;
+    off_t file_size;
+    /* Open addressing index of card_ctrl by case_name, slots hold
+     * section index + 1 and 0 for a free slot */
+    int *section_hash;
+    int section_hash_size;
+    /* Storage of the resolved values of all controls of the verb */
+    long long *ctl_values;
+    /* Holds card_ctrl, the control, device and modifier lists and
+     * section_hash of a parsed verb, only section_hash if cached */
+    ucm_arena_t arena;
 }use_case_verb_t;
 
+/* Compiled config cache layout. All offsets are in bytes from the start
+ * of the file except string references which are offsets into the string
+ * table and list references which are indices into the string list.
+ * Sections, device, modifier and verb lists keep their "end" entries.
+ */
+#define UCM_CACHE_MAGIC     0x434d4355 /* "UCMC" */
+#define UCM_CACHE_VERSION   1
+#define UCM_CACHE_NONE      0xffffffff
+#define UCM_HASH_INIT       2166136261u
+
+typedef struct ucm_cache_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t card_name;
+    uint32_t file_count;
+    uint32_t file_off;
+    uint32_t verb_count;
+    uint32_t verb_off;
+    uint32_t sect_count;
+    uint32_t sect_off;
+    uint32_t ctl_count;
+    uint32_t ctl_off;
+    uint32_t str_count;
+    uint32_t str_off;
+    uint32_t strtab_size;
+    uint32_t strtab_off;
+}ucm_cache_hdr_t;
+
+/* Config file the cache was compiled from, index 0 is the master file */
+typedef struct ucm_cache_file {
+    uint32_t name;
+    uint32_t reserved;
+    int64_t mtime;
+    int64_t size;
+}ucm_cache_file_t;
+
+typedef struct ucm_cache_verb {
+    uint32_t name;
+    uint32_t file;
+    uint32_t sect_first;
+    uint32_t sect_count;
+    uint32_t dev_first;
+    uint32_t dev_count;
+    uint32_t mod_first;
+    uint32_t mod_count;
+}ucm_cache_verb_t;
+
+typedef struct ucm_cache_sect {
+    uint32_t name;
+    uint32_t playback_dev_name;
+    uint32_t capture_dev_name;
+    int32_t acdb_id;
+    int32_t capability;
+    uint32_t ena_first;
+    uint32_t ena_count;
+    uint32_t dis_first;
+    uint32_t dis_count;
+}ucm_cache_sect_t;
+
+typedef struct ucm_cache_ctl {
+    uint32_t name;
+    uint32_t type;
+    uint32_t value;
+    uint32_t string;
+    uint32_t mulval;
+}ucm_cache_ctl_t;
+
+/* String table used while compiling the cache, identical strings are
+ * stored once */
+typedef struct ucm_strtab {
+    char *buf;
+    uint32_t len;
+    uint32_t size;
+    uint32_t *hash;
+    uint32_t hash_size;
+    uint32_t count;
+}ucm_strtab_t;
+
 /* SND card context structure */
+/* Routing state published for the query functions. A published state is
+ * never changed, snd_use_case_get, geti and get_list read it without
+ * card_lock. Two states are used in turn, a new one is published after
+ * each change once no reader can see the one before the current. */
+typedef struct ucm_state {
+    char current_verb[MAX_STR_LEN];
+    int verb_index;
+    /* Copy of the current verb entry, the tables it points to are only
+     * freed after the state is retired */
+    use_case_verb_t verb;
+    char **verb_list;
+    ucm_ident_set_t dev_set;
+    ucm_ident_set_t mod_set;
+}ucm_state_t;
+
 typedef struct card_ctxt {
     char *card_name;
     int card_number;
     char *control_device;
     struct mixer *mixer_handle;
     char current_verb[MAX_STR_LEN];
-    struct snd_ucm_ident_node *dev_list_head;
-    struct snd_ucm_ident_node *mod_list_head;
+    ucm_ident_set_t dev_set;
+    ucm_ident_set_t mod_set;
     pthread_mutex_t card_lock;
     pthread_mutexattr_t card_lock_attr;
+    /* Serializes reloads, which replace the verb tables */
+    pthread_mutex_t reload_lock;
     int current_verb_index;
     use_case_verb_t *use_case_verb_list;
     char **verb_list;
+    int verb_count;
+    /* Parsing threads, verb_cond is signalled when a verb is loaded */
+    pthread_cond_t verb_cond;
+    pthread_t parse_thr[UCM_MAX_PARSE_THREADS];
+    int parse_threads;
+    int parse_workers;
+    int parse_stop;
+    time_t config_mtime;
+    off_t config_size;
+    /* Set when the tables were loaded from the compiled cache, strings
+     * then point into the read-only mapping */
+    void *cache_addr;
+    size_t cache_size;
+    card_mctrl_t *cache_ctrl;
+    mixer_control_t *cache_mixer;
+    char **cache_str;
+    ucm_plan_t plan;
+    ucm_stage_t stage;
+    ucm_ctl_pool_t *ctl_pool;
+    ucm_str_pool_t *str_pool;
+    /* Published routing state, readers are counted per epoch so that
+     * a writer knows when the previous state is not in use anymore */
+    ucm_state_t states[2];
+    volatile int state_epoch;
+    volatile int state_readers[2];
+    ucm_stats_t stats;
+    /* ACDB id of the audio calibration resident for each capability bit,
+     * 0 if it has to be sent. Cleared when the path is disabled and on
+     * reload, cal_force sends every calibration again. */
+    int cal_audio[UCM_CAL_SLOTS];
+    int cal_force;
+    /* Set while a batch of queued requests is applied: calibration is
+     * only recorded and sent once for the final routing of the batch.
+     * cal_pending holds the ACDB id per capability bit, 0 if none. */
+    int cal_defer;
+    int cal_pending[UCM_CAL_SLOTS];
+    int cal_voice_rx;
+    int cal_voice_tx;
+    /* Asynchronous requests, async_cond is signalled when requests are
+     * queued and when the worker becomes idle */
+    pthread_mutex_t async_lock;
+    pthread_cond_t async_cond;
+    pthread_t async_thr;
+    int async_started;
+    int async_stop;
+    int async_busy;
+    int async_fd;
+    ucm_async_req_t *async_head;
+    ucm_async_req_t *async_tail;
+    /* Interned device and modifier names, hash slots hold id + 1 */
+    int ident_count;
+    uint16_t ident_hash[UCM_IDENT_HASH_SIZE];
+    char ident_name[MAX_UCM_IDENTS][MAX_STR_LEN];
 }card_ctxt_t;
 
 /** use case manager structure */
@@ -140,27 +496,23 @@ struct snd_use_case_mgr {
     int current_tx_device;
     int current_rx_device;
     card_ctxt_t *card_ctxt_ptr;
-    pthread_t thr;
 };
 
-#define MAX_NUM_CARDS (sizeof(card_list)/sizeof(char *))
-
-/* Valid sound cards list */
-static const char *card_list[] = {
-    "snd_soc_msm",
-    "snd_soc_msm_2x",
-};
+/* Highest number of sound cards, as SNDRV_CARDS */
+#define MAX_NUM_CARDS 32
 
 typedef struct card_mapping {
     char card_name[50];
     int card_number;
 }card_mapping_t;
 
-/* sound card name and number mapping */
+/* sound card name and number mapping, used in addition to the cards
+ * discovered from /proc/asound/cards or the control devices */
 static card_mapping_t card_mapping_list[] = {
     {"snd_soc_msm", 0},
     {"snd_soc_msm_2x", 0},
 };
+#define NUM_DEFAULT_CARDS (sizeof(card_mapping_list)/sizeof(card_mapping_t))
 
 /* New use cases, devices and modifiers added
  * which are not part of existing macros
@@ -205,26 +557,99 @@ static card_mapping_t card_mapping_list[] = {
 #define SND_USE_CASE_MOD_CAPTURE_VOICE_DL       "Capture Voice Downlink"
 #define SND_USE_CASE_MOD_CAPTURE_VOICE_UL_DL    "Capture Voice Uplink Downlink"
 
-/* List utility functions for maintaining enabled devices and modifiers */
-static int snd_ucm_add_ident_to_list(struct snd_ucm_ident_node **head, const char *value);
-static char *snd_ucm_get_value_at_index(struct snd_ucm_ident_node *head, int index);
-static int snd_ucm_get_size_of_list(struct snd_ucm_ident_node *head);
-static int snd_ucm_del_ident_from_list(struct snd_ucm_ident_node **head, const char *value);
-static int snd_ucm_free_list(struct snd_ucm_ident_node **head);
-static void snd_ucm_print_list(struct snd_ucm_ident_node *head);
-static void snd_ucm_set_status_at_index(struct snd_ucm_ident_node *head, const char *ident, int status);
-static int snd_ucm_get_status_at_index(struct snd_ucm_ident_node *head, const char *ident);
+/* Utility functions for maintaining enabled devices and modifiers */
+static int snd_ucm_ident_lookup(card_ctxt_t *card_ctxt, const char *name);
+static int snd_ucm_ident_intern(card_ctxt_t *card_ctxt, const char *name);
+static void snd_ucm_intern_verb(card_ctxt_t *card_ctxt, use_case_verb_t *verb);
+static int snd_ucm_add_ident(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *value);
+static int snd_ucm_del_ident(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *value);
+static const char *snd_ucm_get_value_at_index(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, int index);
+static void snd_ucm_print_set(card_ctxt_t *card_ctxt, ucm_ident_set_t *set);
+static void snd_ucm_set_status(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *ident, int status);
+static int snd_ucm_get_status(card_ctxt_t *card_ctxt, ucm_ident_set_t *set, const char *ident);
 static int snd_ucm_parse_verb(snd_use_case_mgr_t **uc_mgr, const char *file_name, int index);
+static int snd_ucm_parse_verb_text(snd_use_case_mgr_t **uc_mgr, const char *text, size_t len, int index);
+static int snd_ucm_get_inherit(const char *path, char *base, size_t size);
+static int snd_ucm_stat_verb_file(const char *file_name, time_t *mtime, off_t *size);
+static int snd_ucm_text_sections(const char *buf, ucm_text_sect_t **sects);
+static char *snd_ucm_read_verb_file(const char *file_name, int depth, size_t *len);
+static int snd_ucm_load_verb(snd_use_case_mgr_t *uc_mgr, int index);
+static void *snd_ucm_parse_worker(void *uc_mgr_ptr);
 static int get_verb_count(const char *nxt_str);
 /* Parse functions */
 static int snd_ucm_parse(snd_use_case_mgr_t **uc_mgr);
+static int snd_ucm_parse_master(card_ctxt_t *card_ctxt);
 static int snd_ucm_parse_section(snd_use_case_mgr_t **uc_mgr, char **cur_str, char **nxt_str, int verb_index);
-static int snd_ucm_extract_name(char *buf, char **case_name);
+static int snd_ucm_extract_name(ucm_str_pool_t *pool, char *buf, char **case_name);
 static int snd_ucm_extract_acdb(char *buf, int *id, int *cap);
-static int snd_ucm_extract_dev_name(char *buf, char **dev_name);
-static int snd_ucm_extract_controls(char *buf, mixer_control_t **mixer_list, int count);
+static int snd_ucm_extract_dev_name(ucm_str_pool_t *pool, char *buf, char **dev_name);
+static int snd_ucm_extract_controls(ucm_arena_t *arena, ucm_str_pool_t *pool, char *buf,
+    mixer_control_t **mixer_list, int count);
 static int snd_ucm_print(snd_use_case_mgr_t *uc_mgr);
 static void snd_ucm_free_mixer_list(snd_use_case_mgr_t **uc_mgr);
+/* Section lookup functions */
+static int snd_ucm_find_section(use_case_verb_t *verb, const char *ident, const char *device);
+static int snd_ucm_index_verb(use_case_verb_t *verb);
+static int snd_ucm_get_case_index(snd_use_case_mgr_t *uc_mgr, const char *ident, const char *device);
+static int snd_ucm_apply_section(snd_use_case_mgr_t *uc_mgr, int use_case_index, int enable);
+static int snd_ucm_bind_verb(struct mixer *mixer, use_case_verb_t *verb);
+/* Arena and string pool functions */
+static void *snd_ucm_arena_alloc(ucm_arena_t *arena, size_t size);
+static void snd_ucm_arena_mark(ucm_arena_t *arena, ucm_arena_mark_t *mark);
+static void snd_ucm_arena_reset(ucm_arena_t *arena, ucm_arena_mark_t *mark);
+static void snd_ucm_arena_free(ucm_arena_t *arena);
+static ucm_str_pool_t *snd_ucm_str_pool_create(void);
+static void snd_ucm_str_pool_destroy(ucm_str_pool_t *pool);
+static char *snd_ucm_intern(ucm_str_pool_t *pool, const char *str);
+/* Shared control list functions */
+static ucm_ctl_pool_t *snd_ucm_ctl_pool_create(struct mixer *mixer);
+static void snd_ucm_ctl_pool_destroy(ucm_ctl_pool_t *pool);
+static mixer_control_t *snd_ucm_share_controls(ucm_ctl_pool_t *pool, mixer_control_t *list,
+    int count, ucm_ctl_list_t **shared);
+static void snd_ucm_release_controls(ucm_ctl_pool_t *pool, ucm_ctl_list_t *shared);
+/* Published state functions */
+static void snd_ucm_publish_state(card_ctxt_t *card_ctxt);
+static ucm_state_t *snd_ucm_state_get(card_ctxt_t *card_ctxt, int *epoch);
+static void snd_ucm_state_put(card_ctxt_t *card_ctxt, int epoch);
+static int snd_ucm_get_value(snd_use_case_mgr_t *uc_mgr, ucm_state_t *state,
+    const char *identifier, const char **value);
+static int snd_ucm_set_locked(snd_use_case_mgr_t *uc_mgr, const char *identifier,
+    const char *value);
+/* Sound card discovery functions */
+static int snd_ucm_add_card(const char *card_name, int card_number);
+static int snd_ucm_probe_cards(void);
+static void snd_ucm_discover_cards(void);
+static int snd_ucm_open_card(snd_use_case_mgr_t **uc_mgr, int index);
+/* Transition statistics functions */
+static long long snd_ucm_now_us(void);
+static void snd_ucm_stats_begin(card_ctxt_t *card_ctxt, const char *identifier,
+    const char *value);
+static void snd_ucm_stats_end(card_ctxt_t *card_ctxt, int requests, int result);
+static int snd_ucm_stats_format(card_ctxt_t *card_ctxt, char *buf, size_t size);
+static int snd_ucm_write_values(card_ctxt_t *card_ctxt, mixer_control_t *mctl);
+static void snd_ucm_send_audio_cal(card_ctxt_t *card_ctxt, int acdb_id, int capability);
+static void snd_ucm_send_voice_cal(card_ctxt_t *card_ctxt, int rx_id, int tx_id);
+static void snd_ucm_drop_audio_cal(card_ctxt_t *card_ctxt, int acdb_id, int capability);
+static void snd_ucm_cal_flush(card_ctxt_t *card_ctxt);
+/* Asynchronous request functions */
+static void snd_ucm_async_apply(card_ctxt_t *card_ctxt, ucm_async_req_t *batch);
+static void *snd_ucm_async_thread(void *arg);
+static void snd_ucm_async_stop(card_ctxt_t *card_ctxt);
+static void snd_ucm_plan_begin(card_ctxt_t *card_ctxt);
+static int snd_ucm_plan_commit(card_ctxt_t *card_ctxt);
+static int snd_ucm_write_control(card_ctxt_t *card_ctxt, mixer_control_t *mctl);
+/* Staged transition functions */
+static long long *snd_ucm_stage_lookup(card_ctxt_t *card_ctxt, struct mixer_ctl *ctl);
+static void snd_ucm_stage_clear(card_ctxt_t *card_ctxt);
+static int snd_ucm_stage_verb(snd_use_case_mgr_t *uc_mgr, const char *value);
+static int snd_use_case_enable_device(snd_use_case_mgr_t *uc_mgr, const char *device);
+static void snd_ucm_apply_routing(snd_use_case_mgr_t *uc_mgr, int enable);
+/* Compiled config cache functions */
+static uint32_t snd_ucm_hash_add(uint32_t hash, const char *str);
+static uint32_t snd_ucm_hash(const char *str);
+static void snd_ucm_cache_path(card_ctxt_t *card_ctxt, char *path, size_t size);
+static int snd_ucm_cache_load(snd_use_case_mgr_t *uc_mgr);
+static int snd_ucm_cache_write(snd_use_case_mgr_t *uc_mgr);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Code Aurora Forum, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Routing benchmark of the use case manager on the host.
+ *
+ * The control device of the card is replaced by an in-memory one: open,
+ * close and ioctl are interposed for /dev/snd/controlC0 and served from
+ * an element list saved on the device with "amix -s". snd_use_case_set
+ * traces are then replayed and every request is timed.
+ *
+ * A trace has one request per line, "identifier=value", e.g.
+ *     _verb=Voice Call
+ *     _swdev/Earpiece=Speaker
+ * Empty lines and lines starting with # are ignored.
+ */
+
+#include "ucm_host.h"
+#include "alsa_ucm.c"
+
+#include <getopt.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+
+#define BENCH_MAX_REQUESTS  256
+#define BENCH_CARD          0
+#define BENCH_SLOW_US       200000
+
+typedef struct bench_request {
+    char identifier[MAX_STR_LEN * 2];
+    char value[MAX_STR_LEN];
+}bench_request_t;
+
+typedef struct bench_trace {
+    const char *name;
+    int count;
+    bench_request_t req[BENCH_MAX_REQUESTS];
+}bench_trace_t;
+
+/* Built-in traces, as recorded from the audio HAL */
+static const char *const trace_boot[] = {
+    "_verb=HiFi", "_enadev=Speaker", "_disdev=Speaker", "_verb=Inactive",
+    NULL
+};
+static const char *const trace_music[] = {
+    "_verb=HiFi", "_enadev=Speaker", "_enamod=Play Music",
+    "_dismod=Play Music", "_disdev=Speaker", "_verb=Inactive", NULL
+};
+static const char *const trace_call[] = {
+    "_verb=Voice Call", "_enadev=Earpiece", "_enadev=Handset",
+    "_swdev/Earpiece=Speaker", "_swdev/Handset=Line",
+    "_swdev/Speaker=Earpiece", "_swdev/Line=Handset",
+    "_disdev=Earpiece", "_disdev=Handset", "_verb=Inactive", NULL
+};
+static const char *const trace_headset[] = {
+    "_verb=HiFi", "_enadev=Speaker", "_swdev/Speaker=Headphones",
+    "_swdev/Headphones=Speaker", "_disdev=Speaker", "_verb=Inactive", NULL
+};
+static const char *const trace_bt[] = {
+    "_verb=Voice Call", "_enadev=BT SCO Rx", "_enadev=BT SCO Tx",
+    "_disdev=BT SCO Rx", "_disdev=BT SCO Tx", "_verb=Inactive", NULL
+};
+
+static const struct {
+    const char *name;
+    const char *const *lines;
+} builtin_traces[] = {
+    { "boot", trace_boot },
+    { "music", trace_music },
+    { "call", trace_call },
+    { "headset", trace_headset },
+    { "bt", trace_bt },
+};
+
+/* In-memory control device */
+static struct {
+    struct mixer *elems;
+    long long *values;
+    unsigned *offset;
+    const char *card_name;
+    int fd;
+    unsigned long ioctls;
+    unsigned long reads;
+    unsigned long writes;
+    /* Opens of this config file to hold up, see bench_reload() */
+    char slow_path[256];
+    int slow_opens;
+} fake = { NULL, NULL, NULL, NULL, -1, 0, 0, 0, "", 0 };
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_close)(int);
+static int (*real_ioctl)(int, unsigned long, ...);
+
+static int fake_load(const char *path, const char *card_name)
+{
+    unsigned n, total = 0;
+
+    fake.elems = mixer_elems_open(path);
+    if (fake.elems == NULL)
+        return -EINVAL;
+    fake.offset = (unsigned *)calloc(fake.elems->count, sizeof(unsigned));
+    for (n = 0; (fake.offset != NULL) && (n < fake.elems->count); n++) {
+        fake.offset[n] = total;
+        total += fake.elems->info[n].count;
+    }
+    fake.values = (long long *)calloc(total + 1, sizeof(long long));
+    if ((fake.offset == NULL) || (fake.values == NULL))
+        return -ENOMEM;
+    fake.card_name = card_name;
+    return 0;
+}
+
+static int fake_find(unsigned numid)
+{
+    unsigned n;
+
+    if ((numid >= 1) && (numid <= fake.elems->count) &&
+        (fake.elems->info[numid - 1].id.numid == numid))
+        return numid - 1;
+    for (n = 0; n < fake.elems->count; n++) {
+        if (fake.elems->info[n].id.numid == numid)
+            return n;
+    }
+    return -1;
+}
+
+static int fake_ioctl(unsigned long request, void *arg)
+{
+    struct snd_ctl_card_info *card;
+    struct snd_ctl_elem_list *list;
+    struct snd_ctl_elem_info *info;
+    struct snd_ctl_elem_value *ev;
+    long long *values;
+    unsigned n, item;
+    int index;
+
+    fake.ioctls++;
+    switch (request) {
+    case SNDRV_CTL_IOCTL_CARD_INFO:
+        card = (struct snd_ctl_card_info *)arg;
+        memset(card, 0, sizeof(*card));
+        card->card = BENCH_CARD;
+        strlcpy((char *)card->id, fake.card_name, sizeof(card->id));
+        return 0;
+    case SNDRV_CTL_IOCTL_ELEM_LIST:
+        list = (struct snd_ctl_elem_list *)arg;
+        list->count = fake.elems->count;
+        list->used = 0;
+        for (n = list->offset; (n < fake.elems->count) && (list->used < list->space); n++)
+            list->pids[list->used++] = fake.elems->info[n].id;
+        return 0;
+    case SNDRV_CTL_IOCTL_ELEM_INFO:
+        info = (struct snd_ctl_elem_info *)arg;
+        index = fake_find(info->id.numid);
+        if (index < 0)
+            break;
+        item = info->value.enumerated.item;
+        *info = fake.elems->info[index];
+        if (info->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED) {
+            if (item >= info->value.enumerated.items)
+                break;
+            info->value.enumerated.item = item;
+            strlcpy(info->value.enumerated.name, fake.elems->ctl[index].ename[item],
+                    sizeof(info->value.enumerated.name));
+        }
+        return 0;
+    case SNDRV_CTL_IOCTL_ELEM_READ:
+    case SNDRV_CTL_IOCTL_ELEM_WRITE:
+        ev = (struct snd_ctl_elem_value *)arg;
+        index = fake_find(ev->id.numid);
+        if (index < 0)
+            break;
+        values = fake.values + fake.offset[index];
+        info = &fake.elems->info[index];
+        if (request == SNDRV_CTL_IOCTL_ELEM_READ)
+            fake.reads++;
+        else
+            fake.writes++;
+        for (n = 0; (n < info->count) && (n < MIXER_MAX_VALUES); n++) {
+            if (request == SNDRV_CTL_IOCTL_ELEM_READ) {
+                if (info->type == SNDRV_CTL_ELEM_TYPE_INTEGER64)
+                    ev->value.integer64.value[n] = values[n];
+                else if (info->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+                    ev->value.enumerated.item[n] = values[n];
+                else
+                    ev->value.integer.value[n] = values[n];
+            } else {
+                if (info->type == SNDRV_CTL_ELEM_TYPE_INTEGER64)
+                    values[n] = ev->value.integer64.value[n];
+                else if (info->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED)
+                    values[n] = ev->value.enumerated.item[n];
+                else
+                    values[n] = ev->value.integer.value[n];
+            }
+        }
+        return 0;
+    default:
+        break;
+    }
+    errno = ENXIO;
+    return -1;
+}
+
+int open(const char *path, int flags, ...)
+{
+    va_list ap;
+    int mode;
+
+    if (real_open == NULL)
+        real_open = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open");
+    va_start(ap, flags);
+    mode = va_arg(ap, int);
+    va_end(ap);
+    if (!strncmp(path, "/dev/snd/controlC", 17) && (fake.elems != NULL)) {
+        if (atoi(path + 17) != BENCH_CARD) {
+            errno = ENOENT;
+            return -1;
+        }
+        /* A real descriptor keeps the number from being reused */
+        fake.fd = real_open("/dev/null", O_RDWR);
+        return fake.fd;
+    }
+    if ((fake.slow_opens > 0) && !strcmp(path, fake.slow_path)) {
+        fake.slow_opens--;
+        usleep(BENCH_SLOW_US);
+    }
+    return real_open(path, flags, mode);
+}
+
+int close(int fd)
+{
+    if (real_close == NULL)
+        real_close = (int (*)(int))dlsym(RTLD_NEXT, "close");
+    if ((fd >= 0) && (fd == fake.fd))
+        fake.fd = -1;
+    return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    if (real_ioctl == NULL)
+        real_ioctl = (int (*)(int, unsigned long, ...))dlsym(RTLD_NEXT, "ioctl");
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+    if ((fd >= 0) && (fd == fake.fd))
+        return fake_ioctl(request, arg);
+    return real_ioctl(fd, request, arg);
+}
+
+/* Add a "identifier=value" request to a trace
+ * Returns 0 on sucess, negative error code otherwise
+ */
+static int bench_add_request(bench_trace_t *trace, const char *line)
+{
+    const char *sep = strchr(line, '=');
+    size_t len;
+
+    if ((sep == NULL) || (trace->count == BENCH_MAX_REQUESTS))
+        return -EINVAL;
+    len = sep - line + 1;
+    if (len > sizeof(trace->req[0].identifier))
+        len = sizeof(trace->req[0].identifier);
+    strlcpy(trace->req[trace->count].identifier, line, len);
+    strlcpy(trace->req[trace->count].value, sep + 1, sizeof(trace->req[0].value));
+    trace->count++;
+    return 0;
+}
+
+static int bench_read_trace(bench_trace_t *trace, const char *path)
+{
+    char line[MAX_STR_LEN * 4];
+    const char *name;
+    int len, line_no = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "can't open %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+    name = strrchr(path, '/');
+    trace->name = name ? name + 1 : path;
+    trace->count = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+        len = strlen(line);
+        while ((len > 0) && isspace((unsigned char)line[len - 1]))
+            line[--len] = '\0';
+        if ((len == 0) || (line[0] == '#'))
+            continue;
+        if (bench_add_request(trace, line) < 0) {
+            fprintf(stderr, "%s:%d: invalid request '%s'\n", path, line_no, line);
+            fclose(fp);
+            return -EINVAL;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int bench_cmp_us(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Replay a trace and print its measurements. Every iteration starts from
+ * a reset manager, the first one is not measured.
+ */
+static int bench_run(snd_use_case_mgr_t *uc_mgr, bench_trace_t *trace, int iterations)
+{
+    long long *lat, start, total_us = 0;
+    unsigned long ioctls = 0, reads = 0, writes = 0;
+    unsigned long ioctls0, reads0, writes0;
+    int iter, index, ret, count = 0, failed = 0;
+
+    lat = (long long *)malloc(sizeof(long long) * trace->count * iterations + 1);
+    if (lat == NULL)
+        return -ENOMEM;
+    for (iter = -1; iter < iterations; iter++) {
+        snd_use_case_mgr_reset(uc_mgr);
+        for (index = 0; index < trace->count; index++) {
+            ioctls0 = fake.ioctls;
+            reads0 = fake.reads;
+            writes0 = fake.writes;
+            start = snd_ucm_now_us();
+            ret = snd_use_case_set(uc_mgr, trace->req[index].identifier,
+                                   trace->req[index].value);
+            if (iter < 0)
+                continue;
+            if ((ret < 0) && (iter == 0)) {
+                fprintf(stderr, "%s: %s=%s failed: %d\n", trace->name,
+                        trace->req[index].identifier, trace->req[index].value, ret);
+                failed++;
+            }
+            lat[count] = snd_ucm_now_us() - start;
+            total_us += lat[count++];
+            ioctls += fake.ioctls - ioctls0;
+            reads += fake.reads - reads0;
+            writes += fake.writes - writes0;
+        }
+    }
+    qsort(lat, count, sizeof(long long), bench_cmp_us);
+    printf("%-10s %6d %10.0f %8.1f %8.1f %8.1f %8lld %8lld %8lld %6d\n",
+           trace->name, count,
+           total_us ? count * 1000000.0 / total_us : 0.0,
+           count ? (double)ioctls / count : 0.0,
+           count ? (double)reads / count : 0.0,
+           count ? (double)writes / count : 0.0,
+           count ? lat[count / 2] : 0,
+           count ? lat[(count * 99) / 100] : 0,
+           count ? lat[count - 1] : 0, failed);
+    free(lat);
+    return 0;
+}
+
+static void *bench_reload_set(void *arg)
+{
+    snd_use_case_mgr_t *uc_mgr = (snd_use_case_mgr_t *)arg;
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+
+    return (void *)(long)snd_use_case_set(uc_mgr, "_verb", card_ctxt->verb_list[card_ctxt->verb_count - 1]);
+}
+
+/* Reload while the last verb is loaded on demand. The verb is marked as
+ * not loaded and reading its config file is held up, the reload has to
+ * keep the tables the load fills in until it is done.
+ * Returns 0 if both the verb change and the reload succeeded
+ */
+static int bench_reload(snd_use_case_mgr_t *uc_mgr)
+{
+    card_ctxt_t *card_ctxt = uc_mgr->card_ctxt_ptr;
+    use_case_verb_t *verb;
+    const char *current = NULL;
+    pthread_t thread;
+    void *set_ret;
+    int ret, state;
+
+    /* Lets the parsing threads finish */
+    snd_use_case_mgr_reload(uc_mgr);
+    snd_use_case_mgr_reset(uc_mgr);
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    verb = &card_ctxt->use_case_verb_list[card_ctxt->verb_count - 1];
+    if ((card_ctxt->verb_count < 2) || (verb->file_name == NULL)) {
+        pthread_mutex_unlock(&card_ctxt->card_lock);
+        fprintf(stderr, "reload: no verb to load on demand\n");
+        return -EINVAL;
+    }
+    free(verb->ctl_values);
+    verb->ctl_values = NULL;
+    verb->load_state = UCM_VERB_UNLOADED;
+    snprintf(fake.slow_path, sizeof(fake.slow_path), "%s%s", ucm_config_dir, verb->file_name);
+    fake.slow_opens = 1;
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+
+    if (pthread_create(&thread, NULL, bench_reload_set, uc_mgr))
+        return -EAGAIN;
+    usleep(BENCH_SLOW_US / 4);
+    pthread_mutex_lock(&card_ctxt->card_lock);
+    state = card_ctxt->use_case_verb_list[card_ctxt->verb_count - 1].load_state;
+    pthread_mutex_unlock(&card_ctxt->card_lock);
+    ret = snd_use_case_mgr_reload(uc_mgr);
+    pthread_join(thread, &set_ret);
+    fake.slow_opens = 0;
+    snd_use_case_get(uc_mgr, "_verb", &current);
+    printf("reload: verb %s %s, set %d, reload %d\n", current ? current : "(none)",
+           (state == UCM_VERB_LOADING) ? "loading" : "not loading", (int)(long)set_ret, ret);
+    if (current == NULL ||
+        strcmp(current, card_ctxt->verb_list[card_ctxt->verb_count - 1]))
+        ret = -EINVAL;
+    free((void *)current);
+    snd_use_case_mgr_reset(uc_mgr);
+    return ((long)set_ret < 0) ? (int)(long)set_ret : ret;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-c config_dir] -m elements [-n iterations] [-r] [-t trace]... "
+            "[card_name]\n"
+            "  -c  directory of the config files, default %s\n"
+            "  -m  element list of the card saved with 'amix -s'\n"
+            "  -n  number of times each trace is replayed, default 100\n"
+            "  -o  directory of the compiled config, default %s\n"
+            "  -r  reload while a verb is loaded on demand, instead of the traces\n"
+            "  -t  replay a trace file instead of the built-in boot, music,\n"
+            "      call, headset and bt traces\n", prog, CONFIG_DIR, UCM_CACHE_DIR);
+}
+
+int main(int argc, char **argv)
+{
+    static bench_trace_t traces[8];
+    snd_use_case_mgr_t *uc_mgr;
+    const char *elems = NULL, *card_name = "snd_soc_msm";
+    char config_dir[200], cache_dir[200];
+    long long start, open_us;
+    unsigned long ioctls;
+    int opt, index, line, ntraces = 0, iterations = 100, reload = 0, ret;
+
+    strlcpy(config_dir, CONFIG_DIR, sizeof(config_dir));
+    while ((opt = getopt(argc, argv, "c:m:n:o:rt:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            strlcpy(config_dir, optarg, sizeof(config_dir) - 1);
+            if (config_dir[strlen(config_dir) - 1] != '/')
+                strlcat(config_dir, "/", sizeof(config_dir));
+            break;
+        case 'm':
+            elems = optarg;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'o':
+            snprintf(cache_dir, sizeof(cache_dir), "%s/", optarg);
+            ucm_cache_dir = cache_dir;
+            break;
+        case 'r':
+            reload = 1;
+            break;
+        case 't':
+            if (ntraces == (int)(sizeof(traces) / sizeof(traces[0])) ||
+                bench_read_trace(&traces[ntraces], optarg) < 0)
+                return 2;
+            ntraces++;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+        card_name = argv[optind];
+    if ((elems == NULL) || (iterations <= 0)) {
+        usage(argv[0]);
+        return 2;
+    }
+    ucm_config_dir = config_dir;
+    if (fake_load(elems, card_name) < 0) {
+        fprintf(stderr, "can't read element list %s\n", elems);
+        return 2;
+    }
+    if (ntraces == 0) {
+        for (index = 0; index < (int)(sizeof(builtin_traces) / sizeof(builtin_traces[0]));
+             index++) {
+            traces[ntraces].name = builtin_traces[index].name;
+            for (line = 0; builtin_traces[index].lines[line] != NULL; line++)
+                bench_add_request(&traces[ntraces], builtin_traces[index].lines[line]);
+            ntraces++;
+        }
+    }
+
+    start = snd_ucm_now_us();
+    ioctls = fake.ioctls;
+    ret = snd_use_case_mgr_open(&uc_mgr, card_name);
+    if (ret < 0) {
+        fprintf(stderr, "can't open %s: %s\n", card_name, strerror(-ret));
+        return 1;
+    }
+    open_us = snd_ucm_now_us() - start;
+    printf("open: %lld us, %lu ioctls, %u controls\n", open_us, fake.ioctls - ioctls,
+           fake.elems->count);
+    if (reload) {
+        ret = bench_reload(uc_mgr);
+        snd_use_case_mgr_close(uc_mgr);
+        mixer_close(fake.elems);
+        free(fake.values);
+        free(fake.offset);
+        return ret < 0 ? 1 : 0;
+    }
+    printf("%-10s %6s %10s %8s %8s %8s %8s %8s %8s %6s\n", "trace", "sets", "sets/s",
+           "ioctls", "reads", "writes", "p50 us", "p99 us", "max us", "failed");
+    for (index = 0; index < ntraces; index++)
+        bench_run(uc_mgr, &traces[index], iterations);
+    snd_use_case_mgr_close(uc_mgr);
+    mixer_close(fake.elems);
+    free(fake.values);
+    free(fake.offset);
+    return 0;
+}
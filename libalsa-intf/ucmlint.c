@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2012, Code Aurora Forum. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Code Aurora Forum, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Offline checker and compiler of use case manager configs.
+ *
+ * The tool is built from alsa_ucm.c itself so that the config files go
+ * through the parser, control binding and compiled form used on the
+ * device. Controls are bound to an element list saved on the device with
+ * "amix -s", no sound card is needed.
+ */
+
+#include "ucm_host.h"
+#include "alsa_ucm.c"
+
+#include <getopt.h>
+
+/* Controls written by the enable sequences of up to three sections */
+#define LINT_MAX_WRITES 1024
+
+typedef struct lint_stats {
+    int errors;
+    int warnings;
+} lint_stats_t;
+
+/* Check whether a section can be selected through snd_use_case_set(),
+ * as the verb, a device, a modifier, or the verb or a modifier combined
+ * with a device of the verb
+ * Returns 1 if the section is reachable, 0 otherwise
+ */
+static int lint_reachable(use_case_verb_t *verb, int index)
+{
+    const char *name = verb->card_ctrl[index].case_name;
+    char **mod;
+    char **dev;
+    size_t len;
+
+    /* A lookup returns the first of duplicate names */
+    if (snd_ucm_find_section(verb, name, NULL) != index)
+        return 0;
+    if (!strcmp(name, verb->use_case_name))
+        return 1;
+    for (dev = verb->device_list; strcmp(*dev, SND_UCM_END_OF_LIST); dev++) {
+        if (!strcmp(name, *dev))
+            return 1;
+    }
+    for (mod = verb->modifier_list; strcmp(*mod, SND_UCM_END_OF_LIST); mod++) {
+        if (!strcmp(name, *mod))
+            return 1;
+    }
+    for (dev = verb->device_list; strcmp(*dev, SND_UCM_END_OF_LIST); dev++) {
+        if ((strlen(name) <= strlen(*dev)) ||
+            strcmp(name + strlen(name) - strlen(*dev), *dev))
+            continue;
+        len = strlen(name) - strlen(*dev);
+        if ((strlen(verb->use_case_name) == len) &&
+            !strncmp(name, verb->use_case_name, len))
+            return 1;
+        for (mod = verb->modifier_list; strcmp(*mod, SND_UCM_END_OF_LIST); mod++) {
+            if ((strlen(*mod) == len) && !strncmp(name, *mod, len))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* Report the controls of a sequence missing from the element list and
+ * the values that do not fit their control
+ * Returns number of errors found
+ */
+static int lint_controls(use_case_verb_t *verb, card_mctrl_t *section,
+    mixer_control_t *list, int count, const char *seq)
+{
+    struct mixer_ctl *ctl;
+    unsigned item;
+    int index, errors = 0;
+
+    for (index = 0; index < count; index++) {
+        ctl = list[index].ctl;
+        if (ctl == NULL) {
+            printf("%s: %s: %s: unknown control '%s'\n", verb->use_case_name,
+                   section->case_name, seq, list[index].control_name);
+            errors++;
+            continue;
+        }
+        if (list[index].values != NULL)
+            continue;
+        errors++;
+        if ((list[index].type == TYPE_STR) &&
+            (ctl->info->type == SNDRV_CTL_ELEM_TYPE_ENUMERATED)) {
+            printf("%s: %s: %s: '%s' has no item '%s', items:", verb->use_case_name,
+                   section->case_name, seq, list[index].control_name,
+                   list[index].string);
+            for (item = 0; item < ctl->info->value.enumerated.items; item++)
+                printf(" '%s'", ctl->ename[item]);
+            printf("\n");
+        } else if (list[index].type == TYPE_MULTI_VAL) {
+            printf("%s: %s: %s: '%s' takes %u values, %u given\n", verb->use_case_name,
+                   section->case_name, seq, list[index].control_name,
+                   ctl->info->count, list[index].value);
+        } else {
+            printf("%s: %s: %s: invalid value for '%s'\n", verb->use_case_name,
+                   section->case_name, seq, list[index].control_name);
+        }
+    }
+    return errors;
+}
+
+/* Count the controls of a sequence written more than once
+ * Returns number of duplicate writes
+ */
+static int lint_duplicates(mixer_control_t *list, int count)
+{
+    int index, prev, dups = 0;
+
+    for (index = 1; index < count; index++) {
+        for (prev = 0; prev < index; prev++) {
+            if (list[prev].control_name == list[index].control_name ||
+                !strcmp(list[prev].control_name, list[index].control_name))
+                break;
+        }
+        if (prev < index)
+            dups++;
+    }
+    return dups;
+}
+
+/* Add the enable sequence of a section to the writes of a transition,
+ * a control written by several sections is written once
+ * Returns number of writes
+ */
+static int lint_add_writes(use_case_verb_t *verb, int index, const char **writes,
+    int count)
+{
+    card_mctrl_t *section;
+    int ctl, prev;
+
+    if (index < 0)
+        return count;
+    section = &verb->card_ctrl[index];
+    for (ctl = 0; ctl < section->ena_mixer_count && count < LINT_MAX_WRITES; ctl++) {
+        for (prev = 0; prev < count; prev++) {
+            if (!strcmp(writes[prev], section->ena_mixer_list[ctl].control_name))
+                break;
+        }
+        if (prev == count)
+            writes[count++] = section->ena_mixer_list[ctl].control_name;
+    }
+    return count;
+}
+
+/* Check a verb and print its statistics. A transition is counted as
+ * selecting the verb with one of its devices, each control it writes
+ * costs a read and, if the value differs, a write ioctl.
+ */
+static void lint_verb(card_ctxt_t *card_ctxt, use_case_verb_t *verb, int verbose,
+    lint_stats_t *stats)
+{
+    const char *writes[LINT_MAX_WRITES];
+    card_mctrl_t *section;
+    char **dev;
+    int index, count, controls = 0, dups = 0, devices = 0, modifiers = 0;
+    int min = -1, max = 0, total = 0;
+
+    for (index = 0; index < verb->use_case_count; index++) {
+        section = &verb->card_ctrl[index];
+        controls += section->ena_mixer_count + section->dis_mixer_count;
+        dups += lint_duplicates(section->ena_mixer_list, section->ena_mixer_count) +
+            lint_duplicates(section->dis_mixer_list, section->dis_mixer_count);
+        if (!lint_reachable(verb, index)) {
+            printf("%s: %s: warning: section is unreachable%s\n", verb->use_case_name,
+                   section->case_name,
+                   (snd_ucm_find_section(verb, section->case_name, NULL) != index) ?
+                   ", an earlier section has the same name" : "");
+            stats->warnings++;
+        }
+        if (card_ctxt->mixer_handle == NULL)
+            continue;
+        stats->errors += lint_controls(verb, section,
+            section->ena_mixer_list, section->ena_mixer_count, "enable");
+        stats->errors += lint_controls(verb, section,
+            section->dis_mixer_list, section->dis_mixer_count, "disable");
+    }
+    for (index = 0; strcmp(verb->modifier_list[index], SND_UCM_END_OF_LIST); index++)
+        modifiers++;
+    if (snd_ucm_find_section(verb, verb->use_case_name, NULL) < 0) {
+        printf("%s: error: no section named after the verb\n", verb->use_case_name);
+        stats->errors++;
+    }
+
+    for (dev = verb->device_list; strcmp(*dev, SND_UCM_END_OF_LIST); dev++) {
+        count = lint_add_writes(verb, snd_ucm_find_section(verb, verb->use_case_name, NULL),
+            writes, 0);
+        count = lint_add_writes(verb, snd_ucm_find_section(verb, *dev, NULL), writes, count);
+        count = lint_add_writes(verb, snd_ucm_find_section(verb, verb->use_case_name, *dev),
+            writes, count);
+        if (verbose)
+            printf("%s: %s: %d controls, up to %d ioctls\n", verb->use_case_name, *dev,
+                   count, 2 * count);
+        if ((min < 0) || (count < min))
+            min = count;
+        if (count > max)
+            max = count;
+        total += count;
+        devices++;
+    }
+    if (min < 0)
+        min = 0;
+    printf("%-20s %4d sections %3d devices %3d modifiers %5d controls %3d duplicate"
+           " writes, transition %d/%d/%d controls, up to %d ioctls\n",
+           verb->use_case_name, verb->use_case_count, devices, modifiers, controls, dups,
+           min, devices ? total / devices : 0, max, 2 * max);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-c config_dir] [-m elements] [-o out_dir] [-v] card_name\n"
+            "  -c  directory of the config files, default %s\n"
+            "  -m  element list of the card saved with 'amix -s', controls\n"
+            "      and values are checked against it\n"
+            "  -o  write the compiled config to out_dir\n"
+            "  -v  print the transition cost of every device\n", prog, CONFIG_DIR);
+}
+
+int main(int argc, char **argv)
+{
+    snd_use_case_mgr_t *uc_mgr;
+    card_ctxt_t *card_ctxt;
+    lint_stats_t stats;
+    const char *elems = NULL, *out_dir = NULL;
+    char config_dir[200], cache_dir[200], path[200];
+    int opt, index, verbose = 0, ret;
+
+    strlcpy(config_dir, CONFIG_DIR, sizeof(config_dir));
+    while ((opt = getopt(argc, argv, "c:m:o:vh")) != -1) {
+        switch (opt) {
+        case 'c':
+            strlcpy(config_dir, optarg, sizeof(config_dir) - 1);
+            if (config_dir[strlen(config_dir) - 1] != '/')
+                strlcat(config_dir, "/", sizeof(config_dir));
+            break;
+        case 'm':
+            elems = optarg;
+            break;
+        case 'o':
+            out_dir = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    ucm_config_dir = config_dir;
+    memset(&stats, 0, sizeof(stats));
+
+    uc_mgr = (snd_use_case_mgr_t *)calloc(1, sizeof(snd_use_case_mgr_t));
+    card_ctxt = (card_ctxt_t *)calloc(1, sizeof(card_ctxt_t));
+    if ((uc_mgr == NULL) || (card_ctxt == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    uc_mgr->card_ctxt_ptr = card_ctxt;
+    card_ctxt->card_name = argv[optind];
+    pthread_mutex_init(&card_ctxt->card_lock, NULL);
+    pthread_cond_init(&card_ctxt->verb_cond, NULL);
+    if (elems != NULL) {
+        card_ctxt->mixer_handle = mixer_elems_open(elems);
+        if (card_ctxt->mixer_handle == NULL) {
+            fprintf(stderr, "can't read element list %s\n", elems);
+            return 2;
+        }
+    }
+    card_ctxt->ctl_pool = snd_ucm_ctl_pool_create(card_ctxt->mixer_handle);
+    card_ctxt->str_pool = snd_ucm_str_pool_create();
+    if ((card_ctxt->ctl_pool == NULL) || (card_ctxt->str_pool == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    ret = snd_ucm_parse_master(card_ctxt);
+    if (ret < 0) {
+        fprintf(stderr, "can't parse %s%s: %s\n", config_dir, card_ctxt->card_name,
+                strerror(-ret));
+        return 2;
+    }
+    for (index = 0; index < card_ctxt->verb_count; index++) {
+        pthread_mutex_lock(&card_ctxt->card_lock);
+        ret = snd_ucm_load_verb(uc_mgr, index);
+        pthread_mutex_unlock(&card_ctxt->card_lock);
+        if (ret < 0) {
+            printf("%s: error: failed to parse %s\n", card_ctxt->verb_list[index],
+                   card_ctxt->use_case_verb_list[index].file_name ?
+                   card_ctxt->use_case_verb_list[index].file_name : "(no file)");
+            stats.errors++;
+            continue;
+        }
+        lint_verb(card_ctxt, &card_ctxt->use_case_verb_list[index], verbose, &stats);
+    }
+
+    if ((out_dir != NULL) && (stats.errors == 0)) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s/", out_dir);
+        ucm_cache_dir = cache_dir;
+        ret = snd_ucm_cache_write(uc_mgr);
+        snd_ucm_cache_path(card_ctxt, path, sizeof(path));
+        if (ret < 0) {
+            fprintf(stderr, "can't write %s: %s\n", path, strerror(-ret));
+            stats.errors++;
+        } else {
+            printf("wrote %s\n", path);
+        }
+    }
+    printf("%s: %d verbs, %d errors, %d warnings\n", card_ctxt->card_name,
+           card_ctxt->verb_count, stats.errors, stats.warnings);
+
+    snd_ucm_free_mixer_list(&uc_mgr);
+    snd_ucm_ctl_pool_destroy(card_ctxt->ctl_pool);
+    snd_ucm_str_pool_destroy(card_ctxt->str_pool);
+    if (card_ctxt->mixer_handle)
+        mixer_close(card_ctxt->mixer_handle);
+    pthread_mutex_destroy(&card_ctxt->card_lock);
+    pthread_cond_destroy(&card_ctxt->verb_cond);
+    free(card_ctxt);
+    free(uc_mgr);
+    return stats.errors ? 1 : 0;
+}